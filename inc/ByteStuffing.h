@@ -0,0 +1,86 @@
+#ifndef BYTE_STUFFING_H
+#define BYTE_STUFFING_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t
+
+// Byte stuffing and unstuffing kernels, see the "Byte Stuffing" section of the README.
+// Every START_BYTE, END_BYTE and ESCAPE_BYTE is replaced by an ESCAPE_BYTE followed by the byte XORed with ESCAPE_MASK.
+
+// Byte stuff size bytes from src into dst, using the widest vector instructions available
+// (AVX2 or SSE2 on x86, NEON on ARM, scalar otherwise).
+// dst must have room for 2 * size bytes and must not overlap src.
+// Returns the number of bytes written to dst.
+size_t StuffBytes(const uint8_t *src, size_t size, uint8_t *dst);
+
+// Same as StuffBytes(), one byte at a time. Used as a reference and as the fallback.
+size_t StuffBytesScalar(const uint8_t *src, size_t size, uint8_t *dst);
+
+// Position of the first START_BYTE, END_BYTE or ESCAPE_BYTE in data, or size if there is none.
+// Scans 16 or 32 bytes at a time like StuffBytes().
+size_t FindSpecialByte(const uint8_t *data, size_t size);
+size_t FindSpecialByteScalar(const uint8_t *data, size_t size);
+
+// Unstuff bytes from src into dst, copying the runs between escape sequences in bulk.
+// Stops at the end of src, once maxOutput bytes have been written, or before an unescaped START_BYTE or END_BYTE,
+// which delimit frames and are never part of the stuffed data.
+// escapePending carries an ESCAPE_BYTE found at the end of src over to the next call.
+// dst may be the same as src, or behind it, for unstuffing in place.
+// Returns the number of bytes written to dst, and sets consumed to the number of bytes read from src.
+size_t UnstuffBytes(const uint8_t *src, size_t size, uint8_t *dst, size_t maxOutput, bool &escapePending,
+                    size_t &consumed);
+
+// Same as UnstuffBytes(), looking at one byte at a time. Used as a reference and as the fallback.
+size_t UnstuffBytesScalar(const uint8_t *src, size_t size, uint8_t *dst, size_t maxOutput, bool &escapePending,
+                          size_t &consumed);
+
+// Consistent Overhead Byte Stuffing (COBS), see the "COBS Framing" section of the README.
+// Zero bytes are removed, so that a zero byte can delimit frames. The data is split into blocks, each one starting
+// with a code byte: the number of bytes up to the next removed zero, plus one, or 0xFF for 254 bytes without any zero.
+// The overhead is at most one byte per 254 bytes, plus one.
+
+// Longest run of data bytes in a COBS block
+constexpr size_t COBS_MAX_BLOCK_SIZE = 254;
+
+// Worst case size of size bytes once COBS encoded, without the zero delimiter
+constexpr size_t CobsMaxEncodedSize(size_t size)
+{
+    return size + size / COBS_MAX_BLOCK_SIZE + 1;
+}
+
+// COBS encoder taking its input in several pieces, so that a frame can be encoded without gathering it first.
+// The encoded bytes are written to dst, which must have room for CobsMaxEncodedSize() of the whole input.
+class CobsEncoder
+{
+  public:
+    explicit CobsEncoder(uint8_t *dst);
+
+    // Encode the next size bytes of the input
+    void Write(const uint8_t *src, size_t size);
+
+    // Complete the last block.
+    // Returns the number of bytes written to dst, without the zero delimiter, which is left to the caller.
+    size_t Finish();
+
+  private:
+    uint8_t *dst;
+    size_t codeIndex; // Where the code byte of the current block goes
+    size_t index;     // Where the next byte goes
+    bool afterFullBlock; // The current block follows a full block, so it can be left out if it stays empty
+};
+
+// COBS encode size bytes from src into dst, which must have room for CobsMaxEncodedSize(size) bytes.
+// Returns the number of bytes written to dst, without the zero delimiter.
+size_t CobsEncode(const uint8_t *src, size_t size, uint8_t *dst);
+
+// Decode a whole COBS encoded frame from src into dst, without its zero delimiter.
+// dst may be the same as src, or behind it, for decoding in place.
+// Returns false if the frame is malformed, and sets decodedSize to the number of bytes written to dst otherwise.
+bool CobsDecode(const uint8_t *src, size_t size, uint8_t *dst, size_t &decodedSize);
+
+// Copy bytes from src to dst until the first zero byte, or size bytes.
+// dst may be the same as src, or behind it.
+// Returns the number of bytes copied.
+size_t CopyUntilZero(const uint8_t *src, size_t size, uint8_t *dst);
+
+#endif // BYTE_STUFFING_H
@@ -2,9 +2,14 @@
 #ifndef CM4_UART_H
 #define CM4_UART_H
 
+#include "IoUring.h"
+#include "SpscRing.h"
 #include "UART.h"
 #include "quill/Quill.h" // For Logger
+#include <atomic>
 #include <string>
+#include <termios.h> // For termios
+#include <thread>
 
 class CM4UART : public UART
 {
@@ -13,8 +18,68 @@ class CM4UART : public UART
     ~CM4UART();
     bool Begin() override;
 
+    // Number of packets each way between the I/O thread and the control thread
+    static constexpr size_t IO_RING_SIZE = 64;
+
+    // Threaded mode: start a thread doing all the I/O of the device, so that serial I/O no longer lands in the
+    // control loop. The thread blocks in poll() until bytes arrive or the send buffer has room, deframes the packets
+    // received and hands them to ReceiveUARTPackets() through a wait-free ring, and encodes and sends the packets of
+    // SendUARTPacket(), SendPacket() and SendFrame(), which come back through another one. The handlers still run
+    // on the thread calling ReceiveUARTPackets(), and SendUARTPackets() only wakes the I/O thread up when packets
+    // are waiting for it, without pacing them with maxBytes. Packets that do not fit in the send buffer or the queue
+    // of their class wait in the ring, and SendUARTPacket() returns false once it is full.
+    // Must be called after Begin(), from the thread that sends and receives, once the framing, the priorities, the
+    // mailboxes and the handlers are set up. The counters of UART are only up to date once the thread is stopped.
+    // Returns false if the device is not open or the thread is already running.
+    bool StartIOThread();
+
+    // Stop the I/O thread, once it has encoded the packets already sent. The bytes it could not send yet are sent by
+    // the next calls to SendUARTPackets(), and the packets it received by the next call to ReceiveUARTPackets().
+    // Packets still waiting for room in the ring are dropped if there is none yet.
+    void StopIOThread();
+
+    // Packets received by the I/O thread and dropped because the control thread had IO_RING_SIZE packets waiting
+    uint32_t DroppedReceivedPackets() const;
+
+    // Block until packets are received, and call their handlers like ReceiveUARTPackets(), or until
+    // timeoutMicroseconds have passed. The thread sleeps in ppoll() without using the CPU, on the device or on the
+    // I/O thread, and wakes up as soon as a frame is complete: VMIN is kept at the fewest bytes that can complete
+    // the next packet, so the bytes of a frame arriving in several chunks do not wake it up for each one.
+    // Returns the number of packets received, 0 on timeout.
+    int WaitForPackets(uint32_t timeoutMicroseconds);
+
+    // Read and write the device through io_uring instead of read() and write(). A read is always posted, into memory
+    // registered with the ring, and its bytes are picked up from the completion ring without any system call. The
+    // bytes sent are copied into registered memory and written by a single request, submitted in the same system
+    // call as the next read, on a non-blocking description of the device of its own. While the device is busy, the
+    // write fails with EAGAIN and is submitted again by each call to SendUARTPackets(), with a system call each time.
+    // With kernelPolling, a kernel thread takes the requests from the submission ring, and a system call is only
+    // needed to wake it up once it has been idle for a while, at the cost of the core it polls on.
+    // VMIN stays at 1 in this mode, since changing it takes a system call.
+    // Must be called after Begin(), and not with the I/O thread, which is the other way to take the I/O out of the
+    // control loop.
+    // Returns false, and keeps using read() and write(), if io_uring is not supported by the build or the kernel,
+    // or not allowed. The transport also falls back to them if a request fails, once the requests in flight are
+    // cancelled and the rest of the last write is written.
+    bool UseIoUring(bool kernelPolling = false);
+
+    // Whether the device is read and written through io_uring
+    bool UsingIoUring() const;
+
+    // Number of system calls made to read and write the device so far: read(), readv(), write(), writev(),
+    // io_uring_enter(), and tcsetattr() for VMIN
+    uint32_t SystemCalls() const;
+
+    bool SendUARTPacket(const uint8_t id, const PayloadView &payload) override;
+    bool SendFrame(const uint8_t id, FrameRef frame) override;
+    size_t SendUARTPackets(size_t maxBytes = SIZE_MAX) override;
+    int ReceiveUARTPackets() override;
+
     size_t Send(const unsigned char *data, const size_t data_size) override;
+    size_t SendSegments(const unsigned char *first, size_t firstSize, const unsigned char *second,
+                        size_t secondSize) override;
     size_t Receive(unsigned char *data, const size_t data_size) override;
+    size_t ReceiveSegments(unsigned char *first, size_t firstSize, unsigned char *second, size_t secondSize) override;
     void Log(LOG_LEVEL level, std::string message) override;
 
   private:
@@ -22,6 +87,60 @@ class CM4UART : public UART
     const char *device;
     quill::Logger *logger;
     int uart_fd;
+    struct termios settings; // Last attributes set on the device
+
+    // A packet handed between the I/O thread and the control thread
+    struct IOPacket
+    {
+        uint8_t id;
+        Payload payload;
+    };
+    SpscRing<IOPacket, IO_RING_SIZE> receivedPackets; // From the I/O thread to ReceiveUARTPackets()
+    SpscRing<IOPacket, IO_RING_SIZE> sentPackets;     // From SendUARTPacket() to the I/O thread
+    std::thread ioThread;
+    bool threaded;                         // The I/O thread is running, only used by the control thread
+    int wakeFd;                            // eventfd waking the I/O thread up
+    std::atomic<bool> stopRequested;       // Set by StopIOThread()
+    std::atomic<size_t> ioPendingBytes;    // Bytes waiting in the I/O thread after its last pass
+    std::atomic<uint32_t> droppedReceived; // See DroppedReceivedPackets()
+    int receivedFd;                        // eventfd waking WaitForPackets() up from the I/O thread
+    std::atomic<bool> waitingForPackets;   // WaitForPackets() is waiting on receivedFd
+
+    // io_uring transport, see UseIoUring()
+    IoUring ring;
+    bool uringActive;
+    bool uringKernelPolling;
+    int completionFd;                             // eventfd signalled by the ring, for WaitForPackets()
+    int uringWriteFd;                             // Non-blocking description of the device for the writes
+    uint8_t uringReceiveBuffer[RING_BUFFER_SIZE]; // Registered memory of the posted read
+    size_t uringReceiveSize;                      // Bytes of the last read completed
+    size_t uringReceiveOffset;                    // Bytes of the last read completed handed over so far
+    bool readPosted;                              // A read is queued or in flight
+    uint8_t uringSendBuffer[SEND_BUFFER_SIZE];    // Registered memory of the write in flight
+    size_t uringSendSize;                         // Bytes of the write in flight
+    size_t uringSendOffset;                       // Bytes of the write in flight written so far
+    bool writePosted;                             // A write is queued or in flight
+    std::atomic<uint32_t> systemCalls;            // See SystemCalls(), without those of the ring
+
+    // Take the completions of the ring, and post the next read once the bytes of the last one are handed over
+    void ProcessCompletions();
+    // Update the state of the transport with a completion
+    void TakeCompletion(uint64_t request, int32_t result);
+    // Cancel the requests in flight, and go back to read() and write(). With sendRest, the rest of the last write
+    // is written first.
+    void StopIoUring(bool sendRest);
+
+    // Body of the I/O thread
+    void RunIOThread();
+    // Wake the I/O thread up from poll()
+    void WakeIOThread();
+    // Wake WaitForPackets() up if it is waiting for the I/O thread
+    void NotifyReceivedPackets();
+    // Set VMIN to MinimumBytesToNextPacket(), so that poll() only reports the device readable once a packet can be
+    // complete
+    void UpdateWakeupThreshold();
+    // PacketSink of the I/O thread, pushing the packets to receivedPackets
+    static void ForwardReceivedPacket(void *context, uint8_t id, PayloadView &payload);
 };
 
 #endif // CM4_UART_H
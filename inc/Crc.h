@@ -0,0 +1,27 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t
+
+// CRCs used to check the integrity of packets, see the "Integrity Check" section of the README.
+// Both can be computed incrementally: pass the result of the previous call as crc to continue.
+
+// CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF, not reflected), check value 0x29B1.
+// Computed with slice-by-8 tables.
+uint16_t Crc16Ccitt(const uint8_t *data, size_t size, uint16_t crc = 0xFFFF);
+
+// Same as Crc16Ccitt(), one byte at a time. Used as a reference.
+uint16_t Crc16CcittScalar(const uint8_t *data, size_t size, uint16_t crc = 0xFFFF);
+
+// CRC-32C (Castagnoli polynomial 0x1EDC6F41, reflected), check value 0xE3069283.
+// Computed with the SSE4.2 or ARMv8 CRC32 instructions where available, slice-by-8 tables otherwise.
+uint32_t Crc32c(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+// Same as Crc32c(), one byte at a time. Used as a reference.
+uint32_t Crc32cScalar(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+// Same as Crc32c(), always with the slice-by-8 tables. Used as a reference and as the fallback.
+uint32_t Crc32cSliceBy8(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+#endif // CRC_H
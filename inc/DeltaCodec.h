@@ -0,0 +1,140 @@
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+
+#ifndef ARDUINO
+#include "Packets.h"
+#include "Payload.h"
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t, uint32_t
+
+// Delta encoding of consecutive ControlInputPackets, sent with PacketId::ControlInputDelta, see the
+// "Delta Encoding" section of the README.
+//
+// Every field of the packet is quantized to a 32-bit number of steps (see DELTA_STEPS in DeltaCodec.cpp), and only
+// the fields that differ from a reference packet are sent, as zigzag varints of their difference. The reference is
+// the latest packet that the decoder acknowledged with a DeltaAckPacket, so that a lost frame never leaves the two
+// ends with different references. Without a reference the encoder sends a keyframe: a delta against all zero fields.
+//
+// Frame layout:
+//   flags        uint8, DELTA_FLAG_KEYFRAME
+//   sequence     uint8, incremented for each frame
+//   reference    uint8, sequence of the reference packet, omitted in keyframes
+//   presence     DELTA_PRESENCE_SIZE bytes, bit i set when field i differs from the reference
+//   deltas       zigzag varint of the difference of each field present, modulo 2^32
+//   checksum     uint16, CRC-16/CCITT of the fields of the decoded packet
+// The checksum catches a decoder that would apply a delta to the wrong reference: it drops the frame and asks for
+// a keyframe, as it does for a frame referencing a packet it no longer has.
+
+constexpr size_t DELTA_FIELDS = 28;
+constexpr size_t DELTA_PRESENCE_SIZE = (DELTA_FIELDS + 7) / 8;
+// Packets kept by both ends to serve as references, the reference must be one of the last DELTA_HISTORY frames sent
+constexpr size_t DELTA_HISTORY = 16;
+constexpr uint8_t DELTA_FLAG_KEYFRAME = 0x01;
+// A varint of a 32-bit value takes at most 5 bytes
+constexpr size_t DELTA_FRAME_MAX_SIZE = 3 + DELTA_PRESENCE_SIZE + DELTA_FIELDS * 5 + 2;
+
+// Fields of a ControlInputPacket, as numbers of steps
+struct DeltaFields
+{
+    uint32_t values[DELTA_FIELDS];
+};
+
+// Quantize the fields of packet, or restore a packet from them.
+// Restoring a quantized packet gives the packet as the decoder sees it.
+void QuantizeDeltaFields(const ControlInputPacket &packet, DeltaFields &fields);
+void RestoreDeltaFields(const DeltaFields &fields, ControlInputPacket &packet);
+
+// Encoder side, on the CM4. Feed it every DeltaAckPacket received.
+class DeltaEncoder
+{
+  public:
+    // Send a keyframe every keyframeInterval frames, so that a decoder that missed the acknowledged packets
+    // catches up even without asking. 0 disables the periodic keyframes.
+    explicit DeltaEncoder(uint32_t keyframeInterval = 100);
+
+    // Append the frame of packet to payload.
+    // Returns false, and leaves the encoder unchanged, if the frame does not fit.
+    bool Encode(const ControlInputPacket &packet, Payload &payload);
+
+    // Use the acknowledged packet as the reference, or send a keyframe if the decoder asks for one
+    void OnAck(const DeltaAckPacket &ack);
+
+    // Send the next frame as a keyframe
+    void RequestKeyframe()
+    {
+        keyframePending = true;
+    }
+
+    // Statistics
+    uint32_t GetFramesEncoded() const
+    {
+        return framesEncoded;
+    }
+    uint32_t GetKeyframesEncoded() const
+    {
+        return keyframesEncoded;
+    }
+
+  private:
+    // Whether sequence is one of the last DELTA_HISTORY frames sent
+    bool InHistory(uint8_t sequence) const;
+
+    uint32_t keyframeInterval;
+    uint32_t framesSinceKeyframe;
+    uint8_t nextSequence;
+    uint8_t referenceSequence;
+    bool hasReference;
+    bool keyframePending;
+    uint32_t framesEncoded;
+    uint32_t keyframesEncoded;
+    // Frames sent, indexed by sequence modulo DELTA_HISTORY
+    DeltaFields history[DELTA_HISTORY];
+};
+
+// Decoder side, on the Teensy. Send GetAck() back after each frame, decoded or not.
+class DeltaDecoder
+{
+  public:
+    DeltaDecoder();
+
+    // Decode a frame into packet.
+    // Returns false, and asks for a keyframe in the next ack, if the frame is malformed, references a packet that is
+    // no longer known, or does not match its checksum.
+    bool Decode(PayloadView payload, ControlInputPacket &packet);
+
+    // Acknowledgement of the last packet decoded, with a keyframe request until a keyframe is decoded
+    DeltaAckPacket GetAck() const
+    {
+        return {lastSequence, keyframeRequested};
+    }
+
+    // Forget the previous packets and ask for a keyframe, for example after the link lost bytes
+    void RequestKeyframe();
+
+    // Statistics
+    uint32_t GetFramesDecoded() const
+    {
+        return framesDecoded;
+    }
+    uint32_t GetFramesRejected() const
+    {
+        return framesRejected;
+    }
+
+  private:
+    bool Reject();
+
+    uint8_t lastSequence;
+    bool keyframeRequested;
+    uint32_t framesDecoded;
+    uint32_t framesRejected;
+    // Packets decoded, indexed by sequence modulo DELTA_HISTORY
+    DeltaFields history[DELTA_HISTORY];
+    uint8_t historySequence[DELTA_HISTORY];
+    bool historyValid[DELTA_HISTORY];
+};
+
+#endif // DELTA_CODEC_H
@@ -0,0 +1,129 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#ifndef ARDUINO
+#include "Payload.h"
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#include <atomic>
+#include <cstddef> // For size_t
+#include <cstdint> // For uint16_t, uint32_t
+
+class FramePool;
+
+// Shared reference to a frame of a FramePool, like a std::shared_ptr<Payload> without any allocation.
+// Copying a reference only increments the reference count of the frame, and the frame goes back to its pool
+// when the last reference to it is released, from any thread.
+// The payload of a frame must only be written before the reference is shared.
+class FrameRef
+{
+  public:
+    FrameRef() : pool(nullptr), frame(nullptr)
+    {
+    }
+
+    FrameRef(const FrameRef &other);
+    FrameRef(FrameRef &&other) noexcept;
+    FrameRef &operator=(const FrameRef &other);
+    FrameRef &operator=(FrameRef &&other) noexcept;
+    ~FrameRef();
+
+    // Release the frame, the reference is then empty
+    void Reset();
+
+    // Whether the reference holds a frame
+    explicit operator bool() const
+    {
+        return frame != nullptr;
+    }
+
+    // The payload of the frame, the reference must not be empty
+    Payload &operator*() const;
+    Payload *operator->() const;
+
+    // View over the payload of the frame, the reference must not be empty
+    PayloadView GetView() const
+    {
+        return (**this).GetView();
+    }
+    operator PayloadView() const
+    {
+        return GetView();
+    }
+
+    // Number of references to the frame, 0 for an empty reference
+    uint32_t UseCount() const;
+
+  private:
+    friend class FramePool;
+    struct Frame;
+
+    FrameRef(FramePool *pool, Frame *frame) : pool(pool), frame(frame)
+    {
+    }
+
+    FramePool *pool;
+    Frame *frame;
+};
+
+struct FrameRef::Frame
+{
+    std::atomic<uint32_t> refCount;
+    std::atomic<uint16_t> next; // Next free frame, while in the free list
+    Payload payload;
+};
+
+// Fixed-size pool of reference-counted frames, each holding a Payload.
+// Frames are taken and given back with a lock-free free list, so handlers can hand received packets to other threads
+// or queues, and outgoing packets can be built in place and queued with UART::SendFrame(), without copying them.
+class FramePool
+{
+  public:
+    // Number of frames in the pool
+    static constexpr size_t SIZE = 16;
+
+    FramePool();
+    ~FramePool() = default;
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // Take a frame with an empty payload.
+    // Returns an empty reference, and counts a failure, if all the frames are in use.
+    FrameRef Allocate();
+
+    // Take a frame holding a copy of the given bytes, to keep a received payload past the call to its handler.
+    // Returns an empty reference, and counts a failure, if all the frames are in use.
+    FrameRef Retain(const PayloadView &payload);
+
+    // Number of frames currently in use, and the most that have been in use at once
+    size_t InUse() const;
+    size_t PeakInUse() const;
+
+    // Number of times a frame could not be taken because all of them were in use
+    size_t AllocationFailures() const;
+
+  private:
+    friend class FrameRef;
+
+    // Index marking the end of the free list
+    static constexpr uint16_t NO_FRAME = UINT16_MAX;
+    static_assert(SIZE < NO_FRAME, "FramePool::SIZE must fit in the 16-bit frame indexes");
+
+    // Give a frame back to the free list, once its last reference is released
+    void Free(FrameRef::Frame *frame);
+
+    FrameRef::Frame frames[SIZE];
+
+    // Index of the first free frame in the low 16 bits, and a tag in the high 16 bits that changes on every update,
+    // so that a compare-and-swap fails if the head was popped and pushed back in the meantime (ABA).
+    // 32 bits keep the free list lock-free on the Teensy, which has no 64-bit compare-and-swap.
+    std::atomic<uint32_t> freeHead;
+
+    std::atomic<uint32_t> inUse;
+    std::atomic<uint32_t> peakInUse;
+    std::atomic<uint32_t> allocationFailures;
+};
+
+#endif // FRAME_POOL_H
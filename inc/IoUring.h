@@ -0,0 +1,111 @@
+#ifndef ARDUINO // Compiles only in a non-Arduino environment
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint16_t, uint32_t, uint64_t
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct iovec;
+
+// Minimal io_uring, set up with the raw system calls so that it does not need liburing.
+// Requests are queued in the submission ring shared with the kernel, and handed over in batches by Submit(), and
+// their results are taken from the completion ring without any system call. With kernel polling, a kernel thread
+// picks the requests up from the submission ring by itself, and Submit() only makes a system call to wake it up once
+// it has been idle for a while.
+// Only reads and writes of registered buffers, on registered files, are supported.
+// Without HAS_IO_URING (see CMakeLists.txt), Setup() always fails.
+class IoUring
+{
+  public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // Set up a ring of at least entries requests, polled by a kernel thread if kernelPolling.
+    // Returns false if io_uring is not supported by the build or the kernel, or not allowed.
+    bool Setup(unsigned entries, bool kernelPolling);
+
+    // Tear the ring down, cancelling the requests in flight
+    void Close();
+
+    bool IsOpen() const
+    {
+        return ringFd >= 0;
+    }
+
+    // Register the files the requests are made on, by their index in fds. Returns false on error.
+    bool RegisterFiles(const int *fds, unsigned count);
+
+    // Register the memory of the buffers used by the requests, which stays pinned until Close().
+    // Returns false on error.
+    bool RegisterBuffers(const struct iovec *buffers, unsigned count);
+
+    // Have the kernel signal an eventfd for each completion, to wait for completions with poll().
+    // Returns false on error.
+    bool RegisterEventFd(int fd);
+
+    // Queue a read of up to size bytes into buffer, inside the registered buffer bufferIndex, or a write of size
+    // bytes from it, on the registered file fileIndex. userData comes back with the completion.
+    // Returns false if the submission ring is full.
+    bool QueueReadFixed(int fileIndex, void *buffer, unsigned size, uint16_t bufferIndex, uint64_t userData);
+    bool QueueWriteFixed(int fileIndex, const void *buffer, unsigned size, uint16_t bufferIndex, uint64_t userData);
+
+    // Queue the cancellation of the requests made with targetUserData. Its own completion comes with userData.
+    // Returns false if the submission ring is full.
+    bool QueueCancel(uint64_t targetUserData, uint64_t userData);
+
+    // Whether queued requests were not taken by the kernel yet
+    bool HasQueuedRequests() const;
+
+    // Hand the queued requests to the kernel, with a single system call at most. The kernel may take only some of
+    // them, the others stay queued for the next call.
+    // Returns false on error.
+    bool Submit();
+
+    // Take the oldest completion, without any system call. result is the return value of the request, or -errno.
+    // Returns false if there is none.
+    bool PopCompletion(uint64_t &userData, int32_t &result);
+
+    // Number of io_uring_enter() system calls made by Submit() so far
+    uint32_t SystemCalls() const
+    {
+        return systemCalls;
+    }
+
+  private:
+    int ringFd;
+    bool kernelPolling;
+    uint32_t systemCalls;
+
+    // Memory shared with the kernel
+    void *submissionRing;
+    size_t submissionRingSize;
+    void *completionRing;
+    size_t completionRingSize;
+    struct io_uring_sqe *submissions;
+    size_t submissionsSize;
+
+    // Fields of the rings
+    unsigned *submissionHead;
+    unsigned *submissionTail;
+    unsigned *submissionFlags;
+    unsigned *submissionIndexes;
+    unsigned submissionMask;
+    unsigned submissionEntries;
+    unsigned queuedTail; // Tail including the requests queued since the last Submit()
+    unsigned *completionHead;
+    unsigned *completionTail;
+    unsigned completionMask;
+    struct io_uring_cqe *completions;
+
+    // Fill the next free entry of the submission ring. Returns false if it is full.
+    bool QueueFixed(uint8_t opcode, uint8_t flags, int fileIndex, const void *buffer, unsigned size,
+                    uint16_t bufferIndex, uint64_t userData);
+};
+
+#endif // IO_URING_H
+#endif // ARDUINO
@@ -0,0 +1,542 @@
+// Generated by tools/generate_packets.py from schema/packets.schema, do not edit.
+// Regenerate it with the packet_codecs target after changing the schema, and commit it along with the schema.
+
+#ifndef PACKET_CODECS_H
+#define PACKET_CODECS_H
+
+#ifndef ARDUINO
+#include "Packets.h"
+#include "Quantize.h"
+#endif // ARDUINO
+
+#include <cstddef> // For size_t, offsetof
+#include <cstdint> // For uint8_t
+#include <cstring> // For memcpy
+
+// Hash of the schema, both ends of a link must have the same
+constexpr uint32_t PACKET_SCHEMA_HASH = 0xA1F5B2F6;
+
+// How the packets are encoded on a link, both ends must use the same, see UART::SetEncoding()
+enum class WireEncoding
+{
+    FULL,    // Every field as it is in memory
+    COMPACT, // The fields marked with '~' in the schema quantized, see Quantize.h
+};
+
+// Compile-time wire format of the structs and packets of the schema:
+//  - structs: SIZE, and Encode() and Decode(), which return the position right after the value
+//  - packets: MIN_SIZE, MAX_SIZE, and Size() of a given packet, and the same for the compact encoding
+template <typename T> struct WireFormat;
+
+// Encoders and decoders of the primitive types, they return the position right after the value
+inline uint8_t *EncodeBool(uint8_t *out, bool value)
+{
+    *out = value ? 1 : 0;
+    return out + 1;
+}
+inline const uint8_t *DecodeBool(const uint8_t *in, bool &value)
+{
+    value = *in != 0;
+    return in + 1;
+}
+inline uint8_t *EncodeUint8(uint8_t *out, uint8_t value)
+{
+    std::memcpy(out, &value, 1);
+    return out + 1;
+}
+inline const uint8_t *DecodeUint8(const uint8_t *in, uint8_t &value)
+{
+    std::memcpy(&value, in, 1);
+    return in + 1;
+}
+inline uint8_t *EncodeInt32(uint8_t *out, int32_t value)
+{
+    std::memcpy(out, &value, 4);
+    return out + 4;
+}
+inline const uint8_t *DecodeInt32(const uint8_t *in, int32_t &value)
+{
+    std::memcpy(&value, in, 4);
+    return in + 4;
+}
+inline uint8_t *EncodeUint32(uint8_t *out, uint32_t value)
+{
+    std::memcpy(out, &value, 4);
+    return out + 4;
+}
+inline const uint8_t *DecodeUint32(const uint8_t *in, uint32_t &value)
+{
+    std::memcpy(&value, in, 4);
+    return in + 4;
+}
+inline uint8_t *EncodeFloat(uint8_t *out, float value)
+{
+    std::memcpy(out, &value, 4);
+    return out + 4;
+}
+inline const uint8_t *DecodeFloat(const uint8_t *in, float &value)
+{
+    std::memcpy(&value, in, 4);
+    return in + 4;
+}
+inline uint8_t *EncodeDouble(uint8_t *out, double value)
+{
+    std::memcpy(out, &value, 8);
+    return out + 8;
+}
+inline const uint8_t *DecodeDouble(const uint8_t *in, double &value)
+{
+    std::memcpy(&value, in, 8);
+    return in + 8;
+}
+
+// Encoders and decoders of the structs, the caller checks the size
+
+// Vec3
+constexpr size_t VEC3_WIRE_SIZE = 24;
+inline uint8_t *EncodeVec3(uint8_t *out, const Vec3 &value)
+{
+    out = EncodeDouble(out, value.x);
+    out = EncodeDouble(out, value.y);
+    out = EncodeDouble(out, value.z);
+    return out;
+}
+inline const uint8_t *DecodeVec3(const uint8_t *in, Vec3 &value)
+{
+    in = DecodeDouble(in, value.x);
+    in = DecodeDouble(in, value.y);
+    in = DecodeDouble(in, value.z);
+    return in;
+}
+template <> struct WireFormat<Vec3>
+{
+    static constexpr size_t SIZE = VEC3_WIRE_SIZE;
+    static uint8_t *Encode(uint8_t *out, const Vec3 &value)
+    {
+        return EncodeVec3(out, value);
+    }
+    static const uint8_t *Decode(const uint8_t *in, Vec3 &value)
+    {
+        return DecodeVec3(in, value);
+    }
+};
+
+// State
+constexpr size_t STATE_WIRE_SIZE = 96;
+inline uint8_t *EncodeState(uint8_t *out, const State &value)
+{
+    out = EncodeVec3(out, value.pos);
+    out = EncodeVec3(out, value.vel);
+    out = EncodeVec3(out, value.att);
+    out = EncodeVec3(out, value.rate);
+    return out;
+}
+inline const uint8_t *DecodeState(const uint8_t *in, State &value)
+{
+    in = DecodeVec3(in, value.pos);
+    in = DecodeVec3(in, value.vel);
+    in = DecodeVec3(in, value.att);
+    in = DecodeVec3(in, value.rate);
+    return in;
+}
+template <> struct WireFormat<State>
+{
+    static constexpr size_t SIZE = STATE_WIRE_SIZE;
+    static uint8_t *Encode(uint8_t *out, const State &value)
+    {
+        return EncodeState(out, value);
+    }
+    static const uint8_t *Decode(const uint8_t *in, State &value)
+    {
+        return DecodeState(in, value);
+    }
+};
+
+// State in the compact encoding
+constexpr size_t STATE_COMPACT_WIRE_SIZE = 36;
+static_assert(sizeof(Vec3) == 3 * sizeof(double), "Vec3 must be 3 doubles without padding to be quantized in one batch");
+static_assert(offsetof(State, vel) == offsetof(State, pos) + 3 * sizeof(double),
+              "State::pos to vel must be contiguous to be quantized in one batch");
+inline uint8_t *EncodeCompactState(uint8_t *out, const State &value)
+{
+    out = EncodeDoublesAsFloat(out, &value.pos, 6);
+    out = EncodeDoublesAsInt16(out, &value.att, 3, 0.0001);
+    out = EncodeDoublesAsInt16(out, &value.rate, 3, 0.001);
+    return out;
+}
+inline const uint8_t *DecodeCompactState(const uint8_t *in, State &value)
+{
+    in = DecodeDoublesAsFloat(in, &value.pos, 6);
+    in = DecodeDoublesAsInt16(in, &value.att, 3, 0.0001);
+    in = DecodeDoublesAsInt16(in, &value.rate, 3, 0.001);
+    return in;
+}
+
+// SetpointSelection, 12 bits packed into 2 bytes
+constexpr size_t SETPOINT_SELECTION_WIRE_SIZE = 2;
+inline uint8_t *EncodeSetpointSelection(uint8_t *out, const SetpointSelection &value)
+{
+    out[0] = static_cast<uint8_t>(value.posSPActive[0] << 0 |
+                                value.posSPActive[1] << 1 |
+                                value.posSPActive[2] << 2 |
+                                value.velSPActive[0] << 3 |
+                                value.velSPActive[1] << 4 |
+                                value.velSPActive[2] << 5 |
+                                value.attSPActive[0] << 6 |
+                                value.attSPActive[1] << 7);
+    out[1] = static_cast<uint8_t>(value.attSPActive[2] << 0 |
+                                value.rateSPActive[0] << 1 |
+                                value.rateSPActive[1] << 2 |
+                                value.rateSPActive[2] << 3);
+    return out + 2;
+}
+inline const uint8_t *DecodeSetpointSelection(const uint8_t *in, SetpointSelection &value)
+{
+    value.posSPActive[0] = (in[0] >> 0) & 1;
+    value.posSPActive[1] = (in[0] >> 1) & 1;
+    value.posSPActive[2] = (in[0] >> 2) & 1;
+    value.velSPActive[0] = (in[0] >> 3) & 1;
+    value.velSPActive[1] = (in[0] >> 4) & 1;
+    value.velSPActive[2] = (in[0] >> 5) & 1;
+    value.attSPActive[0] = (in[0] >> 6) & 1;
+    value.attSPActive[1] = (in[0] >> 7) & 1;
+    value.attSPActive[2] = (in[1] >> 0) & 1;
+    value.rateSPActive[0] = (in[1] >> 1) & 1;
+    value.rateSPActive[1] = (in[1] >> 2) & 1;
+    value.rateSPActive[2] = (in[1] >> 3) & 1;
+    return in + 2;
+}
+template <> struct WireFormat<SetpointSelection>
+{
+    static constexpr size_t SIZE = SETPOINT_SELECTION_WIRE_SIZE;
+    static uint8_t *Encode(uint8_t *out, const SetpointSelection &value)
+    {
+        return EncodeSetpointSelection(out, value);
+    }
+    static const uint8_t *Decode(const uint8_t *in, SetpointSelection &value)
+    {
+        return DecodeSetpointSelection(in, value);
+    }
+};
+
+// Encoders and decoders of the packets, with a single size check per conditional section.
+// EncodePacket() returns the number of bytes written, or 0 if they do not fit in capacity.
+// DecodePacket() returns the number of bytes read, or 0 if size is too short for the packet.
+// EncodeCompactPacket() and DecodeCompactPacket() do the same with the compact encoding.
+
+// ControlInputPacket, sent with PacketId::ControlInput
+static_assert(static_cast<int>(PacketId::ControlInput) == 1, "PacketId::ControlInput does not match the schema");
+constexpr size_t CONTROL_INPUT_PACKET_MIN_SIZE = 9;
+constexpr size_t CONTROL_INPUT_PACKET_MAX_SIZE = 211;
+constexpr size_t CONTROL_INPUT_PACKET_COMPACT_MIN_SIZE = 5;
+constexpr size_t CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE = 83;
+inline size_t EncodedSize(const ControlInputPacket &packet)
+{
+    return 9 + (packet.armed ? 202 : 0);
+}
+inline size_t EncodePacket(const ControlInputPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = EncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeBool(out, packet.armed);
+    out = EncodeDouble(out, packet.timestamp);
+    if (packet.armed)
+    {
+        out = EncodeState(out, packet.desired_state);
+        out = EncodeState(out, packet.current_state);
+        out = EncodeSetpointSelection(out, packet.setpointSelection);
+        out = EncodeDouble(out, packet.inline_thrust);
+    }
+    return size;
+}
+inline size_t DecodePacket(const uint8_t *in, size_t size, ControlInputPacket &packet)
+{
+    if (size < CONTROL_INPUT_PACKET_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeBool(in, packet.armed);
+    in = DecodeDouble(in, packet.timestamp);
+    if (packet.armed)
+    {
+        if (size - static_cast<size_t>(in - start) < 202)
+            return 0;
+        in = DecodeState(in, packet.desired_state);
+        in = DecodeState(in, packet.current_state);
+        in = DecodeSetpointSelection(in, packet.setpointSelection);
+        in = DecodeDouble(in, packet.inline_thrust);
+    }
+    return static_cast<size_t>(in - start);
+}
+inline size_t CompactEncodedSize(const ControlInputPacket &packet)
+{
+    return 5 + (packet.armed ? 78 : 0);
+}
+inline size_t EncodeCompactPacket(const ControlInputPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = CompactEncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeBool(out, packet.armed);
+    out = EncodeDoubleAsUint32(out, packet.timestamp, 0.001);
+    if (packet.armed)
+    {
+        out = EncodeCompactState(out, packet.desired_state);
+        out = EncodeCompactState(out, packet.current_state);
+        out = EncodeSetpointSelection(out, packet.setpointSelection);
+        out = EncodeDoublesAsFloat(out, &packet.inline_thrust, 1);
+    }
+    return size;
+}
+inline size_t DecodeCompactPacket(const uint8_t *in, size_t size, ControlInputPacket &packet)
+{
+    if (size < CONTROL_INPUT_PACKET_COMPACT_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeBool(in, packet.armed);
+    in = DecodeDoubleAsUint32(in, packet.timestamp, 0.001);
+    if (packet.armed)
+    {
+        if (size - static_cast<size_t>(in - start) < 78)
+            return 0;
+        in = DecodeCompactState(in, packet.desired_state);
+        in = DecodeCompactState(in, packet.current_state);
+        in = DecodeSetpointSelection(in, packet.setpointSelection);
+        in = DecodeDoublesAsFloat(in, &packet.inline_thrust, 1);
+    }
+    return static_cast<size_t>(in - start);
+}
+template <> struct WireFormat<ControlInputPacket>
+{
+    static constexpr size_t MIN_SIZE = CONTROL_INPUT_PACKET_MIN_SIZE;
+    static constexpr size_t MAX_SIZE = CONTROL_INPUT_PACKET_MAX_SIZE;
+    static constexpr size_t COMPACT_MIN_SIZE = CONTROL_INPUT_PACKET_COMPACT_MIN_SIZE;
+    static constexpr size_t COMPACT_MAX_SIZE = CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE;
+    static size_t Size(const ControlInputPacket &packet)
+    {
+        return EncodedSize(packet);
+    }
+    static size_t CompactSize(const ControlInputPacket &packet)
+    {
+        return CompactEncodedSize(packet);
+    }
+};
+
+// ControlOutputPacket, sent with PacketId::ControlOutput
+static_assert(static_cast<int>(PacketId::ControlOutput) == 2, "PacketId::ControlOutput does not match the schema");
+constexpr size_t CONTROL_OUTPUT_PACKET_MIN_SIZE = 40;
+constexpr size_t CONTROL_OUTPUT_PACKET_MAX_SIZE = 40;
+constexpr size_t CONTROL_OUTPUT_PACKET_COMPACT_MIN_SIZE = 20;
+constexpr size_t CONTROL_OUTPUT_PACKET_COMPACT_MAX_SIZE = 20;
+inline size_t EncodedSize(const ControlOutputPacket &)
+{
+    return 40;
+}
+inline size_t EncodePacket(const ControlOutputPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = EncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeDouble(out, packet.timestamp);
+    out = EncodeDouble(out, packet.d1);
+    out = EncodeDouble(out, packet.d2);
+    out = EncodeDouble(out, packet.avg_throttle);
+    out = EncodeDouble(out, packet.throttle_diff);
+    return size;
+}
+inline size_t DecodePacket(const uint8_t *in, size_t size, ControlOutputPacket &packet)
+{
+    if (size < CONTROL_OUTPUT_PACKET_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeDouble(in, packet.timestamp);
+    in = DecodeDouble(in, packet.d1);
+    in = DecodeDouble(in, packet.d2);
+    in = DecodeDouble(in, packet.avg_throttle);
+    in = DecodeDouble(in, packet.throttle_diff);
+    return static_cast<size_t>(in - start);
+}
+static_assert(offsetof(ControlOutputPacket, d2) == offsetof(ControlOutputPacket, d1) + sizeof(double),
+              "ControlOutputPacket::d1 to d2 must be contiguous to be quantized in one batch");
+static_assert(offsetof(ControlOutputPacket, avg_throttle) == offsetof(ControlOutputPacket, d1) + 2 * sizeof(double),
+              "ControlOutputPacket::d1 to avg_throttle must be contiguous to be quantized in one batch");
+static_assert(offsetof(ControlOutputPacket, throttle_diff) == offsetof(ControlOutputPacket, d1) + 3 * sizeof(double),
+              "ControlOutputPacket::d1 to throttle_diff must be contiguous to be quantized in one batch");
+inline size_t CompactEncodedSize(const ControlOutputPacket &)
+{
+    return 20;
+}
+inline size_t EncodeCompactPacket(const ControlOutputPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = CompactEncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeDoubleAsUint32(out, packet.timestamp, 0.001);
+    out = EncodeDoublesAsFloat(out, &packet.d1, 4);
+    return size;
+}
+inline size_t DecodeCompactPacket(const uint8_t *in, size_t size, ControlOutputPacket &packet)
+{
+    if (size < CONTROL_OUTPUT_PACKET_COMPACT_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeDoubleAsUint32(in, packet.timestamp, 0.001);
+    in = DecodeDoublesAsFloat(in, &packet.d1, 4);
+    return static_cast<size_t>(in - start);
+}
+template <> struct WireFormat<ControlOutputPacket>
+{
+    static constexpr size_t MIN_SIZE = CONTROL_OUTPUT_PACKET_MIN_SIZE;
+    static constexpr size_t MAX_SIZE = CONTROL_OUTPUT_PACKET_MAX_SIZE;
+    static constexpr size_t COMPACT_MIN_SIZE = CONTROL_OUTPUT_PACKET_COMPACT_MIN_SIZE;
+    static constexpr size_t COMPACT_MAX_SIZE = CONTROL_OUTPUT_PACKET_COMPACT_MAX_SIZE;
+    static size_t Size(const ControlOutputPacket &packet)
+    {
+        return EncodedSize(packet);
+    }
+    static size_t CompactSize(const ControlOutputPacket &packet)
+    {
+        return CompactEncodedSize(packet);
+    }
+};
+
+// DeltaAckPacket, sent with PacketId::DeltaAck
+static_assert(static_cast<int>(PacketId::DeltaAck) == 4, "PacketId::DeltaAck does not match the schema");
+constexpr size_t DELTA_ACK_PACKET_MIN_SIZE = 2;
+constexpr size_t DELTA_ACK_PACKET_MAX_SIZE = 2;
+constexpr size_t DELTA_ACK_PACKET_COMPACT_MIN_SIZE = 2;
+constexpr size_t DELTA_ACK_PACKET_COMPACT_MAX_SIZE = 2;
+inline size_t EncodedSize(const DeltaAckPacket &)
+{
+    return 2;
+}
+inline size_t EncodePacket(const DeltaAckPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = EncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeUint8(out, packet.sequence);
+    out = EncodeBool(out, packet.keyframe_request);
+    return size;
+}
+inline size_t DecodePacket(const uint8_t *in, size_t size, DeltaAckPacket &packet)
+{
+    if (size < DELTA_ACK_PACKET_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeUint8(in, packet.sequence);
+    in = DecodeBool(in, packet.keyframe_request);
+    return static_cast<size_t>(in - start);
+}
+inline size_t CompactEncodedSize(const DeltaAckPacket &)
+{
+    return 2;
+}
+inline size_t EncodeCompactPacket(const DeltaAckPacket &packet, uint8_t *out, size_t capacity)
+{
+    const size_t size = CompactEncodedSize(packet);
+    if (size > capacity)
+        return 0;
+    out = EncodeUint8(out, packet.sequence);
+    out = EncodeBool(out, packet.keyframe_request);
+    return size;
+}
+inline size_t DecodeCompactPacket(const uint8_t *in, size_t size, DeltaAckPacket &packet)
+{
+    if (size < DELTA_ACK_PACKET_COMPACT_MIN_SIZE)
+        return 0;
+    const uint8_t *start = in;
+    in = DecodeUint8(in, packet.sequence);
+    in = DecodeBool(in, packet.keyframe_request);
+    return static_cast<size_t>(in - start);
+}
+template <> struct WireFormat<DeltaAckPacket>
+{
+    static constexpr size_t MIN_SIZE = DELTA_ACK_PACKET_MIN_SIZE;
+    static constexpr size_t MAX_SIZE = DELTA_ACK_PACKET_MAX_SIZE;
+    static constexpr size_t COMPACT_MIN_SIZE = DELTA_ACK_PACKET_COMPACT_MIN_SIZE;
+    static constexpr size_t COMPACT_MAX_SIZE = DELTA_ACK_PACKET_COMPACT_MAX_SIZE;
+    static size_t Size(const DeltaAckPacket &packet)
+    {
+        return EncodedSize(packet);
+    }
+    static size_t CompactSize(const DeltaAckPacket &packet)
+    {
+        return CompactEncodedSize(packet);
+    }
+};
+
+// Compile-time mapping between packet IDs, packet structs and their codecs, see PacketRegistry.h
+template <typename T> struct PacketTraits;
+template <PacketId Id> struct PacketType;
+
+template <> struct PacketTraits<ControlInputPacket>
+{
+    static constexpr PacketId ID = PacketId::ControlInput;
+    static constexpr size_t MAX_SIZE = WireFormat<ControlInputPacket>::MAX_SIZE;
+
+    template <typename Writer>
+    static bool Write(Writer &payload, const ControlInputPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.WritePacket(packet, encoding);
+    }
+
+    template <typename Reader>
+    static bool Read(Reader &payload, ControlInputPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.ReadPacket(packet, encoding);
+    }
+};
+
+template <> struct PacketType<PacketId::ControlInput>
+{
+    using Type = ControlInputPacket;
+};
+
+template <> struct PacketTraits<ControlOutputPacket>
+{
+    static constexpr PacketId ID = PacketId::ControlOutput;
+    static constexpr size_t MAX_SIZE = WireFormat<ControlOutputPacket>::MAX_SIZE;
+
+    template <typename Writer>
+    static bool Write(Writer &payload, const ControlOutputPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.WritePacket(packet, encoding);
+    }
+
+    template <typename Reader>
+    static bool Read(Reader &payload, ControlOutputPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.ReadPacket(packet, encoding);
+    }
+};
+
+template <> struct PacketType<PacketId::ControlOutput>
+{
+    using Type = ControlOutputPacket;
+};
+
+template <> struct PacketTraits<DeltaAckPacket>
+{
+    static constexpr PacketId ID = PacketId::DeltaAck;
+    static constexpr size_t MAX_SIZE = WireFormat<DeltaAckPacket>::MAX_SIZE;
+
+    template <typename Writer>
+    static bool Write(Writer &payload, const DeltaAckPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.WritePacket(packet, encoding);
+    }
+
+    template <typename Reader>
+    static bool Read(Reader &payload, DeltaAckPacket &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        return payload.ReadPacket(packet, encoding);
+    }
+};
+
+template <> struct PacketType<PacketId::DeltaAck>
+{
+    using Type = DeltaAckPacket;
+};
+
+#endif // PACKET_CODECS_H
@@ -0,0 +1,75 @@
+#ifndef PACKET_HANDLER_H
+#define PACKET_HANDLER_H
+
+#ifndef ARDUINO
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#include <cstddef> // For size_t, max_align_t
+#include <new>     // For placement new
+#include <type_traits>
+#include <utility>
+
+// Handler of a packet ID, holding any callable taking a PayloadView & (function pointer, lambda, ...)
+// The callable is stored inline, so registering a lambda with captures never allocates,
+// and calling it is a single indirect call.
+class PacketHandler
+{
+  public:
+    // Biggest callable that can be stored, captures beyond that should go through a pointer
+    static constexpr size_t CAPACITY = 4 * sizeof(void *);
+
+    PacketHandler() : invoke(nullptr), destroy(nullptr)
+    {
+    }
+
+    ~PacketHandler()
+    {
+        Reset();
+    }
+
+    PacketHandler(const PacketHandler &) = delete;
+    PacketHandler &operator=(const PacketHandler &) = delete;
+
+    // Store a copy of the callable, replacing the previous one
+    template <typename Handler> void Set(Handler &&handler)
+    {
+        using Callable = typename std::decay<Handler>::type;
+        static_assert(sizeof(Callable) <= CAPACITY, "Handler too big, capture a pointer to its state instead");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "Handler alignment not supported");
+
+        Reset();
+        new (storage) Callable(std::forward<Handler>(handler));
+        invoke = [](void *callable, PayloadView &payload) { (*static_cast<Callable *>(callable))(payload); };
+        destroy = [](void *callable) { static_cast<Callable *>(callable)->~Callable(); };
+    }
+
+    // Remove the callable
+    void Reset()
+    {
+        if (destroy != nullptr)
+        {
+            destroy(storage);
+        }
+        invoke = nullptr;
+        destroy = nullptr;
+    }
+
+    // Whether a callable is stored
+    explicit operator bool() const
+    {
+        return invoke != nullptr;
+    }
+
+    void operator()(PayloadView &payload)
+    {
+        invoke(storage, payload);
+    }
+
+  private:
+    alignas(std::max_align_t) unsigned char storage[CAPACITY];
+    void (*invoke)(void *callable, PayloadView &payload);
+    void (*destroy)(void *callable);
+};
+
+#endif // PACKET_HANDLER_H
@@ -0,0 +1,21 @@
+#ifndef PACKET_REGISTRY_H
+#define PACKET_REGISTRY_H
+
+// Compile-time mapping between packet IDs, packet structs and their codecs, used by UART::On() and UART::SendPacket().
+// The specializations are generated from schema/packets.schema into PacketCodecs.h, along with the codecs.
+//
+// PacketTraits<T> provides:
+//  - ID: the packet ID of T
+//  - MAX_SIZE: the biggest payload T can be encoded to, bigger frames with this ID are rejected before being read
+//  - Write() and Read(): the codec, returning false on failure
+//
+// PacketType<Id>::Type is the struct of a packet ID
+
+#ifndef ARDUINO
+#include "PacketCodecs.h"
+#include "Packets.h"
+#include "Payload.h"
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#endif // PACKET_REGISTRY_H
@@ -1,10 +1,12 @@
 // The integer id for each of the packet.
-// Each packet structure will need to bed definned in the README
-// Each client then need to separately implement the encoder/decoder
+// The wire format of each packet is defined in schema/packets.schema,
+// its encoder and decoder are generated from it into PacketCodecs.h
 
 #ifndef PACKETID_H
 #define PACKETID_H
 
+#include <cstdint>
+
 #ifndef ARDUINO
 #include "Vec3.h"
 #include "State.h"
@@ -15,6 +17,8 @@ enum class PacketId
 {
     ControlInput = 1,
     ControlOutput = 2,
+    ControlInputDelta = 3, // a ControlInputPacket encoded by DeltaEncoder, see DeltaCodec.h
+    DeltaAck = 4,
 };
 
 struct ControlInputPacket
@@ -36,4 +40,11 @@ struct ControlOutputPacket
     double throttle_diff; // from -1 to 1, top_throttle - bot_throttle
 };
 
+// Sent back by DeltaDecoder to DeltaEncoder after each ControlInputDelta, see DeltaCodec.h
+struct DeltaAckPacket
+{
+    uint8_t sequence;      // the sequence number of the last control input decoded
+    bool keyframe_request; // if the decoder lost track of the previous control inputs and needs a keyframe
+};
+
 #endif // PACKETID_H
\ No newline at end of file
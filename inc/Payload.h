@@ -3,64 +3,205 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #ifndef ARDUINO
 #include "Packets.h"
+#include "PayloadView.h"
 #endif
 
-class Payload
+// Payload holding up to Capacity bytes, built in place with the Write methods.
+// The storage is left uninitialized and copies only touch the bytes written so far, so a payload sized to its
+// packet (see UART::SendPacket()) only costs that many bytes of stack.
+template <size_t Capacity> class BasicPayload
 {
   private:
-    static const size_t MAX_SIZE = 1024; // Maximum packet size in bytes
-    uint8_t payload[MAX_SIZE];
+    uint8_t payload[Capacity];
     size_t payloadSize;
     size_t readPosition;
 
+    // Append size bytes, if they fit
+    bool WriteRaw(const void *bytes, size_t size);
+
+    // Read through a view at the current read position, then move the read position past what was read
+    template <typename T> bool Read(bool (PayloadView::*read)(T &), T &value)
+    {
+        PayloadView view = GetView();
+        bool success = (view.*read)(value);
+        readPosition = view.GetReadPosition();
+        return success;
+    }
+
   public:
-    // Constructor
-    Payload();
+    static constexpr size_t MAX_SIZE = Capacity; // Maximum payload size in bytes
+
+    // Constructors, the bytes past payloadSize are never read so they are neither zeroed nor copied
+    BasicPayload() : payloadSize(0), readPosition(0) {}
+    BasicPayload(const BasicPayload &other);
+    BasicPayload &operator=(const BasicPayload &other);
 
     // Payload Getters and Setters
     bool SetBytes(const uint8_t *bytes, size_t size);
-    const uint8_t *GetBytes() const;
-    size_t GetSize() const;
+    const uint8_t *GetBytes() const { return payload; }
+    size_t GetSize() const { return payloadSize; }
+
+    // View over the bytes, starting at the current read position
+    PayloadView GetView() const { return PayloadView(payload, payloadSize, readPosition); }
+    operator PayloadView() const { return GetView(); }
 
     // Write methods for basic types
-    bool WriteInt(int value);
-    bool WriteFloat(float value);
-    bool WriteDouble(double value);
+    bool WriteInt(int value) { return WriteRaw(&value, sizeof(value)); }
+    bool WriteFloat(float value) { return WriteRaw(&value, sizeof(value)); }
+    bool WriteDouble(double value) { return WriteRaw(&value, sizeof(value)); }
     bool WriteBool(bool value);
-    bool WriteBytes(const uint8_t *bytes, size_t size);
+    bool WriteBytes(const uint8_t *bytes, size_t size) { return WriteRaw(bytes, size); }
 
     // Write methods for our custom types
-    bool WriteVec3(const Vec3 &vec);
-    bool WriteState(const State &state);
-    bool WriteSetpointSelection(const SetpointSelection &setpoint);
+    bool WriteVec3(const Vec3 &vec) { return WriteStruct(vec); }
+    bool WriteState(const State &state) { return WriteStruct(state); }
+    bool WriteSetpointSelection(const SetpointSelection &setpoint) { return WriteStruct(setpoint); }
+
+    // Write any struct of the schema, with a single size check and its generated encoder, see PacketCodecs.h
+    template <typename T> bool WriteStruct(const T &value)
+    {
+        if (WireFormat<T>::SIZE > Capacity - payloadSize)
+        {
+            return false;
+        }
+        payloadSize = WireFormat<T>::Encode(payload + payloadSize, value) - payload;
+        return true;
+    }
 
     // Write methods for the actual packet data
     bool WriteControlInputPacket(const ControlInputPacket &control_input);
     bool WriteControlOutputPacket(const ControlOutputPacket &control_output);
 
+    // Write any packet of the schema with its generated encoder, see PacketCodecs.h
+    template <typename Packet> bool WritePacket(const Packet &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        size_t bytesWritten = encoding == WireEncoding::COMPACT
+                                  ? EncodeCompactPacket(packet, payload + payloadSize, Capacity - payloadSize)
+                                  : EncodePacket(packet, payload + payloadSize, Capacity - payloadSize);
+        payloadSize += bytesWritten;
+        return bytesWritten > 0;
+    }
+
     // Read methods for basic types
-    bool ReadInt(int &value);
-    bool ReadFloat(float &value);
-    bool ReadDouble(double &value);
-    bool ReadBool(bool &value);
+    bool ReadInt(int &value) { return Read(&PayloadView::ReadInt, value); }
+    bool ReadFloat(float &value) { return Read(&PayloadView::ReadFloat, value); }
+    bool ReadDouble(double &value) { return Read(&PayloadView::ReadDouble, value); }
+    bool ReadBool(bool &value) { return Read(&PayloadView::ReadBool, value); }
     bool ReadBytes(uint8_t *destBuffer, size_t length);
 
     // Read methods for our custom types
-    bool ReadVec3(Vec3 &vec);
-    bool ReadState(State &state);
-    bool ReadSetpointSelection(SetpointSelection &setpoint);
+    bool ReadVec3(Vec3 &vec) { return ReadStruct(vec); }
+    bool ReadState(State &state) { return ReadStruct(state); }
+    bool ReadSetpointSelection(SetpointSelection &setpoint)
+    {
+        return ReadStruct(setpoint);
+    }
+    template <typename T> bool ReadStruct(T &value)
+    {
+        return Read(&PayloadView::ReadStruct<T>, value);
+    }
 
     // Read methods for the actual packet data
-    bool ReadControlInputPacket(ControlInputPacket &control_input);
-    bool ReadControlOutputPacket(ControlOutputPacket &control_output);
+    bool ReadControlInputPacket(ControlInputPacket &control_input)
+    {
+        return Read(&PayloadView::ReadControlInputPacket, control_input);
+    }
+    bool ReadControlOutputPacket(ControlOutputPacket &control_output)
+    {
+        return Read(&PayloadView::ReadControlOutputPacket, control_output);
+    }
+    template <typename Packet> bool ReadPacket(Packet &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        PayloadView view = GetView();
+        bool success = view.ReadPacket(packet, encoding);
+        readPosition = view.GetReadPosition();
+        return success;
+    }
 
     // Utility methods
-    void ResetReadPosition();
-    size_t GetReadPosition() const;
-    void Clear();
+    void ResetReadPosition() { readPosition = 0; }
+    size_t GetReadPosition() const { return readPosition; }
+    void Clear()
+    {
+        payloadSize = 0;
+        readPosition = 0;
+    }
 };
 
-#endif // PACKET_H
\ No newline at end of file
+// The length field of a packet is a single byte, so this fits any payload that can be sent
+using Payload = BasicPayload<UINT8_MAX>;
+
+template <size_t Capacity>
+BasicPayload<Capacity>::BasicPayload(const BasicPayload &other)
+    : payloadSize(other.payloadSize), readPosition(other.readPosition)
+{
+    std::memcpy(payload, other.payload, payloadSize);
+}
+
+template <size_t Capacity> BasicPayload<Capacity> &BasicPayload<Capacity>::operator=(const BasicPayload &other)
+{
+    if (this != &other)
+    {
+        payloadSize = other.payloadSize;
+        readPosition = other.readPosition;
+        std::memcpy(payload, other.payload, payloadSize);
+    }
+    return *this;
+}
+
+template <size_t Capacity> bool BasicPayload<Capacity>::WriteRaw(const void *bytes, size_t size)
+{
+    if (size > Capacity - payloadSize)
+    {
+        return false; // Error: Not enough space
+    }
+
+    std::memcpy(payload + payloadSize, bytes, size);
+    payloadSize += size;
+    return true;
+}
+
+template <size_t Capacity> bool BasicPayload<Capacity>::SetBytes(const uint8_t *bytes, size_t size)
+{
+    if (size > Capacity)
+    {
+        return false; // Error: Size too large
+    }
+
+    std::memcpy(payload, bytes, size);
+    payloadSize = size;
+    readPosition = 0;
+    return true;
+}
+
+template <size_t Capacity> bool BasicPayload<Capacity>::WriteBool(bool value)
+{
+    const uint8_t byte = value ? 1 : 0;
+    return WriteRaw(&byte, 1);
+}
+
+template <size_t Capacity>
+bool BasicPayload<Capacity>::WriteControlInputPacket(const ControlInputPacket &control_input)
+{
+    return WritePacket(control_input);
+}
+
+template <size_t Capacity>
+bool BasicPayload<Capacity>::WriteControlOutputPacket(const ControlOutputPacket &control_output)
+{
+    return WritePacket(control_output);
+}
+
+template <size_t Capacity> bool BasicPayload<Capacity>::ReadBytes(uint8_t *destBuffer, size_t length)
+{
+    PayloadView view = GetView();
+    bool success = view.ReadBytes(destBuffer, length);
+    readPosition = view.GetReadPosition();
+    return success;
+}
+
+#endif // PACKET_H
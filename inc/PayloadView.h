@@ -0,0 +1,72 @@
+#ifndef PAYLOAD_VIEW_H
+#define PAYLOAD_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef ARDUINO
+#include "PacketCodecs.h"
+#include "Packets.h"
+#endif
+
+// Read-only view over payload bytes owned by someone else, with the same Read methods as Payload.
+// Received packets are handed to the handlers as a view over the receive ring buffer, without any copy.
+// The bytes are only valid during the call to the handler: copy them into a Payload to keep them.
+class PayloadView
+{
+  private:
+    const uint8_t *data;
+    size_t size;
+    size_t readPosition;
+
+  public:
+    // Constructor
+    PayloadView(const uint8_t *bytes, size_t size, size_t readPosition = 0);
+
+    // Getters
+    const uint8_t *GetBytes() const;
+    size_t GetSize() const;
+
+    // Read methods for basic types
+    bool ReadInt(int &value);
+    bool ReadFloat(float &value);
+    bool ReadDouble(double &value);
+    bool ReadBool(bool &value);
+    bool ReadBytes(uint8_t *destBuffer, size_t length);
+
+    // Read methods for our custom types
+    bool ReadVec3(Vec3 &vec);
+    bool ReadState(State &state);
+    bool ReadSetpointSelection(SetpointSelection &setpoint);
+
+    // Read any struct of the schema, with a single size check and its generated decoder, see PacketCodecs.h
+    template <typename T> bool ReadStruct(T &value)
+    {
+        if (readPosition + WireFormat<T>::SIZE > size)
+        {
+            return false;
+        }
+        readPosition = WireFormat<T>::Decode(data + readPosition, value) - data;
+        return true;
+    }
+
+    // Read methods for the actual packet data
+    bool ReadControlInputPacket(ControlInputPacket &control_input);
+    bool ReadControlOutputPacket(ControlOutputPacket &control_output);
+
+    // Read any packet of the schema with its generated decoder, see PacketCodecs.h
+    template <typename Packet> bool ReadPacket(Packet &packet, WireEncoding encoding = WireEncoding::FULL)
+    {
+        size_t bytesRead = encoding == WireEncoding::COMPACT
+                               ? DecodeCompactPacket(data + readPosition, size - readPosition, packet)
+                               : DecodePacket(data + readPosition, size - readPosition, packet);
+        readPosition += bytesRead;
+        return bytesRead > 0;
+    }
+
+    // Utility methods
+    void ResetReadPosition();
+    size_t GetReadPosition() const;
+};
+
+#endif // PAYLOAD_VIEW_H
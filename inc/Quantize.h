@@ -0,0 +1,237 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <cmath>   // For std::isnan, std::fabs
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t
+#include <cstring> // For memcpy
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// Vectors of doubles are only available on AArch64
+#include <arm_neon.h>
+#endif
+
+// Conversions between doubles and their quantized encodings on the wire, used by the compact encoding of the
+// packets, see the "Compact Encoding" section of the README. The bounds below are on the decoded value:
+//  - float:  float32, rounded to nearest. Relative error at most 2^-24 (6e-8), doubles beyond 3.4e38 become infinite.
+//  - int16:  signed number of steps, rounded to nearest and saturated to +-32767 steps.
+//            Error at most step / 2 within +-32767 * step, NaN encodes as 0.
+//  - uint32: unsigned number of steps, rounded to nearest and wrapped modulo 2^32 steps.
+//            Error at most step / 2 modulo 2^32 * step. NaN, infinities and values beyond 2^51 steps encode as 0.
+// The values are little-endian on the wire, like the other fields.
+//
+// The generated codecs call these with a constant count and step, so they are inline for the loops to unroll and
+// the divisions to fold: a call costs more than converting a few doubles.
+
+constexpr double INT16_STEPS_LIMIT = 32767;
+// Adding then subtracting 1.5 * 2^52 leaves no bits for the fraction, so it rounds any value below 2^51
+constexpr double ROUNDING_LIMIT = 2251799813685248.0;  // 2^51
+constexpr double ROUNDING_OFFSET = 6755399441055744.0; // 1.5 * 2^52
+
+// Round a value below ROUNDING_LIMIT to nearest, ties to even with the default rounding mode like the vector
+// conversions. std::rint() and std::lrint() are library calls on x86 without SSE4.1, slower than the conversion.
+inline double RoundToNearest(double value)
+{
+    return (value + ROUNDING_OFFSET) - ROUNDING_OFFSET;
+}
+
+// Number of steps of value, rounded to nearest and saturated, NaN gives 0
+inline int16_t QuantizeInt16(double value, double scale)
+{
+    double steps = value * scale;
+    if (std::isnan(steps))
+        return 0;
+    steps = steps < -INT16_STEPS_LIMIT ? -INT16_STEPS_LIMIT : (steps > INT16_STEPS_LIMIT ? INT16_STEPS_LIMIT : steps);
+    return static_cast<int16_t>(RoundToNearest(steps));
+}
+
+// Encode count doubles as float32, or decode them, one value at a time.
+// values may be unaligned, so that consecutive double fields of a struct are converted in one call.
+// Returns the position right after the encoded values.
+inline uint8_t *EncodeDoublesAsFloatScalar(uint8_t *out, const void *values, size_t count)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(values);
+    for (size_t i = 0; i < count; i++)
+    {
+        double value;
+        std::memcpy(&value, bytes + i * sizeof(double), sizeof(value));
+        float narrowed = static_cast<float>(value);
+        std::memcpy(out + i * sizeof(float), &narrowed, sizeof(narrowed));
+    }
+    return out + count * sizeof(float);
+}
+
+inline const uint8_t *DecodeDoublesAsFloatScalar(const uint8_t *in, void *values, size_t count)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(values);
+    for (size_t i = 0; i < count; i++)
+    {
+        float narrowed;
+        std::memcpy(&narrowed, in + i * sizeof(float), sizeof(narrowed));
+        double value = narrowed;
+        std::memcpy(bytes + i * sizeof(double), &value, sizeof(value));
+    }
+    return in + count * sizeof(float);
+}
+
+// Same as above, with count doubles as int16 numbers of step
+inline uint8_t *EncodeDoublesAsInt16Scalar(uint8_t *out, const void *values, size_t count, double step)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(values);
+    const double scale = 1 / step;
+    for (size_t i = 0; i < count; i++)
+    {
+        double value;
+        std::memcpy(&value, bytes + i * sizeof(double), sizeof(value));
+        int16_t steps = QuantizeInt16(value, scale);
+        std::memcpy(out + i * sizeof(int16_t), &steps, sizeof(steps));
+    }
+    return out + count * sizeof(int16_t);
+}
+
+inline const uint8_t *DecodeDoublesAsInt16Scalar(const uint8_t *in, void *values, size_t count, double step)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(values);
+    for (size_t i = 0; i < count; i++)
+    {
+        int16_t steps;
+        std::memcpy(&steps, in + i * sizeof(int16_t), sizeof(steps));
+        double value = steps * step;
+        std::memcpy(bytes + i * sizeof(double), &value, sizeof(value));
+    }
+    return in + count * sizeof(int16_t);
+}
+
+// Same as the scalar versions, two doubles at a time with SSE2 or NEON, the widest vectors of doubles they have.
+// The odd value is left to the scalar version.
+
+inline uint8_t *EncodeDoublesAsFloat(uint8_t *out, const void *values, size_t count)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(values);
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128 narrowed = _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double *>(bytes + i * sizeof(double))));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i * sizeof(float)), _mm_castps_si128(narrowed));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 2 <= count; i += 2)
+    {
+        float64x2_t value = vreinterpretq_f64_u8(vld1q_u8(bytes + i * sizeof(double)));
+        vst1_u8(out + i * sizeof(float), vreinterpret_u8_f32(vcvt_f32_f64(value)));
+    }
+#endif
+    return EncodeDoublesAsFloatScalar(out + i * sizeof(float), bytes + i * sizeof(double), count - i);
+}
+
+inline const uint8_t *DecodeDoublesAsFloat(const uint8_t *in, void *values, size_t count)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(values);
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128 narrowed = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i * sizeof(float))));
+        _mm_storeu_pd(reinterpret_cast<double *>(bytes + i * sizeof(double)), _mm_cvtps_pd(narrowed));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 2 <= count; i += 2)
+    {
+        float32x2_t narrowed = vreinterpret_f32_u8(vld1_u8(in + i * sizeof(float)));
+        vst1q_u8(bytes + i * sizeof(double), vreinterpretq_u8_f64(vcvt_f64_f32(narrowed)));
+    }
+#endif
+    return DecodeDoublesAsFloatScalar(in + i * sizeof(float), bytes + i * sizeof(double), count - i);
+}
+
+inline uint8_t *EncodeDoublesAsInt16(uint8_t *out, const void *values, size_t count, double step)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(values);
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128d scale = _mm_set1_pd(1 / step);
+    const __m128d low = _mm_set1_pd(-INT16_STEPS_LIMIT);
+    const __m128d high = _mm_set1_pd(INT16_STEPS_LIMIT);
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d steps = _mm_mul_pd(_mm_loadu_pd(reinterpret_cast<const double *>(bytes + i * sizeof(double))), scale);
+        // NaN lanes are cleared to 0 before saturating
+        steps = _mm_and_pd(steps, _mm_cmpord_pd(steps, steps));
+        steps = _mm_min_pd(_mm_max_pd(steps, low), high);
+        __m128i rounded = _mm_cvtpd_epi32(steps);
+        int32_t packed = _mm_cvtsi128_si32(_mm_packs_epi32(rounded, rounded));
+        std::memcpy(out + i * sizeof(int16_t), &packed, sizeof(packed));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const double scale = 1 / step;
+    const float64x2_t low = vdupq_n_f64(-INT16_STEPS_LIMIT);
+    const float64x2_t high = vdupq_n_f64(INT16_STEPS_LIMIT);
+    for (; i + 2 <= count; i += 2)
+    {
+        float64x2_t steps = vmulq_n_f64(vreinterpretq_f64_u8(vld1q_u8(bytes + i * sizeof(double))), scale);
+        // NaN lanes are cleared to 0 before saturating
+        steps = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(steps), vceqq_f64(steps, steps)));
+        steps = vminq_f64(vmaxq_f64(steps, low), high);
+        int32x2_t rounded = vmovn_s64(vcvtnq_s64_f64(steps));
+        int16x4_t narrowed = vmovn_s32(vcombine_s32(rounded, rounded));
+        uint32_t packed = vget_lane_u32(vreinterpret_u32_s16(narrowed), 0);
+        std::memcpy(out + i * sizeof(int16_t), &packed, sizeof(packed));
+    }
+#endif
+    return EncodeDoublesAsInt16Scalar(out + i * sizeof(int16_t), bytes + i * sizeof(double), count - i, step);
+}
+
+inline const uint8_t *DecodeDoublesAsInt16(const uint8_t *in, void *values, size_t count, double step)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(values);
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128d scale = _mm_set1_pd(step);
+    for (; i + 2 <= count; i += 2)
+    {
+        int32_t packed;
+        std::memcpy(&packed, in + i * sizeof(int16_t), sizeof(packed));
+        // Sign extend the two int16 to int32
+        __m128i steps = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_cvtsi32_si128(packed), _mm_cvtsi32_si128(packed)), 16);
+        _mm_storeu_pd(reinterpret_cast<double *>(bytes + i * sizeof(double)), _mm_mul_pd(_mm_cvtepi32_pd(steps), scale));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 2 <= count; i += 2)
+    {
+        uint32_t packed;
+        std::memcpy(&packed, in + i * sizeof(int16_t), sizeof(packed));
+        int32x4_t steps = vmovl_s16(vreinterpret_s16_u32(vdup_n_u32(packed)));
+        float64x2_t value = vmulq_n_f64(vcvtq_f64_s64(vmovl_s32(vget_low_s32(steps))), step);
+        vst1q_u8(bytes + i * sizeof(double), vreinterpretq_u8_f64(value));
+    }
+#endif
+    return DecodeDoublesAsInt16Scalar(in + i * sizeof(int16_t), bytes + i * sizeof(double), count - i, step);
+}
+
+// Encode a double as a uint32 number of step, such as a timestamp in ms sent in us
+inline uint8_t *EncodeDoubleAsUint32(uint8_t *out, double value, double step)
+{
+    // Wrapped rather than saturated, so that a timestamp keeps counting past 2^32 steps.
+    // Converting to uint32_t from a signed integer keeps the low 32 bits.
+    double steps = value / step;
+    uint32_t wrapped = 0;
+    if (std::fabs(steps) < ROUNDING_LIMIT)
+    {
+        wrapped = static_cast<uint32_t>(static_cast<int64_t>(RoundToNearest(steps)));
+    }
+    std::memcpy(out, &wrapped, sizeof(wrapped));
+    return out + sizeof(wrapped);
+}
+
+inline const uint8_t *DecodeDoubleAsUint32(const uint8_t *in, double &value, double step)
+{
+    uint32_t steps;
+    std::memcpy(&steps, in, sizeof(steps));
+    value = steps * step;
+    return in + sizeof(steps);
+}
+
+#endif // QUANTIZE_H
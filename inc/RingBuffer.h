@@ -0,0 +1,70 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t
+
+// Byte storage for the ring buffers of UART.
+// The size is always a power of two, so that indexes wrap around with a mask instead of a modulo.
+//
+// On Linux, the storage can be mirrored: the same memory is mapped twice back to back, so that the bytes
+// right after the end of the buffer are the bytes at its start. Any range of up to Size() bytes, starting
+// at any index, is then contiguous, even if it wraps around. The mapping is at least a page, so it can be bigger
+// than the storage it replaces, but Capacity() stays the size the buffer was created with.
+class RingBuffer
+{
+  public:
+    // Use the given storage, size must be a power of two
+    RingBuffer(uint8_t *storage, size_t size);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // Switch to a mirrored mapping of at least the current size, rounded up to the page size.
+    // The content of the buffer is not kept, so this must be done before it is used.
+    // Returns false, and keeps the current storage, if mirroring is not supported.
+    bool Mirror();
+
+    bool IsMirrored() const
+    {
+        return mirrored;
+    }
+
+    uint8_t *Data() const
+    {
+        return data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+    // Number of bytes the users of the buffer should hold in it, the size of the storage it was created with, even
+    // once mirrored over a bigger mapping
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+
+    // Wrap an index around the end of the buffer
+    size_t Wrap(size_t index) const
+    {
+        return index & (size - 1);
+    }
+
+    // Number of bytes that can be accessed contiguously from Data() + index
+    size_t ContiguousSize(size_t index) const
+    {
+        return mirrored ? size : size - index;
+    }
+
+  private:
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool mirrored;
+};
+
+#endif // RING_BUFFER_H
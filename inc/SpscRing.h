@@ -0,0 +1,78 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef> // For size_t
+
+// Wait-free ring of Size slots between one producer thread and one consumer thread.
+// Items are written and read in place in their slot, so big items such as payloads are only copied once.
+// Each index is only written by one side, and each side keeps a copy of the other index, so that it only reads the
+// shared one again when the ring looks full (producer) or empty (consumer).
+template <typename T, size_t Size> class SpscRing
+{
+  public:
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+    SpscRing() : head(0), cachedTail(0), tail(0), cachedHead(0)
+    {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer: the free slot to write the next item into, or nullptr if the ring is full.
+    // The item is only visible to the consumer after Push().
+    T *Back()
+    {
+        const size_t index = tail.load(std::memory_order_relaxed);
+        if (index - cachedHead == Size)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (index - cachedHead == Size)
+                return nullptr;
+        }
+        return &slots[index & (Size - 1)];
+    }
+
+    // Producer: publish the item written into Back()
+    void Push()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: the oldest item, or nullptr if the ring is empty
+    T *Front()
+    {
+        const size_t index = head.load(std::memory_order_relaxed);
+        if (index == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (index == cachedTail)
+                return nullptr;
+        }
+        return &slots[index & (Size - 1)];
+    }
+
+    // Consumer: release the slot of Front() to the producer
+    void Pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Number of items in the ring, only exact when called from one of the two threads while the other is idle
+    size_t Count() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+  private:
+    // The indexes only grow, and wrap around with the size_t range. Each one is on its own cache line with the copy
+    // of the other index its writer keeps, so the two threads do not invalidate each other's lines on every item.
+    alignas(64) std::atomic<size_t> head; // Written by the consumer
+    size_t cachedTail;                    // Consumer's copy of tail
+    alignas(64) std::atomic<size_t> tail; // Written by the producer
+    size_t cachedHead;                    // Producer's copy of head
+    alignas(64) T slots[Size];
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,71 @@
+#ifndef TRANSMIT_QUEUE_H
+#define TRANSMIT_QUEUE_H
+
+#ifndef ARDUINO
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t, uint32_t
+
+// Packets of one priority class of UART, waiting to be encoded into the send buffer, oldest first.
+// Each packet is stored as a [ Stamp | ID | Length | Payload ] record in a byte ring, so small packets take little
+// room. A record is never split: when it does not fit before the end of the storage, it goes to the start, and the
+// space left at the end is skipped.
+class TransmitQueue
+{
+  public:
+    static constexpr size_t SIZE = 1024;
+    static constexpr size_t HEADER_SIZE = sizeof(uint32_t) + 2;
+
+    TransmitQueue();
+
+    TransmitQueue(const TransmitQueue &) = delete;
+    TransmitQueue &operator=(const TransmitQueue &) = delete;
+
+    // Copy a packet at the back of the queue, with the stamp it was queued at.
+    // Returns false if it does not fit.
+    bool Push(uint8_t id, const PayloadView &payload, uint32_t stamp);
+
+    // The oldest packet, the queue must not be empty
+    uint8_t FrontId() const
+    {
+        return storage[head + sizeof(uint32_t)];
+    }
+    PayloadView FrontPayload() const
+    {
+        return PayloadView(storage + head + HEADER_SIZE, storage[head + sizeof(uint32_t) + 1]);
+    }
+    uint32_t FrontStamp() const;
+
+    // Drop the oldest packet, the queue must not be empty
+    void Pop();
+
+    bool Empty() const
+    {
+        return count == 0;
+    }
+
+    // Number of packets waiting
+    size_t Count() const
+    {
+        return count;
+    }
+
+    // Number of bytes of the packets waiting, IDs and lengths included
+    size_t Bytes() const
+    {
+        return bytes;
+    }
+
+  private:
+    uint8_t storage[SIZE];
+    size_t head;    // Start of the oldest record
+    size_t tail;    // End of the newest record
+    size_t wrapEnd; // End of the records before the start of the storage, when wrapped
+    bool wrapped;   // The newest records are at the start of the storage, before head
+    size_t count;
+    size_t bytes;
+};
+
+#endif // TRANSMIT_QUEUE_H
@@ -2,52 +2,213 @@
 #define UART_H
 
 #ifndef ARDUINO
+#include "FramePool.h"
+#include "PacketHandler.h"
+#include "PacketRegistry.h"
 #include "Payload.h"
+#include "PayloadView.h"
+#include "RingBuffer.h"
+#include "TransmitQueue.h"
 #endif // ARDUINO
 
 #include <cstddef> // For size_t
 #include <cstdint> // For uint8_t
-#include <functional>
-#include <optional>
-#include <unordered_map>
 #include <string>
+#include <utility>
 
 constexpr uint8_t START_BYTE = 0x7E;
 constexpr uint8_t END_BYTE = 0x7F;
 constexpr uint8_t ESCAPE_BYTE = 0x7D;
 constexpr uint8_t ESCAPE_MASK = 0x20;
+constexpr uint8_t COBS_DELIMITER = 0x00;
 
 // TODO: Since the biggest packets are around 128 bytes, we should update these values
 constexpr size_t MAX_PAYLOAD_SIZE = 256;
-constexpr size_t MAX_PACKET_SIZE_STUFFED = (MAX_PAYLOAD_SIZE + 3) * 2 + 2;
-constexpr size_t MAX_PACKET_SIZE_UNSTUFFED = MAX_PAYLOAD_SIZE + 5;
-constexpr size_t RECEIVE_BUFFER_SIZE = 1024;
+constexpr size_t MAX_CHECK_SIZE = 4; // CRC-32C
+constexpr size_t MAX_FRAME_SIZE = MAX_PAYLOAD_SIZE + 2 + MAX_CHECK_SIZE; // ID, length, payload and check
+constexpr size_t MAX_PACKET_SIZE_STUFFED = MAX_FRAME_SIZE * 2 + 2;
+constexpr size_t MAX_PACKET_SIZE_COBS = MAX_FRAME_SIZE + MAX_FRAME_SIZE / 254 + 2;
 constexpr size_t SEND_BUFFER_SIZE = 1024;
 constexpr size_t RING_BUFFER_SIZE = 2048;
 
+// The ring buffers wrap their indexes around with a mask
+static_assert((SEND_BUFFER_SIZE & (SEND_BUFFER_SIZE - 1)) == 0, "SEND_BUFFER_SIZE must be a power of two");
+static_assert((RING_BUFFER_SIZE & (RING_BUFFER_SIZE - 1)) == 0, "RING_BUFFER_SIZE must be a power of two");
+
 class UART
 {
   public:
+    // How packets are delimited on the wire, see the README
+    enum class Framing
+    {
+        ESCAPE, // START_BYTE and END_BYTE delimiters, with escape-byte stuffing
+        COBS,   // Consistent Overhead Byte Stuffing, with a zero byte delimiter
+    };
+
+    // How the integrity of packets is checked, see the README
+    enum class Integrity
+    {
+        CHECKSUM, // 8-bit sum of the bytes
+        CRC16,    // CRC-16/CCITT
+        CRC32C,   // CRC-32C
+    };
+
+    // Priority classes of the packets sent, see the README
+    enum class Priority : uint8_t
+    {
+        CONTROL,   // Encoded straight into the send buffer, ahead of the packets of the other classes
+        TELEMETRY, // Queued, encoded when no CONTROL packet is waiting, sharing the link with BULK by weight
+        BULK,      // Same as TELEMETRY
+    };
+    static constexpr size_t PRIORITY_COUNT = 3;
+
+    // Counters of a priority class.
+    // Latencies are in bytes: the number of bytes sent on the wire between queueing a packet and sending its first
+    // byte. Divide by the byte rate of the link, a tenth of its baud rate, for a time.
+    struct TransmitStats
+    {
+        size_t depth;               // Packets waiting to be encoded into the send buffer
+        size_t peakDepth;           // Highest depth so far
+        uint32_t packetsQueued;     // Packets accepted by SendUARTPacket() and SendFrame()
+        uint32_t packetsDropped;    // Packets refused because their queue or the send buffer was full
+        uint32_t packetsSent;       // Packets encoded into the send buffer
+        uint32_t packetsSuperseded; // Packets replaced in their mailbox by a newer one, see UseMailbox()
+        uint64_t totalLatency;      // Sum of the latencies of the packets sent
+        uint32_t maxLatency;        // Highest latency of a packet sent
+    };
+
     UART();
-    ~UART() = default;
+    virtual ~UART() = default;
+
+    // Choose how packets are framed, both ends of the link must use the same framing.
+    // Must be called before any data is sent or received.
+    // Returns false if the buffers are already in use.
+    bool SetFraming(Framing framing);
+
+    // Choose how the integrity of packets is checked, both ends of the link must use the same check.
+    // Must be called before any data is sent or received.
+    // Returns false if the buffers are already in use.
+    bool SetIntegrity(Integrity integrity);
+
+    // Choose how SendPacket() and the handlers registered with On() encode and decode the packet structs,
+    // both ends of the link must use the same encoding. WireEncoding::COMPACT about halves the biggest packets by
+    // quantizing the fields marked in the schema, see the README for their precision.
+    // Must be called before any data is sent or received.
+    // Returns false if the buffers are already in use.
+    bool SetEncoding(WireEncoding encoding);
     
+    // Send the packets of packet_id with priority, Priority::CONTROL by default.
+    // The packets of the lower classes are queued, and only encoded into the send buffer once it is empty and no
+    // CONTROL packet is waiting, so that a CONTROL packet never waits for more than one of them.
+    void SetPriority(uint8_t packet_id, Priority priority);
+
+    // Share of the link of TELEMETRY or BULK while both have packets waiting, by deficit round robin over the bytes
+    // of their packets: with weights of 3 and 1, TELEMETRY gets 3 bytes for each byte of BULK.
+    // The default weights are 4 for TELEMETRY and 1 for BULK.
+    // Returns false for Priority::CONTROL, which is always sent first, or a weight of 0.
+    bool SetPriorityWeight(Priority priority, uint8_t weight);
+
+    // Counters of a priority class
+    TransmitStats GetTransmitStats(Priority priority) const;
+
+    // Number of packet IDs that can have a mailbox
+    static constexpr size_t MAILBOX_COUNT = 4;
+
+    // Send the packets of packet_id through a mailbox, for state-like packets where only the newest one matters.
+    // At most one packet of the ID is in the send buffer at a time: the next one waits in the mailbox until it has
+    // been sent, and is replaced there by any newer packet. Sending never fails for lack of room, and the newest
+    // packet only waits for the one before it. Mailboxes are encoded ahead of the TELEMETRY and BULK queues.
+    // Returns false if MAILBOX_COUNT IDs already have a mailbox.
+    bool UseMailbox(uint8_t packet_id);
+
+    // Number of packets of packet_id replaced in its mailbox by a newer one before being sent
+    uint32_t SupersededPackets(uint8_t packet_id) const;
+
     // Sets up the UART connextion
     virtual bool Begin() = 0;
 
     // Register a packet handler function for a specific ID.
-    void RegisterHandler(int packet_id, std::function<void(Payload &)> handler);
+    // The handler can be any callable taking a PayloadView &, up to PacketHandler::CAPACITY bytes.
+    // The view points into the receive ring buffer and is only valid during the call.
+    template <typename Handler> void RegisterHandler(uint8_t packet_id, Handler &&handler)
+    {
+        handlers[packet_id].Set(std::forward<Handler>(handler));
+        maxPayloadSizes[packet_id] = UINT8_MAX;
+    }
+
+    // Register a handler receiving the packets of an ID already decoded into their struct, see PacketRegistry.h.
+    // For example: uart.On<PacketId::ControlInput>([](const ControlInputPacket &packet) { ... });
+    // Frames longer than the biggest encoding of the struct are rejected before their payload is read.
+    // The handler can be up to PacketHandler::CAPACITY - sizeof(void *) bytes.
+    template <PacketId Id, typename Handler> void On(Handler &&handler)
+    {
+        using Packet = typename PacketType<Id>::Type;
+        using Traits = PacketTraits<Packet>;
+        static_assert(Traits::MAX_SIZE <= UINT8_MAX, "Packet too big for the length field");
+
+        const uint8_t packetId = static_cast<uint8_t>(Id);
+        handlers[packetId].Set([this, handler = std::forward<Handler>(handler)](PayloadView &payload) mutable {
+            Packet packet{};
+            if (!Traits::Read(payload, packet, encoding))
+            {
+                Log(LOG_LEVEL::WARNING, "Invalid packet payload received");
+                return;
+            }
+            handler(static_cast<const Packet &>(packet));
+        });
+        maxPayloadSizes[packetId] = Traits::MAX_SIZE;
+    }
     
-    // Queue a packet to be sent over UART.
+    // Queue a packet to be sent over UART, with the priority of its ID, see SetPriority().
     // Returns true if the packet was successfully queued.
-    bool SendUARTPacket(const uint8_t id, Payload &payload);
+    virtual bool SendUARTPacket(const uint8_t id, const PayloadView &payload);
 
-    // Tries to send all the packets in the send buffer.
-    void SendUARTPackets();
+    // Encode a packet struct and queue it with its ID, see PacketRegistry.h.
+    // For example: uart.SendPacket(ControlOutputPacket{...});
+    // Returns true if the packet was successfully queued.
+    template <typename Packet> bool SendPacket(const Packet &packet)
+    {
+        using Traits = PacketTraits<Packet>;
+        // Sized to the packet, so only its bytes take up stack space
+        BasicPayload<Traits::MAX_SIZE> payload;
+        if (!Traits::Write(payload, packet, encoding))
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to encode packet");
+            return false;
+        }
+        return SendUARTPacket(static_cast<uint8_t>(Traits::ID), payload);
+    }
+
+    // Queue a frame of the pool to be sent with its ID, without copying it.
+    // The frame is encoded into the send buffer as soon as there is room for it, in the order frames were queued,
+    // and released once encoded. For example:
+    //  FrameRef frame = uart.GetFramePool().Allocate();
+    //  frame->WriteControlOutputPacket(output);
+    //  uart.SendFrame(static_cast<uint8_t>(PacketId::ControlOutput), std::move(frame));
+    // The frames of a lower priority class are copied into its queue right away, like with SendUARTPacket().
+    // The frames of an ID with a mailbox are copied into it in the same way.
+    // Returns false if the frame is empty, FramePool::SIZE frames are already waiting, or its queue is full.
+    virtual bool SendFrame(const uint8_t id, FrameRef frame);
+
+    // Number of CONTROL frames queued by SendFrame() still waiting for room in the send buffer, mailboxes excluded
+    size_t PendingSendFrames() const;
+
+    // Pool of frames used by SendFrame(), and by the handlers to keep received payloads with FramePool::Retain()
+    FramePool &GetFramePool();
+
+    // Tries to send all the packets in the send buffer, until the UART device stops accepting data
+    // or maxBytes have been sent. Pending frames are encoded as room frees up in the send buffer, and the packets of
+    // the lower priority classes once it is empty.
+    // Returns the number of bytes still waiting in the send buffer and in the queues of the lower classes.
+    virtual size_t SendUARTPackets(size_t maxBytes = SIZE_MAX);
+
+    // Number of bytes waiting in the send buffer
+    size_t PendingSendBytes() const;
 
     // Read bytes from the UART device and try to parse them into packets.
     // Calls the registered handler functions for each packet.
     // Returns the number of packets received.
-    int ReceiveUARTPackets();
+    virtual int ReceiveUARTPackets();
 
   protected:  
     // These methods are specific to the UART implementation.
@@ -57,10 +218,29 @@ class UART
     // Returns the number of bytes written.
     virtual size_t Send(const uint8_t *data, const size_t data_size) = 0;
 
+    // Tries to write up to firstSize bytes from *first, then up to secondSize bytes from *second, without blocking.
+    // These are the two halves of the send ring buffer when it wraps.
+    // Returns the total number of bytes written.
+    // The default implementation calls Send() for each segment, override it if the device can do both at once.
+    virtual size_t SendSegments(const uint8_t *first, size_t firstSize, const uint8_t *second, size_t secondSize);
+
     // Tries to read data_size bytes into *data from the UART device, without blocking.
     // Returns the number of bytes read.
     virtual size_t Receive(uint8_t *data, const size_t data_size) = 0;
 
+    // Tries to read up to firstSize bytes into *first, then up to secondSize bytes into *second, without blocking.
+    // These are the free segments of the receive ring buffer, so the data lands there without any copy.
+    // Returns the total number of bytes read.
+    // The default implementation calls Receive() for each segment, override it if the device can do both at once.
+    virtual size_t ReceiveSegments(uint8_t *first, size_t firstSize, uint8_t *second, size_t secondSize);
+
+    // Map the ring buffers twice back to back, where the platform supports it, so that they never wrap:
+    // received frames are always parsed contiguously and pending bytes are sent in a single call. The send buffer
+    // still holds up to SEND_BUFFER_SIZE bytes.
+    // Must be called before any data is sent or received.
+    // Returns false, and keeps the default buffers, if mirroring is not supported.
+    bool UseMirroredBuffers();
+
     enum class LOG_LEVEL
     {
         DEBUG,
@@ -72,37 +252,174 @@ class UART
     // Log a message with the specified log level.
     virtual void Log(LOG_LEVEL level, std::string message) = 0;
 
+    // Receives the packets deframed by DeframeUARTPackets(), instead of their handlers.
+    // The payload is only valid during the call.
+    using PacketSink = void (*)(void *context, uint8_t id, PayloadView &payload);
+
+    // Read and deframe bytes from the UART device like ReceiveUARTPackets(), but hand each packet to sink instead of
+    // its handler, for the implementations that call the handlers on another thread with DispatchPacket().
+    // Returns the number of packets received.
+    int DeframeUARTPackets(PacketSink sink, void *context);
+
+    // Queue a packet like SendUARTPacket(), whose payload fits the length field, but without counting it as dropped
+    // when there is no room, for the implementations that try again later.
+    // Returns false if there is no room.
+    bool TryQueueUARTPacket(const uint8_t id, const PayloadView &payload);
+
+    // Call the handler of a packet ID
+    void DispatchPacket(uint8_t id, PayloadView &payload)
+    {
+        handlers[id](payload);
+    }
+
+    // Fewest bytes the device must still receive before the next packet can be complete, given the progress of the
+    // frame decoder: the rest of the frame being decoded, or the smallest frame between frames. Never more than the
+    // smallest frame, which can follow a frame dropped halfway on a noisy link.
+    // Implementations waiting for data can sleep until that many bytes are available.
+    size_t MinimumBytesToNextPacket() const;
+
   private:
-    uint8_t circularBuffer[RING_BUFFER_SIZE];
-    size_t readIndex;  // Where we're currently reading from
-    size_t writeIndex; // Where new data gets written
-    size_t peekIndex;  // Where to peek next in the ring buffer
+    Framing framing;
+    Integrity integrity;
+    WireEncoding encoding;
+
+    // Received bytes are read straight into the ring buffer and unstuffed in place.
+    // The ring buffer then stores the frames decoded as [ ID | Length | Payload ], ready to be handed to the handlers.
+    uint8_t circularBufferStorage[RING_BUFFER_SIZE];
+    RingBuffer circularBuffer;
+    size_t readIndex;       // Start of the oldest complete frame
+    size_t writeIndex;      // End of the newest complete frame, where the frame being decoded starts
+    size_t frameWriteIndex; // Where the next decoded byte of the current frame gets written
 
-    uint8_t sendBuffer[SEND_BUFFER_SIZE];
+    uint8_t sendBufferStorage[SEND_BUFFER_SIZE];
+    RingBuffer sendBuffer;
     size_t sendBufferStart;
     size_t sendBufferEnd;
 
     int packetsRead; // The number of packets that have been read
 
-    // Handlers map
-    std::unordered_map<int, std::function<void(Payload&)>> handlers;
+    FramePool framePool;
+    // Frames queued by SendFrame() that did not fit in the send buffer yet, oldest first
+    struct PendingFrame
+    {
+        uint8_t id;
+        FrameRef frame;
+        uint32_t stamp; // totalBytesSent when the frame was queued
+    };
+    PendingFrame pendingFrames[FramePool::SIZE];
+    size_t pendingFramesStart;
+    size_t pendingFramesCount;
+
+    // Priority class of each packet ID
+    Priority priorities[UINT8_MAX + 1];
+    // Queues of TELEMETRY and BULK, and their deficit round robin
+    TransmitQueue transmitQueues[PRIORITY_COUNT - 1];
+    uint32_t weights[PRIORITY_COUNT - 1];
+    uint32_t deficits[PRIORITY_COUNT - 1];
+    size_t roundRobinIndex; // Queue currently served, starting with the last one so that TELEMETRY goes first
+    TransmitStats transmitStats[PRIORITY_COUNT];
+    uint32_t totalBytesSent; // Bytes accepted by the device so far, wrapping around, for the latencies
+
+    // Newest packet of an ID sent through a mailbox
+    struct Mailbox
+    {
+        uint8_t id;
+        bool waiting;        // The payload is waiting to be encoded
+        uint32_t stamp;      // totalBytesSent when the waiting packet was queued
+        uint32_t sentAt;     // totalBytesSent once the packet in the send buffer has been sent
+        uint32_t superseded; // Packets replaced by a newer one
+        Payload payload;
+    };
+    Mailbox mailboxes[MAILBOX_COUNT];
+    size_t mailboxCount;
+    // Index of the mailbox of each packet ID, MAILBOX_COUNT for the IDs without one
+    uint8_t mailboxIndexes[UINT8_MAX + 1];
+
+    // Handlers, indexed by packet ID. IDs without a handler are invalid.
+    PacketHandler handlers[UINT8_MAX + 1];
+    // Biggest valid payload for each packet ID
+    uint8_t maxPayloadSizes[UINT8_MAX + 1];
+
+    // States of the frame decoder, named after the field expected next
+    enum class DecoderState
+    {
+        WAIT_START,
+        ID,
+        LENGTH,
+        PAYLOAD,
+        CHECKSUM,
+        END,
+    };
+
+    // The frame decoder keeps its progress between calls to ReceiveUARTPackets(),
+    // so that each received byte is only decoded once.
+    DecoderState decoderState;
+    bool escapePending;     // The last byte received was an ESCAPE_BYTE
+    uint8_t frameId;        // ID of the frame being decoded
+    uint8_t frameLength;    // Payload length of the frame being decoded
+    uint32_t frameCheck;         // Checksum or CRC of the bytes of the frame decoded so far
+    uint32_t frameReceivedCheck; // Checksum or CRC received at the end of the frame
+    size_t frameCheckIndex;      // Number of bytes of the received checksum or CRC so far
+    size_t framePayloadIndex; // Number of payload bytes decoded so far
+    size_t cobsBlockRemaining; // Number of data bytes left in the current COBS block
+    bool cobsZeroPending;      // The current COBS block ends with a zero, decoded when the next block starts
 
     // Calculate the available space in the send buffer
     size_t AvailableSendBufferSpace() const;
+    // Byte stuff data into the send buffer at index, wrapping around its end, and advance index.
+    // The caller must have checked that there is room for 2 * size bytes.
+    // Returns check updated with data.
+    uint32_t StuffIntoSendBuffer(const uint8_t *data, size_t size, size_t &index, uint32_t check);
+    // Encode a frame into the send buffer, once the payload size has been checked. Returns false if it does not fit.
+    bool QueuePacket(const uint8_t id, const PayloadView &payload);
+    // Encode a COBS frame into the send buffer, once the payload size has been checked
+    bool QueueCobsPacket(const uint8_t id, const PayloadView &payload);
+    // Encode a frame queued at stamp, and count it in the stats of its class. Returns false if it does not fit.
+    bool QueueStampedPacket(const uint8_t id, const PayloadView &payload, uint32_t stamp, Priority priority);
+    // Encode the pending frames into the send buffer, oldest first, as long as they fit
+    void QueuePendingFrames();
+    // Put a packet in its mailbox, and encode it if the previous one has been sent
+    bool SendToMailbox(Mailbox &mailbox, const PayloadView &payload);
+    // Encode the waiting packets of the mailboxes whose previous packet has been sent, as long as they fit
+    void QueueMailboxes();
+    // Once the send buffer is empty and no CONTROL frame is waiting, encode the next packet of the lower classes
+    void QueueLowerPriorityPacket();
+    // Number of packets of a class waiting to be encoded into the send buffer
+    size_t QueueDepth(Priority priority) const;
+    // Number of bytes waiting in the queues of the lower classes and in the mailboxes, IDs and lengths included
+    size_t QueuedPacketBytes() const;
+    // Size of the checksum or CRC on the wire
+    size_t CheckSize() const;
+    // Value of the checksum or CRC before any data
+    uint32_t InitialCheck() const;
+    // Update the checksum or CRC with the data
+    uint32_t UpdateCheck(uint32_t check, const uint8_t *data, size_t size) const;
+    // Write the checksum or CRC to bytes, least significant byte first. Returns the number of bytes written.
+    size_t WriteCheck(uint32_t check, uint8_t *bytes) const;
     // Compute the checksum of the data.
-    uint8_t ComputeChecksum(const uint8_t *data, size_t data_size);
-    // Number of bytes that can be peek before the end of the ring buffer
-    size_t AvailableBytesToPeek() const;
-    // The raw next byte in the ring buffer. Need to check AvailableBytesToPeek() > 0 before calling!
-    uint8_t Peek();
-    // The unstuffed next byte in the buffer, or nullopt if we have reached the end of the buffer.
-    std::optional<uint8_t> PeekUnstuff();
-    // Advance the readIndex (the index of the start of the packet) by amount
-    void AdvanceReadIndex(size_t amount);
-    // Advance the ReadIndex by 1
-    bool DiscardCurrentByteAndContinue();
-    // Packet parsing method
-    bool TryParsePacket();
+    uint8_t ComputeChecksum(const uint8_t *data, size_t data_size) const;
+    // Unstuff and frame raw received bytes, storing the complete frames in the ring buffer.
+    // data may be in the ring buffer itself, as long as it is not behind the frame being decoded.
+    void IngestBytes(const uint8_t *data, size_t size);
+    // Unstuff payload bytes from the start of data in bulk, until the payload is complete or a frame delimiter.
+    // Returns the number of bytes consumed.
+    size_t DecodePayloadRun(const uint8_t *data, size_t size);
+    // Feed one raw byte to the frame decoder. The decoder must not be waiting for a START_BYTE.
+    void DecodeByte(uint8_t byte);
+    // Same as IngestBytes(), DecodePayloadRun() and DecodeByte(), for COBS framing
+    void IngestCobsBytes(const uint8_t *data, size_t size);
+    size_t DecodeCobsPayloadRun(const uint8_t *data, size_t size);
+    void DecodeCobsByte(uint8_t byte);
+    // Feed one unstuffed byte to the field decoder (ID, length, payload and checksum)
+    void DecodeField(uint8_t byte);
+    // Drop the frame being decoded and wait for the next one
+    void ResetDecoder();
+    // Reset the decoder to the beginning of a frame, right after its START_BYTE
+    void StartFrame();
+    // Make the decoded frame available to DispatchFrames()
+    void CommitFrame();
+    // Call the handlers of all the complete frames in the ring buffer, or sink if not nullptr
+    void DispatchFrames(PacketSink sink, void *context);
 };
 
 #endif // UART_H
\ No newline at end of file
@@ -0,0 +1,403 @@
+#ifndef ARDUINO
+#include "ByteStuffing.h"
+#include "UART.h"
+#endif // ARDUINO
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+inline bool NeedsEscape(uint8_t byte)
+{
+    return byte == START_BYTE || byte == END_BYTE || byte == ESCAPE_BYTE;
+}
+
+// Copy size bytes from src to dst in increasing address order, 16 bytes at a time.
+// Each block is loaded before it is stored, so this is safe whenever dst is not ahead of src in memory,
+// even when they are different virtual addresses of the same bytes, as with a mirrored ring buffer.
+// memmove() only knows about the addresses, so it may copy in any order in that case.
+inline void CopyForward(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        uint8_t block[16];
+        std::memcpy(block, src + i, sizeof(block));
+        std::memcpy(dst + i, block, sizeof(block));
+    }
+    for (; i < size; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+// Stuff a block of size bytes, where mask flags the bytes that need escaping with bitsPerByte bits per byte.
+// The clean runs between the flagged bytes are copied in bulk.
+inline uint8_t *StuffBlock(const uint8_t *src, size_t size, uint64_t mask, unsigned bitsPerByte, uint8_t *dst)
+{
+    const uint64_t byteMask = (1ull << bitsPerByte) - 1;
+    size_t position = 0;
+    while (mask != 0)
+    {
+        size_t index = __builtin_ctzll(mask) / bitsPerByte;
+        std::memcpy(dst, src + position, index - position);
+        dst += index - position;
+        *dst++ = ESCAPE_BYTE;
+        *dst++ = src[index] ^ ESCAPE_MASK;
+        position = index + 1;
+        mask &= ~(byteMask << (index * bitsPerByte));
+    }
+    std::memcpy(dst, src + position, size - position);
+    return dst + size - position;
+}
+
+#if defined(__SSE2__)
+
+// One bit per byte of block, set for the bytes that need escaping
+inline uint32_t SpecialBytesSSE2(__m128i block)
+{
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(START_BYTE)),
+                                                _mm_cmpeq_epi8(block, _mm_set1_epi8(END_BYTE))),
+                                   _mm_cmpeq_epi8(block, _mm_set1_epi8(ESCAPE_BYTE)));
+    return _mm_movemask_epi8(special);
+}
+
+size_t StuffBytesSSE2(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    uint8_t *const dstStart = dst;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        uint32_t mask = SpecialBytesSSE2(block);
+        if (mask == 0)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), block);
+            dst += 16;
+        }
+        else
+        {
+            dst = StuffBlock(src + i, 16, mask, 1, dst);
+        }
+    }
+
+    return (dst - dstStart) + StuffBytesScalar(src + i, size - i, dst);
+}
+
+size_t FindSpecialByteSSE2(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        uint32_t mask = SpecialBytesSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + FindSpecialByteScalar(data + i, size - i);
+}
+
+#if defined(__GNUC__)
+#define HAS_AVX2_KERNEL
+
+__attribute__((target("avx2"))) inline uint32_t SpecialBytesAVX2(__m256i block)
+{
+    __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(START_BYTE)),
+                                                      _mm256_cmpeq_epi8(block, _mm256_set1_epi8(END_BYTE))),
+                                      _mm256_cmpeq_epi8(block, _mm256_set1_epi8(ESCAPE_BYTE)));
+    return _mm256_movemask_epi8(special);
+}
+
+__attribute__((target("avx2"))) size_t StuffBytesAVX2(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    uint8_t *const dstStart = dst;
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        uint32_t mask = SpecialBytesAVX2(block);
+        if (mask == 0)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), block);
+            dst += 32;
+        }
+        else
+        {
+            dst = StuffBlock(src + i, 32, mask, 1, dst);
+        }
+    }
+
+    // Finish the tail with the 16 byte kernel. Clear the upper halves of the registers first,
+    // the compiler does not do it before calling non-AVX code and the transition is very slow.
+    _mm256_zeroupper();
+    return (dst - dstStart) + StuffBytesSSE2(src + i, size - i, dst);
+}
+
+__attribute__((target("avx2"))) size_t FindSpecialByteAVX2(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        uint32_t mask = SpecialBytesAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return i + FindSpecialByteSSE2(data + i, size - i);
+}
+
+bool HasAVX2()
+{
+    static const bool hasAVX2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return hasAVX2;
+}
+
+#endif // __GNUC__
+
+#elif defined(__ARM_NEON)
+
+// One nibble per byte of block, set for the bytes that need escaping. NEON has no movemask.
+inline uint64_t SpecialBytesNEON(uint8x16_t block)
+{
+    uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8(START_BYTE)), vceqq_u8(block, vdupq_n_u8(END_BYTE))),
+                                  vceqq_u8(block, vdupq_n_u8(ESCAPE_BYTE)));
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)), 0);
+}
+
+size_t StuffBytesNEON(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    uint8_t *const dstStart = dst;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        uint8x16_t block = vld1q_u8(src + i);
+        uint64_t mask = SpecialBytesNEON(block);
+        if (mask == 0)
+        {
+            vst1q_u8(dst, block);
+            dst += 16;
+        }
+        else
+        {
+            dst = StuffBlock(src + i, 16, mask, 4, dst);
+        }
+    }
+
+    return (dst - dstStart) + StuffBytesScalar(src + i, size - i, dst);
+}
+
+size_t FindSpecialByteNEON(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        uint64_t mask = SpecialBytesNEON(vld1q_u8(data + i));
+        if (mask != 0)
+            return i + __builtin_ctzll(mask) / 4;
+    }
+    return i + FindSpecialByteScalar(data + i, size - i);
+}
+
+#endif
+
+// Shared by UnstuffBytes() and UnstuffBytesScalar(), which only differ by how they find the runs to copy
+template <size_t (*FindSpecial)(const uint8_t *, size_t)>
+size_t Unstuff(const uint8_t *src, size_t size, uint8_t *dst, size_t maxOutput, bool &escapePending, size_t &consumed)
+{
+    size_t read = 0;
+    size_t written = 0;
+    while (read < size && written < maxOutput)
+    {
+        if (escapePending)
+        {
+            // A frame delimiter right after an ESCAPE_BYTE, the escape sequence is broken
+            if (src[read] == START_BYTE || src[read] == END_BYTE)
+            {
+                escapePending = false;
+                break;
+            }
+            dst[written++] = src[read++] ^ ESCAPE_MASK;
+            escapePending = false;
+            continue;
+        }
+
+        // Copy the run of bytes that need no unstuffing in one go
+        size_t run = FindSpecial(src + read, std::min(size - read, maxOutput - written));
+        CopyForward(dst + written, src + read, run);
+        read += run;
+        written += run;
+        if (read == size || written == maxOutput)
+            break;
+
+        // Stop before a frame delimiter
+        if (src[read] != ESCAPE_BYTE)
+            break;
+        escapePending = true;
+        read++;
+    }
+
+    consumed = read;
+    return written;
+}
+
+} // namespace
+
+size_t StuffBytesScalar(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    uint8_t *const dstStart = dst;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (NeedsEscape(src[i]))
+        {
+            *dst++ = ESCAPE_BYTE;
+            *dst++ = src[i] ^ ESCAPE_MASK;
+        }
+        else
+        {
+            *dst++ = src[i];
+        }
+    }
+    return dst - dstStart;
+}
+
+size_t StuffBytes(const uint8_t *src, size_t size, uint8_t *dst)
+{
+#if defined(__SSE2__)
+#if defined(HAS_AVX2_KERNEL)
+    if (HasAVX2())
+        return StuffBytesAVX2(src, size, dst);
+#endif
+    return StuffBytesSSE2(src, size, dst);
+#elif defined(__ARM_NEON)
+    return StuffBytesNEON(src, size, dst);
+#else
+    return StuffBytesScalar(src, size, dst);
+#endif
+}
+
+size_t FindSpecialByteScalar(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+    while (i < size && !NeedsEscape(data[i]))
+        i++;
+    return i;
+}
+
+size_t FindSpecialByte(const uint8_t *data, size_t size)
+{
+#if defined(__SSE2__)
+#if defined(HAS_AVX2_KERNEL)
+    if (HasAVX2())
+        return FindSpecialByteAVX2(data, size);
+#endif
+    return FindSpecialByteSSE2(data, size);
+#elif defined(__ARM_NEON)
+    return FindSpecialByteNEON(data, size);
+#else
+    return FindSpecialByteScalar(data, size);
+#endif
+}
+
+size_t UnstuffBytes(const uint8_t *src, size_t size, uint8_t *dst, size_t maxOutput, bool &escapePending,
+                    size_t &consumed)
+{
+    return Unstuff<FindSpecialByte>(src, size, dst, maxOutput, escapePending, consumed);
+}
+
+size_t UnstuffBytesScalar(const uint8_t *src, size_t size, uint8_t *dst, size_t maxOutput, bool &escapePending,
+                          size_t &consumed)
+{
+    return Unstuff<FindSpecialByteScalar>(src, size, dst, maxOutput, escapePending, consumed);
+}
+
+size_t CopyUntilZero(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    const void *zero = std::memchr(src, 0, size);
+    size_t run = (zero != nullptr) ? static_cast<const uint8_t *>(zero) - src : size;
+    CopyForward(dst, src, run);
+    return run;
+}
+
+CobsEncoder::CobsEncoder(uint8_t *dst) : dst(dst), codeIndex(0), index(1), afterFullBlock(false)
+{
+}
+
+void CobsEncoder::Write(const uint8_t *src, size_t size)
+{
+    while (size > 0)
+    {
+        // Copy the bytes up to the next zero, as long as they fit in the current block
+        size_t room = COBS_MAX_BLOCK_SIZE - (index - codeIndex - 1);
+        size_t run = CopyUntilZero(src, std::min(size, room), dst + index);
+        index += run;
+        src += run;
+        size -= run;
+
+        if (run < room && size > 0)
+        {
+            // The zero ends the block and is dropped
+            dst[codeIndex] = static_cast<uint8_t>(index - codeIndex);
+            codeIndex = index++;
+            afterFullBlock = false;
+            src++;
+            size--;
+        }
+        else if (run == room)
+        {
+            // A full block has no zero at its end
+            dst[codeIndex] = 0xFF;
+            codeIndex = index++;
+            afterFullBlock = true;
+        }
+    }
+}
+
+size_t CobsEncoder::Finish()
+{
+    // The input ends with a full block, which needs no zero after it
+    if (afterFullBlock && index - codeIndex == 1)
+        return codeIndex;
+
+    dst[codeIndex] = static_cast<uint8_t>(index - codeIndex);
+    return index;
+}
+
+size_t CobsEncode(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    CobsEncoder encoder(dst);
+    encoder.Write(src, size);
+    return encoder.Finish();
+}
+
+bool CobsDecode(const uint8_t *src, size_t size, uint8_t *dst, size_t &decodedSize)
+{
+    size_t read = 0;
+    size_t written = 0;
+    while (read < size)
+    {
+        uint8_t code = src[read++];
+        size_t run = code - 1;
+        // A zero code, or a block running past the end of the frame
+        if (code == 0 || run > size - read)
+            return false;
+
+        // The data of a block never contains a zero
+        if (CopyUntilZero(src + read, run, dst + written) != run)
+            return false;
+        read += run;
+        written += run;
+
+        // Every block but full ones and the last one ends with a zero
+        if (code != 0xFF && read < size)
+            dst[written++] = 0;
+    }
+    decodedSize = written;
+    return true;
+}
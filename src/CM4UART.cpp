@@ -2,22 +2,69 @@
 
 #include "CM4UART.h"
 #include "quill/Quill.h" // For Logger
+#include <algorithm>     // For std::min
+#include <chrono>        // For steady_clock
 #include <cstring>       // For memset
-#include <fcntl.h>       // For open
+#include <fcntl.h>       // For open, fcntl
+#include <poll.h>        // For poll, ppoll
 #include <stdexcept>     // For runtime_error
+#include <sys/eventfd.h> // For eventfd
+#include <sys/uio.h>     // For readv, writev
 #include <termios.h>     // Terminal I/O
 #include <unistd.h>      // For read, write, close
 
+namespace
+{
+// user_data of the io_uring requests
+constexpr uint64_t READ_REQUEST = 0;
+constexpr uint64_t WRITE_REQUEST = 1;
+constexpr uint64_t CANCEL_REQUEST = 2;
+// Registered files
+constexpr int READ_FILE_INDEX = 0;
+constexpr int WRITE_FILE_INDEX = 1;
+// Registered buffers
+constexpr uint16_t RECEIVE_BUFFER_INDEX = 0;
+constexpr uint16_t SEND_BUFFER_INDEX = 1;
+} // namespace
+
 CM4UART::CM4UART(const int baudrate, const char *device, quill::Logger *logger) : UART(),
                                                                                   baudrate(baudrate),
                                                                                   device(device),
-                                                                                  logger(logger)
+                                                                                  logger(logger),
+                                                                                  uart_fd(-1),
+                                                                                  threaded(false),
+                                                                                  wakeFd(-1),
+                                                                                  stopRequested(false),
+                                                                                  ioPendingBytes(0),
+                                                                                  droppedReceived(0),
+                                                                                  receivedFd(-1),
+                                                                                  waitingForPackets(false),
+                                                                                  uringActive(false),
+                                                                                  uringKernelPolling(false),
+                                                                                  completionFd(-1),
+                                                                                  uringWriteFd(-1),
+                                                                                  uringReceiveSize(0),
+                                                                                  uringReceiveOffset(0),
+                                                                                  readPosted(false),
+                                                                                  uringSendSize(0),
+                                                                                  uringSendOffset(0),
+                                                                                  writePosted(false),
+                                                                                  systemCalls(0)
 {
 }
 
 CM4UART::~CM4UART()
 {
-    close(uart_fd);
+    StopIOThread();
+    if (uringActive)
+    {
+        // Without waiting for the device to take the rest of a write
+        StopIoUring(false);
+    }
+    if (uart_fd >= 0)
+    {
+        close(uart_fd);
+    }
 }
 
 bool CM4UART::Begin()
@@ -57,12 +104,21 @@ bool CM4UART::Begin()
     tty.c_oflag = 0;
     tty.c_iflag = 0;
 
+    // Reads never block with O_NONBLOCK, but with VTIME at 0, poll() only reports the device readable once VMIN bytes
+    // are available. VMIN is then kept at the size of the rest of the next packet, see UpdateWakeupThreshold().
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+
     if (tcsetattr(uart_fd, TCSANOW, &tty) != 0)
     {
         close(uart_fd);
         Log(LOG_LEVEL::ERROR, "Failed to set UART attributes.");
         return false;
     }
+    settings = tty;
+
+    // Parse and send without ever splitting at the end of the ring buffers, this is only an optimization
+    UseMirroredBuffers();
 
     Log(LOG_LEVEL::INFO, "UART set up successfully");
     return true;
@@ -70,6 +126,12 @@ bool CM4UART::Begin()
 
 size_t CM4UART::Send(const unsigned char *data, const size_t data_size)
 {
+    if (uringActive)
+    {
+        return SendSegments(data, data_size, nullptr, 0);
+    }
+
+    systemCalls.fetch_add(1, std::memory_order_relaxed);
     ssize_t bytes_written = write(uart_fd, data, data_size);
     if (bytes_written == -1)
     {
@@ -87,8 +149,73 @@ size_t CM4UART::Send(const unsigned char *data, const size_t data_size)
     return bytes_written;
 }
 
+size_t CM4UART::SendSegments(const unsigned char *first, size_t firstSize, const unsigned char *second,
+                             size_t secondSize)
+{
+    // Taking the completions falls back to writev() if a request failed
+    if (uringActive)
+    {
+        ProcessCompletions();
+    }
+    if (uringActive)
+    {
+        // One write in flight at a time, the device is busy until it completes. The rest of a partial write was only
+        // queued by ProcessCompletions(), submit it.
+        if (writePosted)
+        {
+            if (ring.HasQueuedRequests() && !ring.Submit())
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to submit an io_uring write, falling back to read() and write()");
+                StopIoUring(true);
+            }
+            return 0;
+        }
+        firstSize = std::min(firstSize, sizeof(uringSendBuffer));
+        secondSize = std::min(secondSize, sizeof(uringSendBuffer) - firstSize);
+        std::memcpy(uringSendBuffer, first, firstSize);
+        if (secondSize > 0)
+        {
+            std::memcpy(uringSendBuffer + firstSize, second, secondSize);
+        }
+        uringSendSize = firstSize + secondSize;
+        uringSendOffset = 0;
+        writePosted = ring.QueueWriteFixed(WRITE_FILE_INDEX, uringSendBuffer, uringSendSize, SEND_BUFFER_INDEX,
+                                           WRITE_REQUEST);
+        // Along with the read posted since the last submission
+        if (!writePosted || !ring.Submit())
+        {
+            // The bytes are then written by StopIoUring()
+            Log(LOG_LEVEL::ERROR, "Failed to submit an io_uring write, falling back to read() and write()");
+            StopIoUring(true);
+        }
+        return firstSize + secondSize;
+    }
+
+    // Write both segments with a single system call
+    systemCalls.fetch_add(1, std::memory_order_relaxed);
+    struct iovec segments[2] = {{const_cast<unsigned char *>(first), firstSize},
+                                {const_cast<unsigned char *>(second), secondSize}};
+    ssize_t bytes_written = writev(uart_fd, segments, (secondSize > 0) ? 2 : 1);
+    if (bytes_written == -1)
+    {
+        // This error means that the device is busy
+        if (errno != EAGAIN)
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to send data");
+        }
+        bytes_written = 0;
+    }
+    return bytes_written;
+}
+
 size_t CM4UART::Receive(unsigned char *data, const size_t data_size)
 {
+    if (uringActive)
+    {
+        return ReceiveSegments(data, data_size, nullptr, 0);
+    }
+
+    systemCalls.fetch_add(1, std::memory_order_relaxed);
     ssize_t bytes_read = read(uart_fd, data, data_size);
     if (bytes_read == -1)
     {
@@ -106,6 +233,577 @@ size_t CM4UART::Receive(unsigned char *data, const size_t data_size)
     return bytes_read;
 }
 
+size_t CM4UART::ReceiveSegments(unsigned char *first, size_t firstSize, unsigned char *second, size_t secondSize)
+{
+    if (uringActive)
+    {
+        ProcessCompletions();
+        // No read in flight, since nothing was sent after the last one: submit the next one now, it completes right
+        // away if bytes are waiting
+        if (uringActive && ring.HasQueuedRequests())
+        {
+            if (!ring.Submit())
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to submit an io_uring read, falling back to read() and write()");
+                StopIoUring(true);
+            }
+            ProcessCompletions();
+        }
+    }
+    if (uringActive || uringReceiveOffset < uringReceiveSize)
+    {
+        // Hand over the bytes of the last read completed, even after falling back to readv()
+        const size_t available = uringReceiveSize - uringReceiveOffset;
+        const size_t firstPart = std::min(available, firstSize);
+        const size_t secondPart = std::min(available - firstPart, secondSize);
+        std::memcpy(first, uringReceiveBuffer + uringReceiveOffset, firstPart);
+        if (secondPart > 0)
+        {
+            std::memcpy(second, uringReceiveBuffer + uringReceiveOffset + firstPart, secondPart);
+        }
+        uringReceiveOffset += firstPart + secondPart;
+        if (!uringActive)
+        {
+            return firstPart + secondPart;
+        }
+
+        // Queue the next read once they are all handed over, it is submitted with the next write. With kernel
+        // polling, submitting takes no system call, so it is submitted right away.
+        ProcessCompletions();
+        if (uringActive && uringKernelPolling && !ring.Submit())
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to submit an io_uring read, falling back to read() and write()");
+            StopIoUring(true);
+        }
+        return firstPart + secondPart;
+    }
+
+    // Read both segments with a single system call
+    systemCalls.fetch_add(1, std::memory_order_relaxed);
+    struct iovec segments[2] = {{first, firstSize}, {second, secondSize}};
+    ssize_t bytes_read = readv(uart_fd, segments, (secondSize > 0) ? 2 : 1);
+    if (bytes_read == -1)
+    {
+        // This error means that the device is busy or the read was interrupted
+        if (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR)
+        {
+            bytes_read = 0;
+        }
+        else
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to receive data");
+            bytes_read = 0;
+        }
+    }
+    return bytes_read;
+}
+
+bool CM4UART::StartIOThread()
+{
+    if (uart_fd < 0 || threaded || uringActive)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot start the I/O thread, the device is not open, or the thread or io_uring is "
+                              "running");
+        return false;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    receivedFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0 || receivedFd < 0)
+    {
+        Log(LOG_LEVEL::ERROR, "Failed to create the eventfds of the I/O thread");
+        close(wakeFd);
+        close(receivedFd);
+        wakeFd = receivedFd = -1;
+        return false;
+    }
+
+    stopRequested.store(false, std::memory_order_relaxed);
+    ioPendingBytes.store(UART::SendUARTPackets(0), std::memory_order_relaxed);
+    threaded = true;
+    ioThread = std::thread(&CM4UART::RunIOThread, this);
+    return true;
+}
+
+void CM4UART::StopIOThread()
+{
+    if (!threaded)
+    {
+        return;
+    }
+
+    stopRequested.store(true, std::memory_order_release);
+    WakeIOThread();
+    ioThread.join();
+    // Packets still waiting for room when the thread stopped are dropped like by UART::SendUARTPacket() if there is
+    // none yet
+    for (IOPacket *packet = sentPackets.Front(); packet != nullptr; packet = sentPackets.Front())
+    {
+        UART::SendUARTPacket(packet->id, packet->payload.GetView());
+        sentPackets.Pop();
+    }
+    close(wakeFd);
+    close(receivedFd);
+    wakeFd = receivedFd = -1;
+    threaded = false;
+}
+
+uint32_t CM4UART::DroppedReceivedPackets() const
+{
+    return droppedReceived.load(std::memory_order_relaxed);
+}
+
+void CM4UART::WakeIOThread()
+{
+    // Adds to the counter of the eventfd, which stays readable until the I/O thread reads it
+    const uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        Log(LOG_LEVEL::ERROR, "Failed to wake the I/O thread up");
+    }
+}
+
+void CM4UART::NotifyReceivedPackets()
+{
+    // Pairs with the fence of WaitForPackets(): either it sees the packets in the ring, or this sees it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waitingForPackets.load(std::memory_order_relaxed))
+    {
+        const uint64_t one = 1;
+        if (write(receivedFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to wake WaitForPackets() up");
+        }
+    }
+}
+
+void CM4UART::UpdateWakeupThreshold()
+{
+    const cc_t threshold = static_cast<cc_t>(std::min<size_t>(MinimumBytesToNextPacket(), UINT8_MAX));
+    if (threshold == settings.c_cc[VMIN])
+    {
+        return;
+    }
+    settings.c_cc[VMIN] = threshold;
+    systemCalls.fetch_add(1, std::memory_order_relaxed);
+    if (tcsetattr(uart_fd, TCSANOW, &settings) != 0)
+    {
+        Log(LOG_LEVEL::ERROR, "Failed to set the wakeup threshold of the UART device");
+    }
+}
+
+int CM4UART::WaitForPackets(uint32_t timeoutMicroseconds)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutMicroseconds);
+    while (true)
+    {
+        int packetsReceived = ReceiveUARTPackets();
+        if (packetsReceived > 0)
+        {
+            return packetsReceived;
+        }
+
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero())
+        {
+            return 0;
+        }
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        const struct timespec timeout = {static_cast<time_t>(nanoseconds / 1000000000),
+                                         static_cast<long>(nanoseconds % 1000000000)};
+
+        struct pollfd fd = {uart_fd, POLLIN, 0};
+        if (threaded)
+        {
+            // The I/O thread reads the device, wait for it to hand packets over
+            fd.fd = receivedFd;
+            waitingForPackets.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (receivedPackets.Count() > 0)
+            {
+                waitingForPackets.store(false, std::memory_order_relaxed);
+                continue;
+            }
+        }
+        else if (uringActive)
+        {
+            // The read is in flight once submitted, wait for a completion. No read is posted while the bytes of the
+            // last one did not all fit into the ring buffer.
+            fd.fd = completionFd;
+            if (uringReceiveOffset < uringReceiveSize)
+            {
+                continue;
+            }
+            if (ring.HasQueuedRequests() && !ring.Submit())
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to submit an io_uring read, falling back to read() and write()");
+                StopIoUring(true);
+                continue;
+            }
+        }
+        else
+        {
+            UpdateWakeupThreshold();
+        }
+
+        const int ready = ppoll(&fd, 1, &timeout, nullptr);
+        if (fd.fd != uart_fd)
+        {
+            waitingForPackets.store(false, std::memory_order_relaxed);
+            uint64_t wakeups;
+            if (ready > 0 && read(fd.fd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to read the eventfd of WaitForPackets()");
+            }
+        }
+        if (ready < 0 && errno != EINTR)
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to poll the UART device");
+            return 0;
+        }
+        if (ready > 0 && (fd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            Log(LOG_LEVEL::ERROR, "UART device closed");
+            return 0;
+        }
+    }
+}
+
+bool CM4UART::UseIoUring(bool kernelPolling)
+{
+    if (uart_fd < 0 || threaded || uringActive)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot use io_uring, the device is not open, or the I/O thread or io_uring is running");
+        return false;
+    }
+
+    // Room for a read and a write, and their retries
+    if (!ring.Setup(4, kernelPolling))
+    {
+        Log(LOG_LEVEL::WARNING, "io_uring is not available, using read() and write()");
+        return false;
+    }
+    struct iovec buffers[2] = {{uringReceiveBuffer, sizeof(uringReceiveBuffer)},
+                               {uringSendBuffer, sizeof(uringSendBuffer)}};
+    completionFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // Writes go through a description of the device of their own, which stays non-blocking: a write then completes
+    // right away with the bytes the device took, or EAGAIN, instead of blocking Submit() while the device is busy
+    uringWriteFd = open(device, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    const int files[2] = {uart_fd, uringWriteFd};
+    uringActive = true;
+    uringKernelPolling = kernelPolling;
+    uringReceiveSize = uringReceiveOffset = 0;
+    uringSendSize = uringSendOffset = 0;
+    readPosted = writePosted = false;
+
+    // The posted read must wait for the device instead of failing with EAGAIN, so the device no longer is
+    // non-blocking. The read then completes as soon as a byte is available.
+    const int flags = fcntl(uart_fd, F_GETFL);
+    settings.c_cc[VMIN] = 1;
+    if (completionFd < 0 || uringWriteFd < 0 || !ring.RegisterFiles(files, 2) || !ring.RegisterBuffers(buffers, 2) ||
+        !ring.RegisterEventFd(completionFd) || flags < 0 || fcntl(uart_fd, F_SETFL, flags & ~O_NONBLOCK) != 0 ||
+        tcsetattr(uart_fd, TCSANOW, &settings) != 0)
+    {
+        StopIoUring(true);
+        Log(LOG_LEVEL::WARNING, "Failed to set io_uring up, using read() and write()");
+        return false;
+    }
+
+    // Post the first read
+    ProcessCompletions();
+    if (!ring.Submit())
+    {
+        StopIoUring(true);
+        Log(LOG_LEVEL::WARNING, "Failed to submit to io_uring, using read() and write()");
+        return false;
+    }
+    Log(LOG_LEVEL::INFO, kernelPolling ? "Using io_uring with kernel polling" : "Using io_uring");
+    return true;
+}
+
+bool CM4UART::UsingIoUring() const
+{
+    return uringActive;
+}
+
+uint32_t CM4UART::SystemCalls() const
+{
+    return systemCalls.load(std::memory_order_relaxed) + ring.SystemCalls();
+}
+
+void CM4UART::ProcessCompletions()
+{
+    uint64_t request;
+    int32_t result;
+    while (ring.PopCompletion(request, result))
+    {
+        TakeCompletion(request, result);
+        if (result < 0 && result != -EINTR && result != -EAGAIN)
+        {
+            Log(LOG_LEVEL::ERROR, "io_uring request failed, falling back to read() and write()");
+            StopIoUring(true);
+            return;
+        }
+
+        // Write the rest after a partial write
+        if (request == WRITE_REQUEST && uringSendOffset < uringSendSize)
+        {
+            writePosted = ring.QueueWriteFixed(WRITE_FILE_INDEX, uringSendBuffer + uringSendOffset,
+                                               uringSendSize - uringSendOffset, SEND_BUFFER_INDEX, WRITE_REQUEST);
+            if (!writePosted)
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to queue an io_uring write, falling back to read() and write()");
+                StopIoUring(true);
+                return;
+            }
+        }
+    }
+
+    // The next read goes into the same memory, so only once its bytes have all been handed over
+    if (!readPosted && uringReceiveOffset == uringReceiveSize)
+    {
+        readPosted = ring.QueueReadFixed(READ_FILE_INDEX, uringReceiveBuffer, sizeof(uringReceiveBuffer),
+                                         RECEIVE_BUFFER_INDEX, READ_REQUEST);
+    }
+}
+
+void CM4UART::TakeCompletion(uint64_t request, int32_t result)
+{
+    if (request == READ_REQUEST)
+    {
+        readPosted = false;
+        uringReceiveSize = std::max<int32_t>(result, 0);
+        uringReceiveOffset = 0;
+    }
+    else if (request == WRITE_REQUEST)
+    {
+        writePosted = false;
+        uringSendOffset += std::max<int32_t>(result, 0);
+    }
+    // The completions of the cancellations carry nothing
+}
+
+void CM4UART::StopIoUring(bool sendRest)
+{
+    // Cancel the requests in flight, and wait for their completions before closing the ring. Closing it alone leaves
+    // the kernel to cancel them later: the read could still take bytes from the device, and the requests write into
+    // the registered memory, which is part of this object.
+    if (readPosted)
+    {
+        ring.QueueCancel(READ_REQUEST, CANCEL_REQUEST);
+    }
+    if (writePosted)
+    {
+        ring.QueueCancel(WRITE_REQUEST, CANCEL_REQUEST);
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while ((readPosted || writePosted) && completionFd >= 0 && ring.Submit())
+    {
+        uint64_t request;
+        int32_t result;
+        while (ring.PopCompletion(request, result))
+        {
+            TakeCompletion(request, result);
+        }
+        if (!readPosted && !writePosted)
+        {
+            break;
+        }
+
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        struct pollfd fd = {completionFd, POLLIN, 0};
+        if (remaining.count() <= 0 || poll(&fd, 1, static_cast<int>(remaining.count())) == 0)
+        {
+            Log(LOG_LEVEL::ERROR, "io_uring requests still in flight after their cancellation");
+            break;
+        }
+        uint64_t completions;
+        if (read(completionFd, &completions, sizeof(completions)) < 0 && errno != EAGAIN)
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to read the eventfd of io_uring");
+        }
+    }
+    ring.Close();
+    if (completionFd >= 0)
+    {
+        close(completionFd);
+    }
+    if (uringWriteFd >= 0)
+    {
+        close(uringWriteFd);
+    }
+    completionFd = uringWriteFd = -1;
+    uringActive = false;
+    readPosted = writePosted = false;
+
+    // SendSegments() reported the whole write as sent, finish it while the device still blocks. The bytes of the
+    // last read are handed over by ReceiveSegments().
+    while (sendRest && uringSendOffset < uringSendSize)
+    {
+        systemCalls.fetch_add(1, std::memory_order_relaxed);
+        const ssize_t written = write(uart_fd, uringSendBuffer + uringSendOffset, uringSendSize - uringSendOffset);
+        if (written < 0 && errno != EINTR)
+        {
+            Log(LOG_LEVEL::ERROR, "Failed to send data");
+            break;
+        }
+        uringSendOffset += std::max<ssize_t>(written, 0);
+    }
+    uringSendSize = uringSendOffset = 0;
+
+    // Back to the non-blocking device of read() and write()
+    const int flags = fcntl(uart_fd, F_GETFL);
+    if (flags < 0 || fcntl(uart_fd, F_SETFL, flags | O_NONBLOCK) != 0)
+    {
+        Log(LOG_LEVEL::ERROR, "Failed to make the UART device non-blocking again");
+    }
+}
+
+void CM4UART::RunIOThread()
+{
+    size_t pendingBytes = ioPendingBytes.load(std::memory_order_relaxed);
+    bool stopping = false;
+    while (!stopping)
+    {
+        // Only wait for room in the device while bytes are waiting, or poll() would return right away
+        UpdateWakeupThreshold();
+        struct pollfd fds[2] = {{uart_fd, static_cast<short>(POLLIN | (pendingBytes > 0 ? POLLOUT : 0)), 0},
+                                {wakeFd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            Log(LOG_LEVEL::ERROR, "Failed to poll the UART device");
+            break;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            Log(LOG_LEVEL::ERROR, "UART device closed, stopping the I/O thread");
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t wakeups;
+            if (read(wakeFd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
+            {
+                Log(LOG_LEVEL::ERROR, "Failed to read the eventfd of the I/O thread");
+            }
+            // Packets sent before StopIOThread() are in the ring already, encode them before leaving
+            stopping = stopRequested.load(std::memory_order_acquire);
+        }
+
+        if ((fds[0].revents & POLLIN) && UART::DeframeUARTPackets(&CM4UART::ForwardReceivedPacket, this) > 0)
+        {
+            NotifyReceivedPackets();
+        }
+
+        // Make room in the send buffer before encoding the packets of the control thread
+        UART::SendUARTPackets();
+        for (IOPacket *packet = sentPackets.Front(); packet != nullptr; packet = sentPackets.Front())
+        {
+            // Without room, the packet stays in the ring until the device takes bytes, so that SendUARTPacket()
+            // returns false once the ring is full, like UART::SendUARTPacket() does once the buffers are
+            if (!TryQueueUARTPacket(packet->id, packet->payload.GetView()))
+            {
+                break;
+            }
+            sentPackets.Pop();
+        }
+        pendingBytes = UART::SendUARTPackets();
+        ioPendingBytes.store(pendingBytes, std::memory_order_relaxed);
+    }
+}
+
+void CM4UART::ForwardReceivedPacket(void *context, uint8_t id, PayloadView &payload)
+{
+    CM4UART *uart = static_cast<CM4UART *>(context);
+    IOPacket *packet = uart->receivedPackets.Back();
+    if (packet == nullptr)
+    {
+        uart->droppedReceived.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    packet->id = id;
+    packet->payload.SetBytes(payload.GetBytes(), payload.GetSize());
+    uart->receivedPackets.Push();
+}
+
+bool CM4UART::SendUARTPacket(const uint8_t id, const PayloadView &payload)
+{
+    if (!threaded)
+    {
+        return UART::SendUARTPacket(id, payload);
+    }
+
+    // The length field is a single byte
+    if (payload.GetSize() > UINT8_MAX)
+    {
+        Log(LOG_LEVEL::ERROR, "Payload too big to be sent");
+        return false;
+    }
+
+    IOPacket *packet = sentPackets.Back();
+    if (packet == nullptr)
+    {
+        return false;
+    }
+    packet->id = id;
+    packet->payload.SetBytes(payload.GetBytes(), payload.GetSize());
+    sentPackets.Push();
+    return true;
+}
+
+bool CM4UART::SendFrame(const uint8_t id, FrameRef frame)
+{
+    if (!threaded)
+    {
+        return UART::SendFrame(id, std::move(frame));
+    }
+
+    // Copied into the ring like any other packet, the frame goes back to its pool right away
+    if (!frame)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot send an empty frame");
+        return false;
+    }
+    return SendUARTPacket(id, frame.GetView());
+}
+
+size_t CM4UART::SendUARTPackets(size_t maxBytes)
+{
+    if (!threaded)
+    {
+        return UART::SendUARTPackets(maxBytes);
+    }
+
+    // A single system call for all the packets sent since the last call
+    if (sentPackets.Count() > 0)
+    {
+        WakeIOThread();
+    }
+    return ioPendingBytes.load(std::memory_order_relaxed);
+}
+
+int CM4UART::ReceiveUARTPackets()
+{
+    // Packets left by the I/O thread are handed over first, even once it is stopped
+    int packetsReceived = 0;
+    for (IOPacket *packet = receivedPackets.Front(); packet != nullptr; packet = receivedPackets.Front())
+    {
+        PayloadView payload = packet->payload.GetView();
+        DispatchPacket(packet->id, payload);
+        receivedPackets.Pop();
+        packetsReceived++;
+    }
+
+    if (!threaded)
+    {
+        packetsReceived += UART::ReceiveUARTPackets();
+    }
+    return packetsReceived;
+}
+
 void CM4UART::Log(LOG_LEVEL level, std::string message)
 {
     switch (level)
@@ -0,0 +1,179 @@
+#ifndef ARDUINO
+#include "Crc.h"
+#endif // ARDUINO
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAS_SSE42_KERNEL
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+
+// Slice-by-8 tables: table[k][i] is the CRC of the byte i followed by k zero bytes
+struct Crc16Tables
+{
+    uint16_t table[8][256];
+};
+
+struct Crc32Tables
+{
+    uint32_t table[8][256];
+};
+
+constexpr Crc16Tables MakeCrc16CcittTables()
+{
+    Crc16Tables tables = {};
+    for (unsigned i = 0; i < 256; i++)
+    {
+        uint16_t crc = i << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        tables.table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+    {
+        for (unsigned i = 0; i < 256; i++)
+        {
+            uint16_t previous = tables.table[k - 1][i];
+            tables.table[k][i] = (previous << 8) ^ tables.table[0][previous >> 8];
+        }
+    }
+    return tables;
+}
+
+constexpr Crc32Tables MakeCrc32cTables()
+{
+    Crc32Tables tables = {};
+    for (unsigned i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+        tables.table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+    {
+        for (unsigned i = 0; i < 256; i++)
+        {
+            uint32_t previous = tables.table[k - 1][i];
+            tables.table[k][i] = (previous >> 8) ^ tables.table[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+// Computed at compile time, so that they live in flash on the Teensy
+constexpr Crc16Tables CRC16_CCITT_TABLES = MakeCrc16CcittTables();
+constexpr Crc32Tables CRC32C_TABLES = MakeCrc32cTables();
+
+inline uint32_t LoadLittleEndian32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+#if defined(HAS_SSE42_KERNEL)
+
+__attribute__((target("sse4.2"))) uint32_t Crc32cSSE42(const uint8_t *data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint64_t block = LoadLittleEndian32(data) | (static_cast<uint64_t>(LoadLittleEndian32(data + 4)) << 32);
+        crc64 = _mm_crc32_u64(crc64, block);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; size >= 4; data += 4, size -= 4)
+        crc = _mm_crc32_u32(crc, LoadLittleEndian32(data));
+    for (; size > 0; data++, size--)
+        crc = _mm_crc32_u8(crc, *data);
+    return ~crc;
+}
+
+bool HasSSE42()
+{
+    static const bool hasSSE42 = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    return hasSSE42;
+}
+
+#elif defined(__ARM_FEATURE_CRC32)
+
+uint32_t Crc32cARMv8(const uint8_t *data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        uint64_t block = LoadLittleEndian32(data) | (static_cast<uint64_t>(LoadLittleEndian32(data + 4)) << 32);
+        crc = __crc32cd(crc, block);
+    }
+    for (; size > 0; data++, size--)
+        crc = __crc32cb(crc, *data);
+    return ~crc;
+}
+
+#endif
+
+} // namespace
+
+uint16_t Crc16CcittScalar(const uint8_t *data, size_t size, uint16_t crc)
+{
+    const auto &table = CRC16_CCITT_TABLES.table;
+    for (size_t i = 0; i < size; i++)
+        crc = (crc << 8) ^ table[0][(crc >> 8) ^ data[i]];
+    return crc;
+}
+
+uint16_t Crc16Ccitt(const uint8_t *data, size_t size, uint16_t crc)
+{
+    const auto &table = CRC16_CCITT_TABLES.table;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        // The CRC lines up with the first two bytes, since it is not reflected
+        crc = table[7][data[0] ^ (crc >> 8)] ^ table[6][data[1] ^ (crc & 0xFF)] ^ table[5][data[2]] ^
+              table[4][data[3]] ^ table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    return Crc16CcittScalar(data, size, crc);
+}
+
+uint32_t Crc32cScalar(const uint8_t *data, size_t size, uint32_t crc)
+{
+    const auto &table = CRC32C_TABLES.table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = (crc >> 8) ^ table[0][(crc ^ data[i]) & 0xFF];
+    return ~crc;
+}
+
+uint32_t Crc32cSliceBy8(const uint8_t *data, size_t size, uint32_t crc)
+{
+    const auto &table = CRC32C_TABLES.table;
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        // The CRC lines up with the first four bytes, since it is reflected
+        uint32_t low = LoadLittleEndian32(data) ^ crc;
+        uint32_t high = LoadLittleEndian32(data + 4);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^
+              table[0][high >> 24];
+    }
+    return Crc32cScalar(data, size, ~crc);
+}
+
+uint32_t Crc32c(const uint8_t *data, size_t size, uint32_t crc)
+{
+#if defined(HAS_SSE42_KERNEL)
+    if (HasSSE42())
+        return Crc32cSSE42(data, size, crc);
+    return Crc32cSliceBy8(data, size, crc);
+#elif defined(__ARM_FEATURE_CRC32)
+    return Crc32cARMv8(data, size, crc);
+#else
+    return Crc32cSliceBy8(data, size, crc);
+#endif
+}
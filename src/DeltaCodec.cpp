@@ -0,0 +1,349 @@
+#ifndef ARDUINO
+#include "DeltaCodec.h"
+#include "Crc.h"
+#include "Quantize.h"
+#endif // ARDUINO
+
+#include <cmath>   // For std::isnan, std::fabs
+#include <cstring> // For memcpy, memset
+
+namespace
+{
+// Steps of the fields, see the "Delta Encoding" section of the README
+constexpr double TIMESTAMP_STEP = 0.001; // in ms, wraps around every 71.6 minutes like the compact encoding
+constexpr double STATE_STEPS[4] = {
+    0.0001, // pos, in m
+    0.0001, // vel, in m/s
+    0.0001, // att, in rad
+    0.001,  // rate, in rad/s
+};
+constexpr double INLINE_THRUST_STEP = 0.00001;
+constexpr double INT32_STEPS_LIMIT = 2147483647;
+
+// Field indexes
+constexpr size_t ARMED = 0;
+constexpr size_t TIMESTAMP = 1;
+constexpr size_t DESIRED_STATE = 2;
+constexpr size_t CURRENT_STATE = 14;
+constexpr size_t SETPOINT_SELECTION = 26;
+constexpr size_t INLINE_THRUST = 27;
+static_assert(INLINE_THRUST + 1 == DELTA_FIELDS, "DELTA_FIELDS does not match the fields");
+
+// Signed number of steps, rounded to nearest and saturated to the int32 range, NaN gives 0.
+// Multiplied by the inverse of the step as QuantizeInt16(), a division per field would take most of the time.
+uint32_t QuantizeInt32(double value, double step)
+{
+    double steps = value * (1 / step);
+    if (std::isnan(steps))
+        return 0;
+    steps = steps < -INT32_STEPS_LIMIT ? -INT32_STEPS_LIMIT : (steps > INT32_STEPS_LIMIT ? INT32_STEPS_LIMIT : steps);
+    return static_cast<uint32_t>(static_cast<int32_t>(RoundToNearest(steps)));
+}
+
+// Unsigned number of steps, wrapped modulo 2^32 steps as EncodeDoubleAsUint32()
+uint32_t QuantizeUint32(double value, double step)
+{
+    double steps = value / step;
+    if (!(std::fabs(steps) < ROUNDING_LIMIT))
+        return 0;
+    return static_cast<uint32_t>(static_cast<int64_t>(RoundToNearest(steps)));
+}
+
+double RestoreInt32(uint32_t steps, double step)
+{
+    return static_cast<int32_t>(steps) * step;
+}
+
+void QuantizeVec3(const Vec3 &vec, double step, uint32_t *values)
+{
+    values[0] = QuantizeInt32(vec.x, step);
+    values[1] = QuantizeInt32(vec.y, step);
+    values[2] = QuantizeInt32(vec.z, step);
+}
+
+void RestoreVec3(const uint32_t *values, double step, Vec3 &vec)
+{
+    vec.x = RestoreInt32(values[0], step);
+    vec.y = RestoreInt32(values[1], step);
+    vec.z = RestoreInt32(values[2], step);
+}
+
+void QuantizeState(const State &state, uint32_t *values)
+{
+    QuantizeVec3(state.pos, STATE_STEPS[0], values);
+    QuantizeVec3(state.vel, STATE_STEPS[1], values + 3);
+    QuantizeVec3(state.att, STATE_STEPS[2], values + 6);
+    QuantizeVec3(state.rate, STATE_STEPS[3], values + 9);
+}
+
+void RestoreState(const uint32_t *values, State &state)
+{
+    RestoreVec3(values, STATE_STEPS[0], state.pos);
+    RestoreVec3(values + 3, STATE_STEPS[1], state.vel);
+    RestoreVec3(values + 6, STATE_STEPS[2], state.att);
+    RestoreVec3(values + 9, STATE_STEPS[3], state.rate);
+}
+
+// Small differences of either sign give small varints: 0, -1, 1, -2... become 0, 1, 2, 3...
+uint32_t ZigZag(uint32_t delta)
+{
+    return (delta << 1) ^ (0u - (delta >> 31));
+}
+
+uint32_t UnZigZag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// LEB128: 7 bits per byte, least significant first, the high bit set on all bytes but the last
+uint8_t *WriteVarint(uint8_t *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// Returns nullptr if the varint is longer than 5 bytes or runs past end
+const uint8_t *ReadVarint(const uint8_t *in, const uint8_t *end, uint32_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 35 && in < end; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return in;
+    }
+    return nullptr;
+}
+
+uint16_t Checksum(const DeltaFields &fields)
+{
+    return Crc16Ccitt(reinterpret_cast<const uint8_t *>(fields.values), sizeof(fields.values));
+}
+
+const DeltaFields ZERO_FIELDS = {};
+} // namespace
+
+void QuantizeDeltaFields(const ControlInputPacket &packet, DeltaFields &fields)
+{
+    uint32_t *values = fields.values;
+    values[ARMED] = packet.armed ? 1 : 0;
+    values[TIMESTAMP] = QuantizeUint32(packet.timestamp, TIMESTAMP_STEP);
+    QuantizeState(packet.desired_state, values + DESIRED_STATE);
+    QuantizeState(packet.current_state, values + CURRENT_STATE);
+
+    const bool *bits[] = {packet.setpointSelection.posSPActive, packet.setpointSelection.velSPActive,
+                          packet.setpointSelection.attSPActive, packet.setpointSelection.rateSPActive};
+    uint32_t selection = 0;
+    for (size_t i = 0; i < 12; i++)
+    {
+        selection |= static_cast<uint32_t>(bits[i / 3][i % 3]) << i;
+    }
+    values[SETPOINT_SELECTION] = selection;
+    values[INLINE_THRUST] = QuantizeInt32(packet.inline_thrust, INLINE_THRUST_STEP);
+}
+
+void RestoreDeltaFields(const DeltaFields &fields, ControlInputPacket &packet)
+{
+    const uint32_t *values = fields.values;
+    packet.armed = values[ARMED] != 0;
+    packet.timestamp = values[TIMESTAMP] * TIMESTAMP_STEP;
+    RestoreState(values + DESIRED_STATE, packet.desired_state);
+    RestoreState(values + CURRENT_STATE, packet.current_state);
+
+    bool *bits[] = {packet.setpointSelection.posSPActive, packet.setpointSelection.velSPActive,
+                    packet.setpointSelection.attSPActive, packet.setpointSelection.rateSPActive};
+    for (size_t i = 0; i < 12; i++)
+    {
+        bits[i / 3][i % 3] = (values[SETPOINT_SELECTION] >> i) & 1;
+    }
+    packet.inline_thrust = RestoreInt32(values[INLINE_THRUST], INLINE_THRUST_STEP);
+}
+
+DeltaEncoder::DeltaEncoder(uint32_t keyframeInterval)
+    : keyframeInterval(keyframeInterval), framesSinceKeyframe(0), nextSequence(0), referenceSequence(0),
+      hasReference(false), keyframePending(false), framesEncoded(0), keyframesEncoded(0)
+{
+}
+
+bool DeltaEncoder::InHistory(uint8_t sequence) const
+{
+    const uint8_t age = static_cast<uint8_t>(nextSequence - sequence);
+    return age >= 1 && age <= DELTA_HISTORY && age <= framesEncoded;
+}
+
+bool DeltaEncoder::Encode(const ControlInputPacket &packet, Payload &payload)
+{
+    DeltaFields fields;
+    QuantizeDeltaFields(packet, fields);
+
+    const bool keyframe = keyframePending || !hasReference || !InHistory(referenceSequence) ||
+                          (keyframeInterval > 0 && framesSinceKeyframe >= keyframeInterval);
+    const DeltaFields &reference = keyframe ? ZERO_FIELDS : history[referenceSequence % DELTA_HISTORY];
+
+    uint8_t frame[DELTA_FRAME_MAX_SIZE];
+    uint8_t *out = frame;
+    *out++ = keyframe ? DELTA_FLAG_KEYFRAME : 0;
+    *out++ = nextSequence;
+    if (!keyframe)
+    {
+        *out++ = referenceSequence;
+    }
+    uint8_t *presence = out;
+    std::memset(presence, 0, DELTA_PRESENCE_SIZE);
+    out += DELTA_PRESENCE_SIZE;
+    for (size_t i = 0; i < DELTA_FIELDS; i++)
+    {
+        const uint32_t delta = fields.values[i] - reference.values[i];
+        if (delta != 0)
+        {
+            presence[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            out = WriteVarint(out, ZigZag(delta));
+        }
+    }
+    const uint16_t checksum = Checksum(fields);
+    std::memcpy(out, &checksum, sizeof(checksum));
+    out += sizeof(checksum);
+
+    if (!payload.WriteBytes(frame, out - frame))
+    {
+        return false;
+    }
+
+    // The reference was read above, this may overwrite it when it is the oldest frame of the history
+    history[nextSequence % DELTA_HISTORY] = fields;
+    nextSequence++;
+    framesEncoded++;
+    framesSinceKeyframe = keyframe ? 1 : framesSinceKeyframe + 1;
+    if (keyframe)
+    {
+        keyframesEncoded++;
+        keyframePending = false;
+    }
+    return true;
+}
+
+void DeltaEncoder::OnAck(const DeltaAckPacket &ack)
+{
+    if (ack.keyframe_request)
+    {
+        // Keyframes until the decoder acknowledges one, whatever it had before may be gone
+        hasReference = false;
+        return;
+    }
+    if (!InHistory(ack.sequence))
+    {
+        return;
+    }
+    // Keep the newest reference
+    const uint8_t age = static_cast<uint8_t>(nextSequence - ack.sequence);
+    if (hasReference && InHistory(referenceSequence) && age > static_cast<uint8_t>(nextSequence - referenceSequence))
+    {
+        return;
+    }
+    referenceSequence = ack.sequence;
+    hasReference = true;
+}
+
+DeltaDecoder::DeltaDecoder() : lastSequence(0), keyframeRequested(true), framesDecoded(0), framesRejected(0)
+{
+    for (size_t i = 0; i < DELTA_HISTORY; i++)
+    {
+        historySequence[i] = 0;
+        historyValid[i] = false;
+    }
+}
+
+void DeltaDecoder::RequestKeyframe()
+{
+    keyframeRequested = true;
+    for (size_t i = 0; i < DELTA_HISTORY; i++)
+    {
+        historyValid[i] = false;
+    }
+}
+
+bool DeltaDecoder::Reject()
+{
+    framesRejected++;
+    RequestKeyframe();
+    return false;
+}
+
+bool DeltaDecoder::Decode(PayloadView payload, ControlInputPacket &packet)
+{
+    const uint8_t *in = payload.GetBytes() + payload.GetReadPosition();
+    const uint8_t *end = payload.GetBytes() + payload.GetSize();
+    if (end - in < 2)
+    {
+        return Reject();
+    }
+    const uint8_t flags = *in++;
+    const uint8_t sequence = *in++;
+    if (flags & ~DELTA_FLAG_KEYFRAME)
+    {
+        return Reject();
+    }
+
+    const DeltaFields *reference = &ZERO_FIELDS;
+    if (!(flags & DELTA_FLAG_KEYFRAME))
+    {
+        if (in == end)
+        {
+            return Reject();
+        }
+        const uint8_t referenceSequence = *in++;
+        const size_t slot = referenceSequence % DELTA_HISTORY;
+        if (!historyValid[slot] || historySequence[slot] != referenceSequence)
+        {
+            return Reject();
+        }
+        reference = &history[slot];
+    }
+
+    if (end - in < static_cast<ptrdiff_t>(DELTA_PRESENCE_SIZE + sizeof(uint16_t)))
+    {
+        return Reject();
+    }
+    const uint8_t *presence = in;
+    in += DELTA_PRESENCE_SIZE;
+    const uint8_t *deltasEnd = end - sizeof(uint16_t);
+    DeltaFields fields;
+    for (size_t i = 0; i < DELTA_FIELDS; i++)
+    {
+        uint32_t delta = 0;
+        if (presence[i / 8] & (1 << (i % 8)))
+        {
+            in = ReadVarint(in, deltasEnd, delta);
+            if (!in)
+            {
+                return Reject();
+            }
+        }
+        fields.values[i] = reference->values[i] + UnZigZag(delta);
+    }
+    uint16_t checksum;
+    std::memcpy(&checksum, deltasEnd, sizeof(checksum));
+    if (in != deltasEnd || checksum != Checksum(fields))
+    {
+        return Reject();
+    }
+
+    const size_t slot = sequence % DELTA_HISTORY;
+    history[slot] = fields;
+    historySequence[slot] = sequence;
+    historyValid[slot] = true;
+    lastSequence = sequence;
+    if (flags & DELTA_FLAG_KEYFRAME)
+    {
+        keyframeRequested = false;
+    }
+    framesDecoded++;
+    RestoreDeltaFields(fields, packet);
+    return true;
+}
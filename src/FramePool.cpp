@@ -0,0 +1,166 @@
+#ifndef ARDUINO
+#include "FramePool.h"
+#endif // ARDUINO
+
+#include <cstddef>
+#include <utility> // For std::move
+
+namespace
+{
+constexpr uint32_t INDEX_MASK = 0xFFFF;
+constexpr uint32_t TAG_INCREMENT = 0x10000;
+} // namespace
+
+FrameRef::FrameRef(const FrameRef &other) : pool(other.pool), frame(other.frame)
+{
+    if (frame)
+    {
+        // The other reference keeps the frame alive, so no ordering is needed
+        frame->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameRef::FrameRef(FrameRef &&other) noexcept : pool(other.pool), frame(other.frame)
+{
+    other.pool = nullptr;
+    other.frame = nullptr;
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &other)
+{
+    if (this != &other)
+    {
+        FrameRef copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+FrameRef &FrameRef::operator=(FrameRef &&other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        pool = other.pool;
+        frame = other.frame;
+        other.pool = nullptr;
+        other.frame = nullptr;
+    }
+    return *this;
+}
+
+FrameRef::~FrameRef()
+{
+    Reset();
+}
+
+void FrameRef::Reset()
+{
+    // The last reference makes the writes of all the others visible before giving the frame back
+    if (frame && frame->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        pool->Free(frame);
+    }
+    pool = nullptr;
+    frame = nullptr;
+}
+
+Payload &FrameRef::operator*() const
+{
+    return frame->payload;
+}
+
+Payload *FrameRef::operator->() const
+{
+    return &frame->payload;
+}
+
+uint32_t FrameRef::UseCount() const
+{
+    return frame ? frame->refCount.load(std::memory_order_relaxed) : 0;
+}
+
+FramePool::FramePool() : freeHead(0), inUse(0), peakInUse(0), allocationFailures(0)
+{
+    // Chain all the frames in the free list, in order
+    for (size_t i = 0; i < SIZE; i++)
+    {
+        frames[i].refCount.store(0, std::memory_order_relaxed);
+        frames[i].next.store(i + 1 < SIZE ? static_cast<uint16_t>(i + 1) : NO_FRAME, std::memory_order_relaxed);
+    }
+}
+
+FrameRef FramePool::Allocate()
+{
+    // Pop the head of the free list
+    uint32_t head = freeHead.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t index = head & INDEX_MASK;
+        if (index == NO_FRAME)
+        {
+            allocationFailures.fetch_add(1, std::memory_order_relaxed);
+            return FrameRef();
+        }
+
+        // next is stale if the frame was popped meanwhile, but the tag has then changed and the swap fails
+        uint32_t next = frames[index].next.load(std::memory_order_relaxed);
+        uint32_t newHead = ((head & ~INDEX_MASK) + TAG_INCREMENT) | next;
+        if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+
+    FrameRef::Frame *frame = &frames[head & INDEX_MASK];
+    frame->refCount.store(1, std::memory_order_relaxed);
+    frame->payload.Clear();
+
+    uint32_t used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t peak = peakInUse.load(std::memory_order_relaxed);
+    while (used > peak && !peakInUse.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+    {
+    }
+
+    return FrameRef(this, frame);
+}
+
+FrameRef FramePool::Retain(const PayloadView &payload)
+{
+    FrameRef frame = Allocate();
+    if (frame && !frame->SetBytes(payload.GetBytes(), payload.GetSize()))
+    {
+        // Too big for a frame, which cannot happen for a received payload
+        frame.Reset();
+    }
+    return frame;
+}
+
+void FramePool::Free(FrameRef::Frame *frame)
+{
+    uint16_t index = static_cast<uint16_t>(frame - frames);
+    inUse.fetch_sub(1, std::memory_order_relaxed);
+
+    // Push the frame back at the head of the free list
+    uint32_t head = freeHead.load(std::memory_order_relaxed);
+    do
+    {
+        frame->next.store(static_cast<uint16_t>(head & INDEX_MASK), std::memory_order_relaxed);
+    } while (!freeHead.compare_exchange_weak(head, ((head & ~INDEX_MASK) + TAG_INCREMENT) | index,
+                                             std::memory_order_release, std::memory_order_relaxed));
+}
+
+size_t FramePool::InUse() const
+{
+    return inUse.load(std::memory_order_relaxed);
+}
+
+size_t FramePool::PeakInUse() const
+{
+    return peakInUse.load(std::memory_order_relaxed);
+}
+
+size_t FramePool::AllocationFailures() const
+{
+    return allocationFailures.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,333 @@
+#ifndef ARDUINO // Compiles only in a non-Arduino environment
+
+#include "IoUring.h"
+
+#ifdef HAS_IO_URING
+#include <algorithm>         // For std::max
+#include <atomic>            // For atomic_thread_fence
+#include <cerrno>            // For errno
+#include <cstring>           // For memset
+#include <linux/io_uring.h>  // For the io_uring structures and constants
+#include <sys/mman.h>        // For mmap, munmap
+#include <sys/syscall.h>     // For __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <sys/uio.h>         // For iovec
+#include <unistd.h>          // For syscall, close
+
+namespace
+{
+// How long the kernel polling thread keeps polling after the last request before going to sleep, in ms.
+// Longer than a control period, so that it stays awake while the control loop runs.
+constexpr unsigned KERNEL_POLLING_IDLE_MS = 100;
+
+// The ring indexes are shared with the kernel: the ones it writes are read with acquire, and the ones we write are
+// published with release, like liburing does
+unsigned LoadAcquire(const unsigned *index)
+{
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned *index, unsigned value)
+{
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+template <typename T> T *At(void *ring, unsigned offset)
+{
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(ring) + offset);
+}
+} // namespace
+#endif // HAS_IO_URING
+
+IoUring::IoUring()
+    : ringFd(-1), kernelPolling(false), systemCalls(0), submissionRing(nullptr), submissionRingSize(0),
+      completionRing(nullptr), completionRingSize(0), submissions(nullptr), submissionsSize(0),
+      submissionHead(nullptr), submissionTail(nullptr), submissionFlags(nullptr), submissionIndexes(nullptr),
+      submissionMask(0), submissionEntries(0), queuedTail(0), completionHead(nullptr), completionTail(nullptr),
+      completionMask(0), completions(nullptr)
+{
+}
+
+IoUring::~IoUring()
+{
+    Close();
+}
+
+#ifdef HAS_IO_URING
+
+bool IoUring::Setup(unsigned entries, bool polling)
+{
+    Close();
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    if (polling)
+    {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = KERNEL_POLLING_IDLE_MS;
+    }
+    // Fails with ENOSYS on kernels without io_uring, or EPERM where it is disabled or filtered out
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ringFd < 0)
+    {
+        return false;
+    }
+    kernelPolling = polling;
+
+    // Map the rings, in a single mapping on the kernels that support it
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+    {
+        submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+    }
+    submissionRing = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_SQ_RING);
+    if (submissionRing == MAP_FAILED)
+    {
+        submissionRing = nullptr;
+        Close();
+        return false;
+    }
+    completionRing = singleMapping ? submissionRing
+                                   : mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (completionRing == MAP_FAILED)
+    {
+        completionRing = nullptr;
+        Close();
+        return false;
+    }
+    submissionsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, submissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    submissions = static_cast<struct io_uring_sqe *>(sqes);
+
+    submissionHead = At<unsigned>(submissionRing, params.sq_off.head);
+    submissionTail = At<unsigned>(submissionRing, params.sq_off.tail);
+    submissionFlags = At<unsigned>(submissionRing, params.sq_off.flags);
+    submissionIndexes = At<unsigned>(submissionRing, params.sq_off.array);
+    submissionMask = *At<unsigned>(submissionRing, params.sq_off.ring_mask);
+    submissionEntries = params.sq_entries;
+    queuedTail = *submissionTail;
+    completionHead = At<unsigned>(completionRing, params.cq_off.head);
+    completionTail = At<unsigned>(completionRing, params.cq_off.tail);
+    completionMask = *At<unsigned>(completionRing, params.cq_off.ring_mask);
+    completions = At<struct io_uring_cqe>(completionRing, params.cq_off.cqes);
+    return true;
+}
+
+void IoUring::Close()
+{
+    if (submissions != nullptr)
+    {
+        munmap(submissions, submissionsSize);
+    }
+    if (completionRing != nullptr && completionRing != submissionRing)
+    {
+        munmap(completionRing, completionRingSize);
+    }
+    if (submissionRing != nullptr)
+    {
+        munmap(submissionRing, submissionRingSize);
+    }
+    if (ringFd >= 0)
+    {
+        close(ringFd);
+    }
+    ringFd = -1;
+    submissionRing = completionRing = nullptr;
+    submissions = nullptr;
+}
+
+bool IoUring::RegisterFiles(const int *fds, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES, fds, count) == 0;
+}
+
+bool IoUring::RegisterBuffers(const struct iovec *buffers, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+bool IoUring::RegisterEventFd(int fd)
+{
+    return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_EVENTFD, &fd, 1) == 0;
+}
+
+bool IoUring::QueueFixed(uint8_t opcode, uint8_t flags, int fileIndex, const void *buffer, unsigned size,
+                         uint16_t bufferIndex, uint64_t userData)
+{
+    if (queuedTail - LoadAcquire(submissionHead) >= submissionEntries)
+    {
+        return false;
+    }
+
+    const unsigned index = queuedTail & submissionMask;
+    struct io_uring_sqe &sqe = submissions[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.flags = IOSQE_FIXED_FILE | flags;
+    sqe.fd = fileIndex;
+    sqe.off = static_cast<uint64_t>(-1); // At the current position, as read() and write() on a tty
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = size;
+    sqe.buf_index = bufferIndex;
+    sqe.user_data = userData;
+    submissionIndexes[index] = index;
+    queuedTail++;
+    return true;
+}
+
+bool IoUring::QueueReadFixed(int fileIndex, void *buffer, unsigned size, uint16_t bufferIndex, uint64_t userData)
+{
+    // A tty read blocks until VMIN bytes arrive even when io_uring asks it not to, unless the file is non-blocking,
+    // which would block Submit(): hand it to a kernel worker thread straight away
+    return QueueFixed(IORING_OP_READ_FIXED, IOSQE_ASYNC, fileIndex, buffer, size, bufferIndex, userData);
+}
+
+bool IoUring::QueueWriteFixed(int fileIndex, const void *buffer, unsigned size, uint16_t bufferIndex,
+                              uint64_t userData)
+{
+    return QueueFixed(IORING_OP_WRITE_FIXED, 0, fileIndex, buffer, size, bufferIndex, userData);
+}
+
+bool IoUring::QueueCancel(uint64_t targetUserData, uint64_t userData)
+{
+    if (!QueueFixed(IORING_OP_ASYNC_CANCEL, 0, -1, nullptr, 0, 0, userData))
+    {
+        return false;
+    }
+    // Not a fixed request: the target is given by its user_data, in addr
+    struct io_uring_sqe &sqe = submissions[(queuedTail - 1) & submissionMask];
+    sqe.flags = 0;
+    sqe.fd = -1;
+    sqe.off = 0;
+    sqe.addr = targetUserData;
+    return true;
+}
+
+bool IoUring::HasQueuedRequests() const
+{
+    // Until the kernel takes them, which moves the head
+    return ringFd >= 0 && queuedTail != LoadAcquire(submissionHead);
+}
+
+bool IoUring::Submit()
+{
+    // The requests the kernel did not take in an earlier call are still between the head and the tail, and go with
+    // the new ones
+    const unsigned toSubmit = queuedTail - LoadAcquire(submissionHead);
+    if (toSubmit == 0)
+    {
+        return true;
+    }
+    StoreRelease(submissionTail, queuedTail);
+
+    unsigned flags = 0;
+    if (kernelPolling)
+    {
+        // The polling thread picks the requests up by itself, unless it went to sleep.
+        // The fence orders the tail store before the flags load, so that it cannot miss them and sleep.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!(__atomic_load_n(submissionFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP))
+        {
+            return true;
+        }
+        flags = IORING_ENTER_SQ_WAKEUP;
+    }
+
+    systemCalls++;
+    long submitted;
+    do
+    {
+        submitted = syscall(__NR_io_uring_enter, ringFd, kernelPolling ? 0 : toSubmit, 0, flags, nullptr, 0);
+    } while (submitted < 0 && errno == EINTR);
+    // With EAGAIN or EBUSY, the kernel is short of resources for now, and the requests stay queued too
+    return submitted >= 0 || errno == EAGAIN || errno == EBUSY;
+}
+
+bool IoUring::PopCompletion(uint64_t &userData, int32_t &result)
+{
+    // Only we move the head
+    const unsigned head = *completionHead;
+    if (head == LoadAcquire(completionTail))
+    {
+        return false;
+    }
+    const struct io_uring_cqe &cqe = completions[head & completionMask];
+    userData = cqe.user_data;
+    result = cqe.res;
+    StoreRelease(completionHead, head + 1);
+    return true;
+}
+
+#else // HAS_IO_URING
+
+bool IoUring::Setup(unsigned /* entries */, bool /* polling */)
+{
+    return false;
+}
+
+void IoUring::Close()
+{
+}
+
+bool IoUring::RegisterFiles(const int * /* fds */, unsigned /* count */)
+{
+    return false;
+}
+
+bool IoUring::RegisterBuffers(const struct iovec * /* buffers */, unsigned /* count */)
+{
+    return false;
+}
+
+bool IoUring::RegisterEventFd(int /* fd */)
+{
+    return false;
+}
+
+bool IoUring::QueueFixed(uint8_t, uint8_t, int, const void *, unsigned, uint16_t, uint64_t)
+{
+    return false;
+}
+
+bool IoUring::QueueReadFixed(int, void *, unsigned, uint16_t, uint64_t)
+{
+    return false;
+}
+
+bool IoUring::QueueWriteFixed(int, const void *, unsigned, uint16_t, uint64_t)
+{
+    return false;
+}
+
+bool IoUring::QueueCancel(uint64_t, uint64_t)
+{
+    return false;
+}
+
+bool IoUring::HasQueuedRequests() const
+{
+    return false;
+}
+
+bool IoUring::Submit()
+{
+    return false;
+}
+
+bool IoUring::PopCompletion(uint64_t &, int32_t &)
+{
+    return false;
+}
+
+#endif // HAS_IO_URING
+
+#endif // ARDUINO
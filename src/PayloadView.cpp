@@ -0,0 +1,115 @@
+#ifndef ARDUINO
+#include "PayloadView.h"
+#endif // ARDUINO
+
+#include <cstring>
+
+PayloadView::PayloadView(const uint8_t *bytes, size_t size, size_t readPosition)
+    : data(bytes), size(size), readPosition(readPosition)
+{
+}
+
+const uint8_t *PayloadView::GetBytes() const
+{
+    return data;
+}
+
+size_t PayloadView::GetSize() const
+{
+    return size;
+}
+
+bool PayloadView::ReadInt(int &value)
+{
+    if (readPosition + sizeof(int) > size)
+    {
+        return false; // Error: Not enough bytes
+    }
+
+    std::memcpy(&value, data + readPosition, sizeof(int));
+    readPosition += sizeof(int);
+    return true;
+}
+
+bool PayloadView::ReadFloat(float &value)
+{
+    if (readPosition + sizeof(float) > size)
+    {
+        return false;
+    }
+
+    std::memcpy(&value, data + readPosition, sizeof(float));
+    readPosition += sizeof(float);
+    return true;
+}
+
+bool PayloadView::ReadDouble(double &value)
+{
+    if (readPosition + sizeof(double) > size)
+    {
+        return false;
+    }
+
+    std::memcpy(&value, data + readPosition, sizeof(double));
+    readPosition += sizeof(double);
+    return true;
+}
+
+bool PayloadView::ReadBool(bool &value)
+{
+    if (readPosition >= size)
+    {
+        return false;
+    }
+
+    value = data[readPosition] != 0;
+    readPosition += 1;
+    return true;
+}
+
+bool PayloadView::ReadBytes(uint8_t *destBuffer, size_t length)
+{
+    if (readPosition + length > size)
+    {
+        return false;
+    }
+
+    std::memcpy(destBuffer, data + readPosition, length);
+    readPosition += length;
+    return true;
+}
+
+bool PayloadView::ReadVec3(Vec3 &vec)
+{
+    return ReadStruct(vec);
+}
+
+bool PayloadView::ReadState(State &state)
+{
+    return ReadStruct(state);
+}
+
+bool PayloadView::ReadSetpointSelection(SetpointSelection &setpoint)
+{
+    return ReadStruct(setpoint);
+}
+
+bool PayloadView::ReadControlInputPacket(ControlInputPacket &control_input)
+{
+    return ReadPacket(control_input);
+}
+
+bool PayloadView::ReadControlOutputPacket(ControlOutputPacket &control_output)
+{
+    return ReadPacket(control_output);
+}
+
+void PayloadView::ResetReadPosition()
+{
+    readPosition = 0;
+}
+
+size_t PayloadView::GetReadPosition() const
+{
+    return readPosition;
+}
@@ -0,0 +1,72 @@
+#ifndef ARDUINO
+#include "RingBuffer.h"
+#endif // ARDUINO
+
+#if defined(__linux__)
+#include <sys/mman.h> // For memfd_create, mmap
+#include <unistd.h>   // For ftruncate, sysconf, close
+#endif
+
+RingBuffer::RingBuffer(uint8_t *storage, size_t size) : data(storage), size(size), capacity(size), mirrored(false)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+#if defined(__linux__)
+    if (mirrored)
+    {
+        munmap(data, 2 * size);
+    }
+#endif
+}
+
+bool RingBuffer::Mirror()
+{
+#if defined(__linux__)
+    if (mirrored)
+        return true;
+
+    // Both mappings must be page aligned, page sizes are powers of two
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mirroredSize = (size > pageSize) ? size : pageSize;
+
+    int fd = memfd_create("uart_ring_buffer", 0);
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, mirroredSize) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Reserve twice the size, then map the same memory over both halves
+    void *reserved = mmap(nullptr, 2 * mirroredSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    uint8_t *base = static_cast<uint8_t *>(reserved);
+    bool mapped = mmap(base, mirroredSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                  mmap(base + mirroredSize, mirroredSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) !=
+                      MAP_FAILED;
+    // The mappings keep the memory alive
+    close(fd);
+
+    if (!mapped)
+    {
+        munmap(reserved, 2 * mirroredSize);
+        return false;
+    }
+
+    data = base;
+    size = mirroredSize;
+    mirrored = true;
+    return true;
+#else
+    return false;
+#endif
+}
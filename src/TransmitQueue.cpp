@@ -0,0 +1,76 @@
+#ifndef ARDUINO
+#include "TransmitQueue.h"
+#endif // ARDUINO
+
+#include <cstring> // For memcpy
+
+TransmitQueue::TransmitQueue() : head(0), tail(0), wrapEnd(SIZE), wrapped(false), count(0), bytes(0)
+{
+}
+
+bool TransmitQueue::Push(uint8_t id, const PayloadView &payload, uint32_t stamp)
+{
+    const size_t size = HEADER_SIZE + payload.GetSize();
+    size_t start;
+    if (wrapped)
+    {
+        // Between the newest records at the start and the oldest ones
+        if (head - tail < size)
+            return false;
+        start = tail;
+    }
+    else if (SIZE - tail >= size)
+    {
+        start = tail;
+    }
+    else if (head >= size)
+    {
+        // Skip the end of the storage
+        wrapEnd = tail;
+        wrapped = true;
+        start = 0;
+    }
+    else
+    {
+        return false;
+    }
+
+    uint8_t *record = storage + start;
+    std::memcpy(record, &stamp, sizeof(stamp));
+    record[sizeof(stamp)] = id;
+    record[sizeof(stamp) + 1] = static_cast<uint8_t>(payload.GetSize());
+    std::memcpy(record + HEADER_SIZE, payload.GetBytes(), payload.GetSize());
+    tail = start + size;
+    count++;
+    bytes += size - sizeof(stamp);
+    return true;
+}
+
+uint32_t TransmitQueue::FrontStamp() const
+{
+    uint32_t stamp;
+    std::memcpy(&stamp, storage + head, sizeof(stamp));
+    return stamp;
+}
+
+void TransmitQueue::Pop()
+{
+    const size_t size = HEADER_SIZE + storage[head + sizeof(uint32_t) + 1];
+    head += size;
+    count--;
+    bytes -= size - sizeof(uint32_t);
+
+    if (count == 0)
+    {
+        // Start over at the beginning, where the most contiguous room is
+        head = tail = 0;
+        wrapEnd = SIZE;
+        wrapped = false;
+    }
+    else if (wrapped && head == wrapEnd)
+    {
+        head = 0;
+        wrapEnd = SIZE;
+        wrapped = false;
+    }
+}
@@ -1,263 +1,934 @@
 #ifndef ARDUINO
 #include "UART.h"
+#include "ByteStuffing.h"
+#include "Crc.h"
+#include "RingBuffer.h"
 #include "Payload.h"
 #endif // ARDUINO
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <stdexcept>
 
 UART::UART()
-    : readIndex(0),
+    : framing(Framing::ESCAPE),
+      integrity(Integrity::CHECKSUM),
+      encoding(WireEncoding::FULL),
+      circularBuffer(circularBufferStorage, RING_BUFFER_SIZE),
+      readIndex(0),
       writeIndex(0),
-      peekIndex(0),
+      frameWriteIndex(0),
+      sendBuffer(sendBufferStorage, SEND_BUFFER_SIZE),
       sendBufferStart(0),
-      sendBufferEnd(0)
+      sendBufferEnd(0),
+      pendingFramesStart(0),
+      pendingFramesCount(0),
+      weights{4, 1},
+      deficits{0, 0},
+      roundRobinIndex(PRIORITY_COUNT - 2),
+      transmitStats{},
+      totalBytesSent(0),
+      mailboxCount(0),
+      decoderState(DecoderState::WAIT_START),
+      escapePending(false)
 {
+    std::fill(std::begin(maxPayloadSizes), std::end(maxPayloadSizes), UINT8_MAX);
+    std::fill(std::begin(priorities), std::end(priorities), Priority::CONTROL);
+    std::fill(std::begin(mailboxIndexes), std::end(mailboxIndexes), MAILBOX_COUNT);
 }
 
-void UART::RegisterHandler(int packetId, std::function<void(Payload &)> handler)
+bool UART::SetIntegrity(Integrity newIntegrity)
 {
-    handlers[packetId] = handler;
+    // Packets already received or queued would be checked the old way
+    if (readIndex != writeIndex || sendBufferStart != sendBufferEnd)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot change the integrity check while the buffers are in use");
+        return false;
+    }
+
+    integrity = newIntegrity;
+    ResetDecoder();
+    return true;
 }
 
-bool UART::SendUARTPacket(const uint8_t id, Payload &payload)
+bool UART::SetEncoding(WireEncoding newEncoding)
 {
-    uint8_t packetBuffer[MAX_PACKET_SIZE_UNSTUFFED];
-    size_t packetBufferIndex = 0;
+    // Packets already received or queued would be decoded the old way
+    if (readIndex != writeIndex || sendBufferStart != sendBufferEnd || QueuedPacketBytes() > 0)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot change the encoding while the buffers are in use");
+        return false;
+    }
 
-    // 1. Start byte
-    packetBuffer[packetBufferIndex++] = START_BYTE;
+    encoding = newEncoding;
+    return true;
+}
 
-    // 2. Packet ID
-    packetBuffer[packetBufferIndex++] = id;
+bool UART::SetFraming(Framing newFraming)
+{
+    // Bytes already received or queued would be framed the old way
+    if (readIndex != writeIndex || sendBufferStart != sendBufferEnd)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot change the framing while the buffers are in use");
+        return false;
+    }
 
-    // 3. Length
-    packetBuffer[packetBufferIndex++] = payload.GetSize();
+    framing = newFraming;
+    ResetDecoder();
+    return true;
+}
 
-    // 4. Payload
-    const uint8_t *payloadData = payload.GetBytes();
-    for (size_t i = 0; i < payload.GetSize(); i++)
+void UART::ResetDecoder()
+{
+    if (framing == Framing::COBS)
     {
-        packetBuffer[packetBufferIndex++] = payloadData[i];
+        // COBS frames have no start byte, the first one starts right away
+        StartFrame();
     }
+    else
+    {
+        decoderState = DecoderState::WAIT_START;
+    }
+}
 
-    // 5. Checksum
-    uint8_t checksum = ComputeChecksum(packetBuffer + 1, packetBufferIndex - 1); // Exclude start byte
-    packetBuffer[packetBufferIndex++] = checksum;
+void UART::SetPriority(uint8_t packet_id, Priority priority)
+{
+    priorities[packet_id] = priority;
+}
 
-    // 6. End byte
-    packetBuffer[packetBufferIndex++] = END_BYTE;
+bool UART::SetPriorityWeight(Priority priority, uint8_t weight)
+{
+    if (priority == Priority::CONTROL || weight == 0)
+    {
+        Log(LOG_LEVEL::ERROR, "Only TELEMETRY and BULK have a weight, of at least 1");
+        return false;
+    }
+
+    weights[static_cast<size_t>(priority) - 1] = weight;
+    return true;
+}
+
+UART::TransmitStats UART::GetTransmitStats(Priority priority) const
+{
+    TransmitStats stats = transmitStats[static_cast<size_t>(priority)];
+    stats.depth = QueueDepth(priority);
+    return stats;
+}
+
+size_t UART::QueueDepth(Priority priority) const
+{
+    size_t depth = (priority == Priority::CONTROL) ? pendingFramesCount
+                                                   : transmitQueues[static_cast<size_t>(priority) - 1].Count();
+    for (size_t i = 0; i < mailboxCount; i++)
+    {
+        if (mailboxes[i].waiting && priorities[mailboxes[i].id] == priority)
+            depth++;
+    }
+    return depth;
+}
+
+bool UART::UseMailbox(uint8_t packet_id)
+{
+    if (mailboxIndexes[packet_id] != MAILBOX_COUNT)
+    {
+        return true;
+    }
+    if (mailboxCount == MAILBOX_COUNT)
+    {
+        Log(LOG_LEVEL::ERROR, "No mailbox left");
+        return false;
+    }
 
-    // Stuff the packet
-    uint8_t stuffedBuffer[MAX_PACKET_SIZE_STUFFED];
-    size_t stuffedBufferIndex = 0;
+    Mailbox &mailbox = mailboxes[mailboxCount];
+    mailbox.id = packet_id;
+    mailbox.waiting = false;
+    mailbox.stamp = 0;
+    mailbox.sentAt = totalBytesSent;
+    mailbox.superseded = 0;
+    mailboxIndexes[packet_id] = static_cast<uint8_t>(mailboxCount++);
+    return true;
+}
 
-    // 1. Copy the START_BYTE as is
-    stuffedBuffer[stuffedBufferIndex++] = packetBuffer[0]; // START_BYTE
+uint32_t UART::SupersededPackets(uint8_t packet_id) const
+{
+    const size_t index = mailboxIndexes[packet_id];
+    return index == MAILBOX_COUNT ? 0 : mailboxes[index].superseded;
+}
 
-    // 2. Stuff the middle portion (ID, length, payload, checksum)
-    for (size_t i = 1; i < packetBufferIndex - 1; i++) // Skip first and last bytes
+bool UART::SendToMailbox(Mailbox &mailbox, const PayloadView &payload)
+{
+    const Priority priority = priorities[mailbox.id];
+    TransmitStats &stats = transmitStats[static_cast<size_t>(priority)];
+    stats.packetsQueued++;
+    if (mailbox.waiting)
     {
-        if (packetBuffer[i] == START_BYTE || packetBuffer[i] == END_BYTE || packetBuffer[i] == ESCAPE_BYTE)
+        mailbox.superseded++;
+        stats.packetsSuperseded++;
+    }
+
+    // Straight into the send buffer when possible, like a CONTROL packet
+    mailbox.waiting = false;
+    mailbox.stamp = totalBytesSent;
+    const bool previousSent = static_cast<int32_t>(totalBytesSent - mailbox.sentAt) >= 0;
+    if (previousSent && QueueStampedPacket(mailbox.id, payload, mailbox.stamp, priority))
+    {
+        mailbox.sentAt = totalBytesSent + static_cast<uint32_t>(PendingSendBytes());
+        return true;
+    }
+
+    mailbox.payload.SetBytes(payload.GetBytes(), payload.GetSize());
+    mailbox.waiting = true;
+    stats.peakDepth = std::max(stats.peakDepth, QueueDepth(priority));
+    return true;
+}
+
+void UART::QueueMailboxes()
+{
+    for (size_t i = 0; i < mailboxCount; i++)
+    {
+        Mailbox &mailbox = mailboxes[i];
+        if (!mailbox.waiting || static_cast<int32_t>(totalBytesSent - mailbox.sentAt) < 0)
+            continue;
+
+        if (QueueStampedPacket(mailbox.id, mailbox.payload, mailbox.stamp, priorities[mailbox.id]))
         {
-            stuffedBuffer[stuffedBufferIndex++] = ESCAPE_BYTE;
-            stuffedBuffer[stuffedBufferIndex++] = packetBuffer[i] ^ ESCAPE_MASK;
+            mailbox.waiting = false;
+            mailbox.sentAt = totalBytesSent + static_cast<uint32_t>(PendingSendBytes());
         }
-        else
+    }
+}
+
+bool UART::SendUARTPacket(const uint8_t id, const PayloadView &payload)
+{
+    // The length field is a single byte
+    if (payload.GetSize() > UINT8_MAX)
+    {
+        Log(LOG_LEVEL::ERROR, "Payload too big to be sent");
+        return false;
+    }
+
+    if (!TryQueueUARTPacket(id, payload))
+    {
+        transmitStats[static_cast<size_t>(priorities[id])].packetsDropped++;
+        return false;
+    }
+    return true;
+}
+
+bool UART::TryQueueUARTPacket(const uint8_t id, const PayloadView &payload)
+{
+    if (mailboxIndexes[id] != MAILBOX_COUNT)
+    {
+        return SendToMailbox(mailboxes[mailboxIndexes[id]], payload);
+    }
+
+    const Priority priority = priorities[id];
+    TransmitStats &stats = transmitStats[static_cast<size_t>(priority)];
+    if (priority == Priority::CONTROL)
+    {
+        if (!QueueStampedPacket(id, payload, totalBytesSent, priority))
         {
-            stuffedBuffer[stuffedBufferIndex++] = packetBuffer[i];
+            return false;
         }
+        stats.packetsQueued++;
+        return true;
     }
 
-    // 3. Copy the END_BYTE as is
-    stuffedBuffer[stuffedBufferIndex++] = packetBuffer[packetBufferIndex - 1]; // END_BYTE
+    // Wait in the queue of the class until the send buffer is empty
+    TransmitQueue &queue = transmitQueues[static_cast<size_t>(priority) - 1];
+    if (!queue.Push(id, payload, totalBytesSent))
+    {
+        return false;
+    }
+    stats.packetsQueued++;
+    stats.peakDepth = std::max(stats.peakDepth, queue.Count());
+    return true;
+}
 
-    // Add the stuffed packet to the send buffer
-    if (AvailableSendBufferSpace() < stuffedBufferIndex)
+bool UART::QueueStampedPacket(const uint8_t id, const PayloadView &payload, uint32_t stamp, Priority priority)
+{
+    // The first byte of the packet is sent once the bytes already in the send buffer are
+    const uint32_t start = totalBytesSent + static_cast<uint32_t>(PendingSendBytes());
+    if (!QueuePacket(id, payload))
     {
         return false;
     }
 
-    for (size_t i = 0; i < stuffedBufferIndex; i++)
+    TransmitStats &stats = transmitStats[static_cast<size_t>(priority)];
+    const uint32_t latency = start - stamp;
+    stats.packetsSent++;
+    stats.totalLatency += latency;
+    stats.maxLatency = std::max(stats.maxLatency, latency);
+    return true;
+}
+
+bool UART::QueuePacket(const uint8_t id, const PayloadView &payload)
+{
+    if (framing == Framing::COBS)
     {
-        sendBuffer[sendBufferEnd] = stuffedBuffer[i];
-        sendBufferEnd = (sendBufferEnd + 1) % SEND_BUFFER_SIZE;
+        return QueueCobsPacket(id, payload);
     }
 
+    // Reserve room for the worst case, where every byte but the start and end bytes needs escaping
+    if (AvailableSendBufferSpace() < (payload.GetSize() + 2 + CheckSize()) * 2 + 2)
+    {
+        return false;
+    }
+
+    // Encode the packet straight into the send buffer
+    size_t index = sendBufferEnd;
+
+    // 1. Start byte
+    sendBuffer.Data()[index] = START_BYTE;
+    index = sendBuffer.Wrap(index + 1);
+
+    // 2. Packet ID and 3. Length
+    const uint8_t header[2] = {id, static_cast<uint8_t>(payload.GetSize())};
+    uint32_t check = StuffIntoSendBuffer(header, sizeof(header), index, InitialCheck());
+
+    // 4. Payload
+    check = StuffIntoSendBuffer(payload.GetBytes(), payload.GetSize(), index, check);
+
+    // 5. Checksum or CRC
+    uint8_t checkBytes[MAX_CHECK_SIZE];
+    StuffIntoSendBuffer(checkBytes, WriteCheck(check, checkBytes), index, check);
+
+    // 6. End byte
+    sendBuffer.Data()[index] = END_BYTE;
+    index = sendBuffer.Wrap(index + 1);
+
+    // Only commit the bytes we have actually used
+    sendBufferEnd = index;
     return true;
 }
 
-size_t UART::AvailableBytesToPeek() const
+bool UART::QueueCobsPacket(const uint8_t id, const PayloadView &payload)
 {
-    return (writeIndex - (readIndex + peekIndex) + RING_BUFFER_SIZE) % RING_BUFFER_SIZE;
+    // The ID, length and checksum are encoded along with the payload, and followed by the delimiter
+    size_t maxPacketSize = CobsMaxEncodedSize(payload.GetSize() + 2 + CheckSize()) + 1;
+    if (AvailableSendBufferSpace() < maxPacketSize)
+    {
+        return false;
+    }
+
+    const uint8_t header[2] = {id, static_cast<uint8_t>(payload.GetSize())};
+    uint32_t check = UpdateCheck(InitialCheck(), header, sizeof(header));
+    check = UpdateCheck(check, payload.GetBytes(), payload.GetSize());
+    uint8_t checkBytes[MAX_CHECK_SIZE];
+    size_t checkSize = WriteCheck(check, checkBytes);
+
+    // Encode straight into the send buffer, unless the packet may wrap around its end
+    uint8_t packet[MAX_PACKET_SIZE_COBS];
+    bool contiguous = sendBuffer.ContiguousSize(sendBufferEnd) >= maxPacketSize;
+    uint8_t *destination = contiguous ? sendBuffer.Data() + sendBufferEnd : packet;
+
+    CobsEncoder encoder(destination);
+    encoder.Write(header, sizeof(header));
+    encoder.Write(payload.GetBytes(), payload.GetSize());
+    encoder.Write(checkBytes, checkSize);
+    size_t packetSize = encoder.Finish();
+    destination[packetSize++] = COBS_DELIMITER;
+
+    if (!contiguous)
+    {
+        size_t firstPartSize = std::min(packetSize, sendBuffer.ContiguousSize(sendBufferEnd));
+        std::memcpy(sendBuffer.Data() + sendBufferEnd, packet, firstPartSize);
+        std::memcpy(sendBuffer.Data(), packet + firstPartSize, packetSize - firstPartSize);
+    }
+
+    sendBufferEnd = sendBuffer.Wrap(sendBufferEnd + packetSize);
+    return true;
 }
 
-uint8_t UART::Peek()
+uint32_t UART::StuffIntoSendBuffer(const uint8_t *data, size_t size, size_t &index, uint32_t check)
 {
-    uint8_t byte = circularBuffer[(readIndex + peekIndex) % RING_BUFFER_SIZE];
-    peekIndex = (peekIndex + 1) % RING_BUFFER_SIZE;
-    return byte;
+    while (size > 0)
+    {
+        // Stuff as many bytes as are sure to fit before the end of the buffer
+        size_t chunkSize = std::min(size, sendBuffer.ContiguousSize(index) / 2);
+        if (chunkSize > 0)
+        {
+            index = sendBuffer.Wrap(index + StuffBytes(data, chunkSize, sendBuffer.Data() + index));
+        }
+        else
+        {
+            // Less than two bytes left before the end of the buffer, an escape sequence may straddle it
+            chunkSize = 1;
+            uint8_t stuffed[2];
+            size_t stuffedSize = StuffBytesScalar(data, 1, stuffed);
+            for (size_t i = 0; i < stuffedSize; i++)
+            {
+                sendBuffer.Data()[index] = stuffed[i];
+                index = sendBuffer.Wrap(index + 1);
+            }
+        }
+
+        // Update the checksum while the data is still hot in the cache
+        check = UpdateCheck(check, data, chunkSize);
+        data += chunkSize;
+        size -= chunkSize;
+    }
+    return check;
 }
 
-void UART::AdvanceReadIndex(size_t amount)
+void UART::IngestBytes(const uint8_t *data, size_t size)
 {
-    readIndex = (readIndex + amount) % RING_BUFFER_SIZE;
+    if (framing == Framing::COBS)
+    {
+        IngestCobsBytes(data, size);
+        return;
+    }
+
+    size_t i = 0;
+    while (i < size)
+    {
+        if (decoderState == DecoderState::WAIT_START)
+        {
+            // Jump straight to the next start byte
+            const void *start = std::memchr(data + i, START_BYTE, size - i);
+            if (start == nullptr)
+                return;
+
+            i = static_cast<const uint8_t *>(start) - data + 1;
+            StartFrame();
+            continue;
+        }
+
+        // Unstuff the payload in bulk
+        if (decoderState == DecoderState::PAYLOAD)
+        {
+            size_t decoded = DecodePayloadRun(data + i, size - i);
+            i += decoded;
+            if (decoded > 0)
+                continue;
+        }
+
+        DecodeByte(data[i++]);
+    }
 }
 
-std::optional<uint8_t> UART::PeekUnstuff()
+size_t UART::DecodePayloadRun(const uint8_t *data, size_t size)
 {
-    if (AvailableBytesToPeek() < 1)
-        return std::nullopt;
+    size_t read = 0;
+    while (read < size && decoderState == DecoderState::PAYLOAD)
+    {
+        // Unstuff straight into the ring buffer, up to its end
+        uint8_t *destination = circularBuffer.Data() + frameWriteIndex;
+        size_t maxOutput = std::min<size_t>(frameLength - framePayloadIndex, circularBuffer.ContiguousSize(frameWriteIndex));
+        size_t consumed;
+        size_t written = UnstuffBytes(data + read, size - read, destination, maxOutput, escapePending, consumed);
+        if (consumed == 0)
+            break;
+
+        read += consumed;
+        frameCheck = UpdateCheck(frameCheck, destination, written);
+        frameWriteIndex = circularBuffer.Wrap(frameWriteIndex + written);
+        framePayloadIndex += written;
+        if (framePayloadIndex == frameLength)
+            decoderState = DecoderState::CHECKSUM;
+    }
+    return read;
+}
 
-    uint8_t byte = Peek();
+void UART::StartFrame()
+{
+    decoderState = DecoderState::ID;
+    escapePending = false;
+    frameCheck = InitialCheck();
+    frameReceivedCheck = 0;
+    frameCheckIndex = 0;
+    framePayloadIndex = 0;
+    cobsBlockRemaining = 0;
+    cobsZeroPending = false;
+    // Leave room for the ID and length in front of the payload
+    frameWriteIndex = circularBuffer.Wrap(writeIndex + 2);
+}
 
-    // Handle escape sequence
-    if (byte == ESCAPE_BYTE)
+void UART::DecodeByte(uint8_t byte)
+{
+    // An unescaped START_BYTE can only be the beginning of a new frame, so the current one is broken.
+    if (byte == START_BYTE)
+    {
+        StartFrame();
+        return;
+    }
+
+    // The end byte is not stuffed
+    if (decoderState == DecoderState::END)
+    {
+        if (byte == END_BYTE)
+            CommitFrame();
+        decoderState = DecoderState::WAIT_START;
+        return;
+    }
+
+    // An unescaped END_BYTE before the checksum means that the frame is truncated
+    if (byte == END_BYTE)
     {
-        if (AvailableBytesToPeek() < 1)
-            return std::nullopt;
+        decoderState = DecoderState::WAIT_START;
+        return;
+    }
 
-        byte = Peek() ^ ESCAPE_MASK;
+    // Handle escape sequence
+    if (escapePending)
+    {
+        byte ^= ESCAPE_MASK;
+        escapePending = false;
+    }
+    else if (byte == ESCAPE_BYTE)
+    {
+        escapePending = true;
+        return;
     }
 
-    return byte;
+    DecodeField(byte);
 }
 
-bool UART::DiscardCurrentByteAndContinue()
+void UART::IngestCobsBytes(const uint8_t *data, size_t size)
 {
-    AdvanceReadIndex(1);
-    return true;
+    size_t i = 0;
+    while (i < size)
+    {
+        if (decoderState == DecoderState::WAIT_START)
+        {
+            // Jump straight to the delimiter, the next frame starts right after it
+            const void *delimiter = std::memchr(data + i, COBS_DELIMITER, size - i);
+            if (delimiter == nullptr)
+                return;
+
+            i = static_cast<const uint8_t *>(delimiter) - data + 1;
+            StartFrame();
+            continue;
+        }
+
+        // Copy the payload bytes of the current block in bulk
+        if (decoderState == DecoderState::PAYLOAD && cobsBlockRemaining > 0)
+        {
+            size_t decoded = DecodeCobsPayloadRun(data + i, size - i);
+            i += decoded;
+            if (decoded > 0)
+                continue;
+        }
+
+        DecodeCobsByte(data[i++]);
+    }
 }
 
-bool UART::TryParsePacket()
+size_t UART::DecodeCobsPayloadRun(const uint8_t *data, size_t size)
 {
-    peekIndex = 0;
+    // Copy straight into the ring buffer, up to its end, stopping at a delimiter
+    uint8_t *destination = circularBuffer.Data() + frameWriteIndex;
+    size_t maxOutput = std::min({size, cobsBlockRemaining, static_cast<size_t>(frameLength - framePayloadIndex),
+                                 circularBuffer.ContiguousSize(frameWriteIndex)});
+    size_t written = CopyUntilZero(data, maxOutput, destination);
+
+    frameCheck = UpdateCheck(frameCheck, destination, written);
+    frameWriteIndex = circularBuffer.Wrap(frameWriteIndex + written);
+    framePayloadIndex += written;
+    cobsBlockRemaining -= written;
+    if (framePayloadIndex == frameLength)
+        decoderState = DecoderState::CHECKSUM;
+    return written;
+}
 
-    uint8_t packetBuffer[MAX_PACKET_SIZE_UNSTUFFED];
-    size_t packetBufferIndex = 0;
+void UART::DecodeCobsByte(uint8_t byte)
+{
+    // The delimiter ends the frame, which is only complete if its last block is
+    if (byte == COBS_DELIMITER)
+    {
+        if (decoderState == DecoderState::END && cobsBlockRemaining == 0)
+            CommitFrame();
+        StartFrame();
+        return;
+    }
 
-    // 1. Read start byte
-    if (AvailableBytesToPeek() < 1)
-        return false;
+    if (cobsBlockRemaining > 0)
+    {
+        cobsBlockRemaining--;
+        DecodeField(byte);
+        return;
+    }
 
-    uint8_t start = Peek();
-    if (start != START_BYTE)
-        return DiscardCurrentByteAndContinue();
+    // A code byte starts a new block, and the previous block ends with a zero unless it was a full one
+    bool zeroPending = cobsZeroPending;
+    cobsBlockRemaining = byte - 1;
+    cobsZeroPending = (byte != 0xFF);
+    if (zeroPending)
+        DecodeField(0);
+}
 
-    packetBuffer[packetBufferIndex++] = start;
+void UART::DecodeField(uint8_t byte)
+{
+    switch (decoderState)
+    {
+    case DecoderState::ID:
+        // Check if ID is valid
+        if (!handlers[byte])
+        {
+            Log(LOG_LEVEL::WARNING, "Invalid packet ID received");
+            decoderState = DecoderState::WAIT_START;
+            return;
+        }
+        frameId = byte;
+        frameCheck = UpdateCheck(frameCheck, &byte, 1);
+        decoderState = DecoderState::LENGTH;
+        break;
+
+    case DecoderState::LENGTH:
+        // Check if length is valid
+        if (byte > maxPayloadSizes[frameId])
+        {
+            Log(LOG_LEVEL::WARNING, "Invalid packet length received");
+            decoderState = DecoderState::WAIT_START;
+            return;
+        }
+        frameLength = byte;
+        frameCheck = UpdateCheck(frameCheck, &byte, 1);
+        decoderState = (frameLength > 0) ? DecoderState::PAYLOAD : DecoderState::CHECKSUM;
+        break;
+
+    case DecoderState::PAYLOAD:
+        circularBuffer.Data()[frameWriteIndex] = byte;
+        frameWriteIndex = circularBuffer.Wrap(frameWriteIndex + 1);
+        frameCheck = UpdateCheck(frameCheck, &byte, 1);
+        if (++framePayloadIndex == frameLength)
+            decoderState = DecoderState::CHECKSUM;
+        break;
+
+    case DecoderState::CHECKSUM:
+        // The checksum or CRC is sent least significant byte first
+        frameReceivedCheck |= static_cast<uint32_t>(byte) << (8 * frameCheckIndex);
+        if (++frameCheckIndex < CheckSize())
+            break;
+
+        // Verify checksum (excluding start byte)
+        if (frameCheck != frameReceivedCheck)
+        {
+            Log(LOG_LEVEL::WARNING, "Invalid checksum received");
+            decoderState = DecoderState::WAIT_START;
+            return;
+        }
+        decoderState = DecoderState::END;
+        break;
 
-    // 2. Read packet ID
-    auto maybeId = PeekUnstuff();
-    if (!maybeId.has_value())
-        return false;
+    default:
+        decoderState = DecoderState::WAIT_START;
+        break;
+    }
+}
 
-    uint8_t id = maybeId.value();
+void UART::CommitFrame()
+{
+    circularBuffer.Data()[writeIndex] = frameId;
+    circularBuffer.Data()[circularBuffer.Wrap(writeIndex + 1)] = frameLength;
+    writeIndex = frameWriteIndex;
+}
 
-    // Check if ID is valid
-    if (handlers.find(id) == handlers.end())
+void UART::DispatchFrames(PacketSink sink, void *context)
+{
+    while (readIndex != writeIndex)
     {
-        Log(LOG_LEVEL::WARNING, "Invalid packet ID received");
-        return DiscardCurrentByteAndContinue();
+        uint8_t id = circularBuffer.Data()[readIndex];
+        uint8_t length = circularBuffer.Data()[circularBuffer.Wrap(readIndex + 1)];
+        size_t payloadIndex = circularBuffer.Wrap(readIndex + 2);
+
+        // Hand the payload over in place. It can only wrap around the end of the ring buffer if it is not mirrored,
+        // then it is gathered on the stack.
+        const uint8_t *bytes = circularBuffer.Data() + payloadIndex;
+        uint8_t wrapped[UINT8_MAX];
+        size_t firstPartSize = std::min<size_t>(length, circularBuffer.ContiguousSize(payloadIndex));
+        if (firstPartSize < length)
+        {
+            std::memcpy(wrapped, bytes, firstPartSize);
+            std::memcpy(wrapped + firstPartSize, circularBuffer.Data(), length - firstPartSize);
+            bytes = wrapped;
+        }
+        PayloadView payload(bytes, length);
+        if (sink == nullptr)
+        {
+            handlers[id](payload);
+        }
+        else
+        {
+            sink(context, id, payload);
+        }
+
+        // Only release the bytes once the handler is done with them
+        readIndex = circularBuffer.Wrap(payloadIndex + length);
+        packetsRead++;
     }
+}
 
-    packetBuffer[packetBufferIndex++] = id;
+size_t UART::ReceiveSegments(uint8_t *first, size_t firstSize, uint8_t *second, size_t secondSize)
+{
+    size_t bytesReceived = Receive(first, firstSize);
+    if (bytesReceived == firstSize && secondSize > 0)
+    {
+        bytesReceived += Receive(second, secondSize);
+    }
+    return bytesReceived;
+}
 
-    // 3. Read length
-    auto maybeLength = PeekUnstuff();
-    if (!maybeLength.has_value())
+bool UART::SendFrame(const uint8_t id, FrameRef frame)
+{
+    if (!frame)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot send an empty frame");
         return false;
+    }
 
-    uint8_t length = maybeLength.value();
+    // Only CONTROL frames keep their place in the pending frames, the others are copied into their queue or mailbox
+    if (priorities[id] != Priority::CONTROL || mailboxIndexes[id] != MAILBOX_COUNT)
+    {
+        return SendUARTPacket(id, frame.GetView());
+    }
 
-    // Check if length is valid
-    if (length > MAX_PAYLOAD_SIZE)
+    TransmitStats &stats = transmitStats[static_cast<size_t>(Priority::CONTROL)];
+    if (pendingFramesCount == FramePool::SIZE)
     {
-        Log(LOG_LEVEL::WARNING, "Invalid packet length received");
-        return DiscardCurrentByteAndContinue();
+        stats.packetsDropped++;
+        return false;
     }
 
-    packetBuffer[packetBufferIndex++] = length;
+    PendingFrame &pending = pendingFrames[(pendingFramesStart + pendingFramesCount) % FramePool::SIZE];
+    pending.id = id;
+    pending.frame = std::move(frame);
+    pending.stamp = totalBytesSent;
+    pendingFramesCount++;
+    stats.packetsQueued++;
+    stats.peakDepth = std::max(stats.peakDepth, pendingFramesCount);
+
+    QueuePendingFrames();
+    return true;
+}
 
-    // 4. Read payload
-    for (size_t i = 0; i < length; i++)
+void UART::QueuePendingFrames()
+{
+    while (pendingFramesCount > 0)
     {
-        auto maybeByte = PeekUnstuff();
-        if (!maybeByte.has_value())
-            return false;
-        packetBuffer[packetBufferIndex++] = maybeByte.value();
+        PendingFrame &pending = pendingFrames[pendingFramesStart];
+        if (!QueueStampedPacket(pending.id, pending.frame.GetView(), pending.stamp, Priority::CONTROL))
+        {
+            // No room left, try again once some bytes have been sent
+            break;
+        }
+
+        pending.frame.Reset();
+        pendingFramesStart = (pendingFramesStart + 1) % FramePool::SIZE;
+        pendingFramesCount--;
     }
+}
 
-    // 5. Read checksum
-    auto maybeChecksum = PeekUnstuff();
-    if (!maybeChecksum.has_value())
-        return false;
+void UART::QueueLowerPriorityPacket()
+{
+    // A CONTROL packet queued from now on waits for at most this packet.
+    // The mailboxes are encoded before, as soon as their previous packet is sent, so none is waiting here.
+    if (sendBufferStart != sendBufferEnd || pendingFramesCount > 0 ||
+        (transmitQueues[0].Empty() && transmitQueues[1].Empty()))
+    {
+        return;
+    }
+
+    // Deficit round robin: each visit to a queue adds its weight times the biggest packet to its deficit, and its
+    // packets are sent while they fit in the deficit, so every visit sends at least one packet.
+    constexpr uint32_t QUANTUM = UINT8_MAX + 2;
+    while (true)
+    {
+        TransmitQueue &queue = transmitQueues[roundRobinIndex];
+        if (queue.Empty())
+        {
+            deficits[roundRobinIndex] = 0;
+        }
+        else
+        {
+            const PayloadView payload = queue.FrontPayload();
+            const uint32_t size = static_cast<uint32_t>(payload.GetSize()) + 2;
+            if (size <= deficits[roundRobinIndex])
+            {
+                // The send buffer is empty, so the packet fits
+                QueueStampedPacket(queue.FrontId(), payload, queue.FrontStamp(),
+                                   static_cast<Priority>(roundRobinIndex + 1));
+                queue.Pop();
+                deficits[roundRobinIndex] = queue.Empty() ? 0 : deficits[roundRobinIndex] - size;
+                return;
+            }
+        }
 
-    uint8_t checksum = maybeChecksum.value();
+        roundRobinIndex = (roundRobinIndex + 1) % (PRIORITY_COUNT - 1);
+        deficits[roundRobinIndex] += weights[roundRobinIndex] * QUANTUM;
+    }
+}
 
-    // Verify checksum (excluding start byte)
-    if (ComputeChecksum(packetBuffer + 1, packetBufferIndex - 1) != checksum)
+size_t UART::QueuedPacketBytes() const
+{
+    size_t bytes = 0;
+    for (const TransmitQueue &queue : transmitQueues)
     {
-        Log(LOG_LEVEL::WARNING, "Invalid checksum received");
-        // std::cout << "received: " << std::hex << std::setfill('0') << std::setw(2) << (int)checksum << std::endl;
-        // std::cout << "computed: " << std::hex << std::setfill('0') << std::setw(2) << (int)ComputeChecksum(packetBuffer + 1, packetBufferIndex - 1) << std::endl;
-        // std::cout << std::dec;
-        return DiscardCurrentByteAndContinue();
+        bytes += queue.Bytes();
     }
+    for (size_t i = 0; i < mailboxCount; i++)
+    {
+        if (mailboxes[i].waiting)
+            bytes += mailboxes[i].payload.GetSize() + 2;
+    }
+    return bytes;
+}
 
-    packetBuffer[packetBufferIndex++] = checksum;
+size_t UART::PendingSendFrames() const
+{
+    return pendingFramesCount;
+}
 
-    // 6. Read end byte
-    if (AvailableBytesToPeek() < 1)
-        return false;
+FramePool &UART::GetFramePool()
+{
+    return framePool;
+}
 
-    uint8_t end = Peek();
-    if (end != END_BYTE)
-        return DiscardCurrentByteAndContinue();
+size_t UART::SendUARTPackets(size_t maxBytes)
+{
+    QueueMailboxes();
+    QueuePendingFrames();
+    QueueLowerPriorityPacket();
 
-    packetBuffer[packetBufferIndex++] = end;
+    // Keep sending until the device stops accepting data or the budget is spent
+    while (sendBufferStart != sendBufferEnd && maxBytes > 0)
+    {
+        // The queued bytes are at most two contiguous segments, hand both to the device at once
+        size_t bytesToSend = std::min(PendingSendBytes(), maxBytes);
+        size_t firstSegmentSize = std::min(bytesToSend, sendBuffer.ContiguousSize(sendBufferStart));
+        size_t bytesSent = SendSegments(sendBuffer.Data() + sendBufferStart, firstSegmentSize, sendBuffer.Data(),
+                                        bytesToSend - firstSegmentSize);
+
+        sendBufferStart = sendBuffer.Wrap(sendBufferStart + bytesSent);
+        maxBytes -= bytesSent;
+        totalBytesSent += static_cast<uint32_t>(bytesSent);
+        QueueMailboxes();
+        QueuePendingFrames();
+        QueueLowerPriorityPacket();
+
+        // The device is full, try again later
+        if (bytesSent == 0)
+            break;
+    }
+
+    return PendingSendBytes() + QueuedPacketBytes();
+}
 
-    // 7. Process valid packet
-    Payload payload;
-    if (!payload.SetBytes(packetBuffer + 3, packetBufferIndex - 5)) // Exclude start, id, length, checksum, end
+size_t UART::SendSegments(const uint8_t *first, size_t firstSize, const uint8_t *second, size_t secondSize)
+{
+    size_t bytesSent = Send(first, firstSize);
+    if (bytesSent == firstSize && secondSize > 0)
     {
-        Log(LOG_LEVEL::ERROR, "Failed to initialize payload, size exceeds limit.");
-        return DiscardCurrentByteAndContinue();
+        bytesSent += Send(second, secondSize);
     }
-    auto handler = handlers.find(id);
-    handler->second(payload);
+    return bytesSent;
+}
 
-    // Advance past this packet
-    AdvanceReadIndex(peekIndex);
-    packetsRead++;
+bool UART::UseMirroredBuffers()
+{
+    // The buffers lose their content, so only switch while nothing is pending. The decoder is idle in WAIT_START, or
+    // with COBS, in ID before the first code byte of a frame.
+    const bool decoderIdle = (framing == Framing::COBS)
+                                 ? decoderState == DecoderState::ID && cobsBlockRemaining == 0 && !cobsZeroPending
+                                 : decoderState == DecoderState::WAIT_START;
+    if (!decoderIdle || readIndex != writeIndex || sendBufferStart != sendBufferEnd)
+    {
+        Log(LOG_LEVEL::ERROR, "Cannot mirror the ring buffers while they are in use");
+        return false;
+    }
+
+    if (!circularBuffer.Mirror() || !sendBuffer.Mirror())
+    {
+        Log(LOG_LEVEL::WARNING, "Mirrored ring buffers are not supported, using the default ones");
+        return false;
+    }
+
+    readIndex = writeIndex = 0;
+    sendBufferStart = sendBufferEnd = 0;
+    ResetDecoder();
     return true;
 }
 
-void UART::SendUARTPackets()
+size_t UART::PendingSendBytes() const
 {
-    // Send data from the send buffer
-    if (sendBufferStart != sendBufferEnd)
+    return sendBuffer.Wrap(sendBufferEnd - sendBufferStart);
+}
+
+size_t UART::AvailableSendBufferSpace() const
+{
+    // Up to SEND_BUFFER_SIZE bytes, even if mirroring made the buffer bigger, so that no more bytes wait in front of
+    // a new packet
+    return sendBuffer.Capacity() - PendingSendBytes() - 1;
+}
+
+size_t UART::MinimumBytesToNextPacket() const
+{
+    // Each field byte takes at least one byte on the wire, and the frame ends with END_BYTE or COBS_DELIMITER.
+    // The START_BYTE, or the delimiter before a COBS frame, is only missing while waiting for a new frame.
+    const size_t checkSize = CheckSize();
+    const size_t smallestFrame = 1 + 2 + checkSize + 1;
+    switch (decoderState)
     {
-        size_t bytesToSend = (sendBufferEnd >= sendBufferStart) ? (sendBufferEnd - sendBufferStart) : (SEND_BUFFER_SIZE - sendBufferStart);
-        // std::cout << "Sending " << bytesToSend << " bytes" << std::endl;
-        size_t bytesSent = Send(sendBuffer + sendBufferStart, bytesToSend);
+    case DecoderState::ID:
+        return 2 + checkSize + 1;
+    case DecoderState::LENGTH:
+        return 1 + checkSize + 1;
+    case DecoderState::PAYLOAD:
+        // A START_BYTE or COBS_DELIMITER drops the frame, after a corrupted length for instance, and the smallest
+        // frame can then complete before the rest of this one. The other states have less left than that.
+        return std::min((frameLength - framePayloadIndex) + checkSize + 1, smallestFrame);
+    case DecoderState::CHECKSUM:
+        return (checkSize - frameCheckIndex) + 1;
+    case DecoderState::END:
+        return 1;
+    default:
+        return smallestFrame;
+    }
+}
 
-        sendBufferStart = (sendBufferStart + bytesSent) % SEND_BUFFER_SIZE;
+size_t UART::CheckSize() const
+{
+    switch (integrity)
+    {
+    case Integrity::CRC16:
+        return 2;
+    case Integrity::CRC32C:
+        return 4;
+    default:
+        return 1;
     }
 }
 
-size_t UART::AvailableSendBufferSpace() const
+uint32_t UART::InitialCheck() const
+{
+    return (integrity == Integrity::CRC16) ? 0xFFFF : 0;
+}
+
+uint32_t UART::UpdateCheck(uint32_t check, const uint8_t *data, size_t size) const
 {
-    if (sendBufferEnd >= sendBufferStart)
+    switch (integrity)
     {
-        return SEND_BUFFER_SIZE - (sendBufferEnd - sendBufferStart) - 1;
+    case Integrity::CRC16:
+        return Crc16Ccitt(data, size, check);
+    case Integrity::CRC32C:
+        return Crc32c(data, size, check);
+    default:
+        return static_cast<uint8_t>(check + ComputeChecksum(data, size));
     }
-    else
+}
+
+size_t UART::WriteCheck(uint32_t check, uint8_t *bytes) const
+{
+    size_t size = CheckSize();
+    for (size_t i = 0; i < size; i++)
     {
-        return sendBufferStart - sendBufferEnd - 1;
+        bytes[i] = static_cast<uint8_t>(check >> (8 * i));
     }
+    return size;
 }
 
-uint8_t UART::ComputeChecksum(const uint8_t *data, size_t data_size)
+uint8_t UART::ComputeChecksum(const uint8_t *data, size_t data_size) const
 {
     uint8_t checksum = 0;
     for (size_t i = 0; i < data_size; ++i)
@@ -268,33 +939,38 @@ uint8_t UART::ComputeChecksum(const uint8_t *data, size_t data_size)
 }
 
 int UART::ReceiveUARTPackets()
+{
+    return DeframeUARTPackets(nullptr, nullptr);
+}
+
+int UART::DeframeUARTPackets(PacketSink sink, void *context)
 {
     // Log(LOG_LEVEL::DEBUG, "Receiving UART packets");
 
     packetsRead = 0;
 
-    // Receive new data into circular buffer
-    uint8_t tempBuffer[RECEIVE_BUFFER_SIZE];
-    size_t bytesReceived = Receive(tempBuffer, RECEIVE_BUFFER_SIZE);
-
-    // Check if we might have filled the receive buffer completely
-    if (bytesReceived == RECEIVE_BUFFER_SIZE)
+    // Receive new data straight into the free space of the ring buffer, right after the frame being decoded.
+    // The bytes are then unstuffed in place, which is safe since unstuffing never makes data longer.
+    size_t ingestIndex = (decoderState == DecoderState::WAIT_START) ? writeIndex : frameWriteIndex;
+    // With a mirrored ring buffer, the free space is always a single segment.
+    size_t freeSpace = circularBuffer.Wrap(readIndex - ingestIndex - 1);
+    size_t firstSegmentSize = std::min(freeSpace, circularBuffer.ContiguousSize(ingestIndex));
+    size_t bytesReceived = ReceiveSegments(circularBuffer.Data() + ingestIndex, firstSegmentSize,
+                                           circularBuffer.Data(), freeSpace - firstSegmentSize);
+
+    // Check if we have filled the ring buffer completely, the rest of the data waits in the UART device
+    if (bytesReceived == freeSpace)
     {
-        Log(LOG_LEVEL::WARNING, "Receive buffer filled completely, might have lost data");
+        Log(LOG_LEVEL::WARNING, "Receive ring buffer filled completely");
     }
 
-    // Copy received data to circular buffer
-    // We cannot unstuff bytes here, because it would cause errors if an ESCAPE_BYTE appears at the end of the buffer :(
-    for (size_t i = 0; i < bytesReceived; i++)
-    {
-        circularBuffer[writeIndex] = tempBuffer[i];
-        writeIndex = (writeIndex + 1) % RING_BUFFER_SIZE;
-    }
+    // Unstuff and frame the received bytes.
+    // The decoder keeps any partial frame, and a pending ESCAPE_BYTE, for the next call.
+    size_t firstSegmentReceived = std::min(bytesReceived, firstSegmentSize);
+    IngestBytes(circularBuffer.Data() + ingestIndex, firstSegmentReceived);
+    IngestBytes(circularBuffer.Data(), bytesReceived - firstSegmentReceived);
 
-    // Try to parse packets until no more can be parsed
-    while (TryParsePacket())
-    {
-    }
+    DispatchFrames(sink, context);
 
     return packetsRead;
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef FAKE_UART_H
+#define FAKE_UART_H
+
+#include "UART.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Fake UART class for testing
+class FakeUART : public UART
+{
+  public:
+    FakeUART() : UART() {}
+
+    bool Begin() override
+    {
+        return true;
+    }
+
+    using UART::UseMirroredBuffers;
+    using UART::MinimumBytesToNextPacket;
+
+    uint8_t send_buffer[1024];
+    size_t send_buffer_size = 0;
+    std::vector<uint8_t> sent_bytes; // Everything sent so far
+    size_t send_limit = SIZE_MAX;    // Maximum number of bytes accepted by each call to Send()
+    size_t send_capacity = SIZE_MAX; // Number of bytes accepted before the device is full
+    size_t Send(const uint8_t *data, const size_t data_size) override
+    {
+        if (data_size > sizeof(send_buffer))
+        {
+            throw std::runtime_error("Packet too big for send buffer");
+        }
+        size_t size = std::min({data_size, send_limit, send_capacity});
+        std::memcpy(send_buffer, data, size);
+        send_buffer_size = size;
+        sent_bytes.insert(sent_bytes.end(), data, data + size);
+        if (send_capacity != SIZE_MAX)
+        {
+            send_capacity -= size;
+        }
+        return size;
+    }
+
+    uint8_t receive_buffer[1024];
+    size_t receive_buffer_size = 0;
+    size_t Receive(uint8_t *data, const size_t data_size) override
+    {
+        // Hand out as much as fits, and keep the rest for the next read
+        size_t size = std::min(receive_buffer_size, data_size);
+        std::memcpy(data, receive_buffer, size);
+        std::memmove(receive_buffer, receive_buffer + size, receive_buffer_size - size);
+        receive_buffer_size -= size;
+        return size;
+    }
+
+    std::string log_message;
+    void Log(LOG_LEVEL level, std::string message) override
+    {
+        // std::cout << message << std::endl;
+        log_message = message;
+    }
+};
+
+#endif // FAKE_UART_H
@@ -0,0 +1,64 @@
+#ifndef PTY_PAIR_H
+#define PTY_PAIR_H
+
+#include "CM4UART.h"
+#include <cstdlib> // For posix_openpt, grantpt, unlockpt, ptsname
+#include <fcntl.h> // For fcntl, O_RDWR, O_NOCTTY, O_NONBLOCK
+#include <stdexcept>
+#include <string>
+#include <termios.h> // For B115200
+#include <unistd.h>  // For close
+
+// Pseudo-terminal standing in for the serial device of a CM4UART: CM4UART opens SlavePath() like /dev/ttyAMA0,
+// and the test plays the other end of the link on MasterFd(), which does not block.
+class PtyPair
+{
+  public:
+    PtyPair()
+    {
+        masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0 ||
+            fcntl(masterFd, F_SETFL, O_NONBLOCK) != 0)
+        {
+            throw std::runtime_error("Failed to open a pty");
+        }
+        slavePath = ptsname(masterFd);
+    }
+
+    ~PtyPair()
+    {
+        close(masterFd);
+    }
+
+    PtyPair(const PtyPair &) = delete;
+    PtyPair &operator=(const PtyPair &) = delete;
+
+    int MasterFd() const
+    {
+        return masterFd;
+    }
+
+    const char *SlavePath() const
+    {
+        return slavePath.c_str();
+    }
+
+  private:
+    int masterFd;
+    std::string slavePath;
+};
+
+// CM4UART without a logger
+class QuietCM4UART : public CM4UART
+{
+  public:
+    explicit QuietCM4UART(const char *device) : CM4UART(B115200, device, nullptr)
+    {
+    }
+
+    void Log(LOG_LEVEL level, std::string message) override
+    {
+    }
+};
+
+#endif // PTY_PAIR_H
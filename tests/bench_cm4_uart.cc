@@ -0,0 +1,266 @@
+#include "catch.hpp"
+#include "FakeUART.h"
+#include "PtyPair.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <ctime> // For clock_gettime
+#include <functional>
+#include <thread>
+#include <unistd.h> // For read, write
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Percentiles of durations, in microseconds
+void PrintPercentiles(const char *name, std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+    std::cout << "  " << name << ": median " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, max "
+              << samples.back() << " us" << std::endl;
+}
+
+// CPU time used by the calling thread, or by the whole process, in seconds
+double CpuTime(clockid_t clock)
+{
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+double Now()
+{
+    return std::chrono::duration<double, std::micro>(Clock::now().time_since_epoch()).count();
+}
+
+// Plays the Teensy on the other end of the pty: sends a ControlOutputPacket every 200 us and reads everything
+class PtyPeer
+{
+  public:
+    explicit PtyPeer(int fd) : fd(fd), running(true)
+    {
+        FakeUART encoder;
+        encoder.SendPacket(ControlOutputPacket{1.0, 2.0, 3.0, 0.5, 0.1});
+        encoder.SendUARTPackets();
+        frame = encoder.sent_bytes;
+        thread = std::thread([this]() { Run(); });
+    }
+
+    ~PtyPeer()
+    {
+        running = false;
+        thread.join();
+    }
+
+  private:
+    int fd;
+    std::atomic<bool> running;
+    std::vector<uint8_t> frame;
+    std::thread thread;
+
+    void Run()
+    {
+        uint8_t buffer[4096];
+        auto next = Clock::now();
+        while (running)
+        {
+            if (write(fd, frame.data(), frame.size()) < 0)
+            {
+                // The pty is full, the frame is lost like on a busy link
+            }
+            while (read(fd, buffer, sizeof(buffer)) > 0)
+            {
+            }
+            next += std::chrono::microseconds(200);
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
+} // namespace
+
+TEST_CASE("Benchmark control loop jitter on a pty", "[benchmark]")
+{
+    const int ticks = 2000;
+    const auto period = std::chrono::milliseconds(1);
+
+    ControlInputPacket input{};
+    input.armed = true;
+
+    for (bool threaded : {false, true})
+    {
+        PtyPair pty;
+        QuietCM4UART uart(pty.SlavePath());
+        REQUIRE(uart.Begin());
+        int packetsReceived = 0;
+        uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &) { packetsReceived++; });
+        if (threaded)
+        {
+            REQUIRE(uart.StartIOThread());
+        }
+        PtyPeer peer(pty.MasterFd());
+
+        // Time spent in the UART calls of each tick, and how late each tick started
+        std::vector<double> ioTimes;
+        std::vector<double> lateness;
+        auto next = Clock::now() + period;
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            std::this_thread::sleep_until(next);
+            const auto start = Clock::now();
+            uart.ReceiveUARTPackets();
+            input.timestamp = tick;
+            uart.SendPacket(input);
+            uart.SendUARTPackets();
+            const auto end = Clock::now();
+
+            ioTimes.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            lateness.push_back(std::chrono::duration<double, std::micro>(start - next).count());
+            next += period;
+        }
+        uart.StopIOThread();
+
+        std::cout << (threaded ? "I/O thread" : "inline I/O") << ", " << ticks << " ticks of 1 ms, "
+                  << packetsReceived << " packets received:" << std::endl;
+        PrintPercentiles("UART calls per tick", ioTimes);
+        PrintPercentiles("tick start lateness", lateness);
+    }
+}
+
+TEST_CASE("Benchmark waiting for packets on a pty", "[benchmark]")
+{
+    const int packets = 1000;
+
+    struct Mode
+    {
+        const char *name;
+        bool threaded;
+        std::function<void(QuietCM4UART &)> receive;
+    };
+    const Mode modes[] = {
+        {"WaitForPackets", false, [](QuietCM4UART &uart) { uart.WaitForPackets(100000); }},
+        {"WaitForPackets, I/O thread", true, [](QuietCM4UART &uart) { uart.WaitForPackets(100000); }},
+        {"busy polling", false, [](QuietCM4UART &uart) { uart.ReceiveUARTPackets(); }},
+        {"polling every 100 us", false,
+         [](QuietCM4UART &uart) {
+             uart.ReceiveUARTPackets();
+             std::this_thread::sleep_for(std::chrono::microseconds(100));
+         }},
+    };
+
+    for (const Mode &mode : modes)
+    {
+        PtyPair pty;
+        QuietCM4UART uart(pty.SlavePath());
+        REQUIRE(uart.Begin());
+        // Time from writing the end of a frame to its handler, in microseconds
+        std::vector<double> latencies;
+        std::atomic<double> frameEndTime(0);
+        uart.On<PacketId::ControlOutput>(
+            [&](const ControlOutputPacket &) { latencies.push_back(Now() - frameEndTime.load()); });
+        if (mode.threaded)
+        {
+            REQUIRE(uart.StartIOThread());
+        }
+
+        // A frame every millisecond, in two halves 100 us apart like on a slow link
+        double peerCpuTime = 0;
+        std::thread peer([&]() {
+            auto next = Clock::now();
+            for (int i = 0; i < packets; i++)
+            {
+                next += std::chrono::milliseconds(1);
+                std::this_thread::sleep_until(next);
+                FakeUART encoder;
+                encoder.SendPacket(ControlOutputPacket{static_cast<double>(i), 0, 0, 0, 0});
+                encoder.SendUARTPackets();
+                const std::vector<uint8_t> &frame = encoder.sent_bytes;
+                const size_t half = frame.size() / 2;
+                if (write(pty.MasterFd(), frame.data(), half) < 0)
+                    break;
+                std::this_thread::sleep_until(next + std::chrono::microseconds(100));
+                frameEndTime = Now();
+                if (write(pty.MasterFd(), frame.data() + half, frame.size() - half) < 0)
+                    break;
+            }
+            peerCpuTime = CpuTime(CLOCK_THREAD_CPUTIME_ID);
+        });
+
+        const double cpuStart = CpuTime(CLOCK_PROCESS_CPUTIME_ID);
+        const auto start = Clock::now();
+        while (latencies.size() < static_cast<size_t>(packets) && Clock::now() - start < std::chrono::seconds(5))
+        {
+            mode.receive(uart);
+        }
+        const double wallTime = std::chrono::duration<double>(Clock::now() - start).count();
+        peer.join();
+        const double cpuTime = CpuTime(CLOCK_PROCESS_CPUTIME_ID) - cpuStart - peerCpuTime;
+        uart.StopIOThread();
+
+        std::cout << mode.name << ", " << latencies.size() << " packets, CPU " << 100 * cpuTime / wallTime
+                  << "% of a core:" << std::endl;
+        PrintPercentiles("wakeup latency", latencies);
+    }
+}
+
+TEST_CASE("Benchmark io_uring on a pty", "[benchmark]")
+{
+    const int ticks = 2000;
+    const auto period = std::chrono::milliseconds(1);
+
+    ControlInputPacket input{};
+    input.armed = true;
+
+    struct Transport
+    {
+        const char *name;
+        bool uring;
+        bool kernelPolling;
+    };
+    const Transport transports[] = {
+        {"read() and write()", false, false},
+        {"io_uring", true, false},
+        {"io_uring, kernel polling", true, true},
+    };
+
+    for (const Transport &transport : transports)
+    {
+        PtyPair pty;
+        QuietCM4UART uart(pty.SlavePath());
+        REQUIRE(uart.Begin());
+        int packetsReceived = 0;
+        uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &) { packetsReceived++; });
+        if (transport.uring && !uart.UseIoUring(transport.kernelPolling))
+        {
+            WARN("io_uring is not available, skipping " << transport.name);
+            continue;
+        }
+        PtyPeer peer(pty.MasterFd());
+
+        // Same control loop as above, counting the system calls of the UART calls
+        std::vector<double> ioTimes;
+        const uint32_t systemCallsStart = uart.SystemCalls();
+        auto next = Clock::now() + period;
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            std::this_thread::sleep_until(next);
+            const auto start = Clock::now();
+            uart.ReceiveUARTPackets();
+            input.timestamp = tick;
+            uart.SendPacket(input);
+            uart.SendUARTPackets();
+            ioTimes.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            next += period;
+        }
+        const uint32_t systemCalls = uart.SystemCalls() - systemCallsStart;
+
+        std::cout << transport.name << ", " << ticks << " ticks of 1 ms, " << packetsReceived
+                  << " packets received, " << static_cast<double>(systemCalls) / ticks << " system calls per tick, "
+                  << static_cast<double>(systemCalls) / std::max(packetsReceived, 1) << " per packet received:"
+                  << std::endl;
+        PrintPercentiles("UART calls per tick", ioTimes);
+    }
+}
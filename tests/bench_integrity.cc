@@ -0,0 +1,137 @@
+#include "catch.hpp"
+#include "Crc.h"
+#include "FakeUART.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST_CASE("Benchmark CRC kernels", "[benchmark]")
+{
+    for (size_t size : {40, 211, 4096})
+    {
+        std::mt19937 rng(42);
+        std::vector<uint8_t> data(size);
+        for (auto &b : data)
+            b = rng();
+
+        BENCHMARK("8-bit checksum, " + std::to_string(size) + " bytes")
+        {
+            uint8_t checksum = 0;
+            for (uint8_t b : data)
+                checksum += b;
+            return checksum;
+        };
+
+        BENCHMARK("CRC-16/CCITT, one byte at a time, " + std::to_string(size) + " bytes")
+        {
+            return Crc16CcittScalar(data.data(), data.size());
+        };
+
+        BENCHMARK("CRC-16/CCITT, slice-by-8, " + std::to_string(size) + " bytes")
+        {
+            return Crc16Ccitt(data.data(), data.size());
+        };
+
+        BENCHMARK("CRC-32C, one byte at a time, " + std::to_string(size) + " bytes")
+        {
+            return Crc32cScalar(data.data(), data.size());
+        };
+
+        BENCHMARK("CRC-32C, slice-by-8, " + std::to_string(size) + " bytes")
+        {
+            return Crc32cSliceBy8(data.data(), data.size());
+        };
+
+        BENCHMARK("CRC-32C, " + std::to_string(size) + " bytes")
+        {
+            return Crc32c(data.data(), data.size());
+        };
+    }
+}
+
+// Errors a noisy UART line can introduce in a packet on the wire
+static void FlipTwoBits(std::vector<uint8_t> &packet, std::mt19937 &rng)
+{
+    for (int i = 0; i < 2; i++)
+        packet[rng() % packet.size()] ^= 1 << (rng() % 8);
+}
+
+static void SwapTwoBytes(std::vector<uint8_t> &packet, std::mt19937 &rng)
+{
+    size_t i = rng() % (packet.size() - 1);
+    std::swap(packet[i], packet[i + 1]);
+}
+
+static void Burst(std::vector<uint8_t> &packet, std::mt19937 &rng)
+{
+    // Up to 16 bits, starting and ending with a flipped bit
+    size_t length = 2 + rng() % 15;
+    size_t start = rng() % (packet.size() * 8 - length);
+    for (size_t bit = start; bit < start + length; bit++)
+    {
+        if (bit == start || bit == start + length - 1 || rng() % 2 == 0)
+            packet[bit / 8] ^= 1 << (bit % 8);
+    }
+}
+
+TEST_CASE("Compare error detection on a noisy channel", "[benchmark]")
+{
+    struct ErrorModel
+    {
+        std::string name;
+        void (*corrupt)(std::vector<uint8_t> &, std::mt19937 &);
+    };
+    const ErrorModel errorModels[] = {{"two bit flips", FlipTwoBits},
+                                      {"two swapped bytes", SwapTwoBytes},
+                                      {"burst of up to 16 bits", Burst}};
+    const std::pair<std::string, UART::Integrity> integrities[] = {{"8-bit checksum", UART::Integrity::CHECKSUM},
+                                                                   {"CRC-16/CCITT", UART::Integrity::CRC16},
+                                                                   {"CRC-32C", UART::Integrity::CRC32C}};
+    const int packets = 100000;
+
+    for (const auto &errorModel : errorModels)
+    {
+        for (const auto &integrity : integrities)
+        {
+            FakeUART sender;
+            FakeUART receiver;
+            sender.SetIntegrity(integrity.second);
+            receiver.SetIntegrity(integrity.second);
+
+            std::vector<uint8_t> sent(40);
+            int corrupted = 0;
+            int undetected = 0;
+            receiver.RegisterHandler(1, [&](PayloadView &payload) {
+                if (payload.GetSize() != sent.size() || std::memcmp(payload.GetBytes(), sent.data(), sent.size()) != 0)
+                    undetected++;
+            });
+
+            std::mt19937 rng(42);
+            for (int i = 0; i < packets; i++)
+            {
+                for (auto &b : sent)
+                    b = rng();
+                Payload payload;
+                payload.WriteBytes(sent.data(), sent.size());
+                sender.SendUARTPacket(1, payload);
+                sender.SendUARTPackets();
+
+                std::vector<uint8_t> packet;
+                packet.swap(sender.sent_bytes);
+                std::vector<uint8_t> original = packet;
+                errorModel.corrupt(packet, rng);
+                if (packet == original)
+                    continue;
+                corrupted++;
+
+                std::memcpy(receiver.receive_buffer, packet.data(), packet.size());
+                receiver.receive_buffer_size = packet.size();
+                receiver.ReceiveUARTPackets();
+            }
+
+            std::cout << errorModel.name << ", " << integrity.first << ": " << undetected << " undetected out of "
+                      << corrupted << " corrupted packets" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,411 @@
+#include "catch.hpp"
+#include "ByteStuffing.h"
+#include "FakeUART.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Adversarial input benchmarks for the receive path.
+// Each stream is fed in chunks of at most 1024 bytes, like a real UART poll.
+// The time per byte should stay the same whatever the size of the stream.
+
+static const size_t CHUNK_SIZE = 1024;
+static const size_t STREAM_SIZES[] = {1024, 4096, 16384};
+
+static void dummyHandler(PayloadView &payload)
+{
+}
+
+static void legacyDummyHandler(Payload &payload)
+{
+}
+
+static int FeedStream(FakeUART &uart, const std::vector<uint8_t> &stream)
+{
+    int packets = 0;
+    for (size_t offset = 0; offset < stream.size(); offset += CHUNK_SIZE)
+    {
+        uart.receive_buffer_size = std::min(CHUNK_SIZE, stream.size() - offset);
+        std::memcpy(uart.receive_buffer, stream.data() + offset, uart.receive_buffer_size);
+        packets += uart.ReceiveUARTPackets();
+    }
+    return packets;
+}
+
+// Only START_BYTEs, each one looks like the beginning of a frame
+static std::vector<uint8_t> AllStartBytes(size_t size)
+{
+    return std::vector<uint8_t>(size, START_BYTE);
+}
+
+// Uniformly random bytes
+static std::vector<uint8_t> RandomNoise(size_t size)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> stream(size);
+    for (auto &b : stream)
+        b = byte(rng);
+    return stream;
+}
+
+// Frames announcing the maximum length, each cut short by the start of the next one
+static std::vector<uint8_t> TruncatedFrames(size_t size)
+{
+    std::vector<uint8_t> stream;
+    while (stream.size() < size)
+    {
+        stream.push_back(START_BYTE);
+        stream.push_back(0x01);
+        stream.push_back(0xFF);
+        for (int i = 0; i < 61 && stream.size() < size; i++)
+            stream.push_back(0x11);
+    }
+    stream.resize(size);
+    return stream;
+}
+
+static void BenchmarkStream(const std::string &name, std::vector<uint8_t> (*generator)(size_t))
+{
+    for (size_t size : STREAM_SIZES)
+    {
+        FakeUART uart;
+        uart.RegisterHandler(1, dummyHandler);
+        std::vector<uint8_t> stream = generator(size);
+
+        BENCHMARK(name + ", " + std::to_string(size) + " bytes")
+        {
+            return FeedStream(uart, stream);
+        };
+    }
+}
+
+TEST_CASE("Benchmark resynchronization on adversarial input", "[benchmark]")
+{
+    BenchmarkStream("all START_BYTE", AllStartBytes);
+    BenchmarkStream("random noise", RandomNoise);
+    BenchmarkStream("truncated frames", TruncatedFrames);
+}
+
+TEST_CASE("Benchmark receiving a packet in small chunks", "[benchmark]")
+{
+    // An armed ControlInputPacket arriving over several polls
+    uint8_t payload[211];
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = i;
+    std::vector<uint8_t> stream = {START_BYTE, 0x01, sizeof(payload)};
+    uint8_t checksum = 0x01 + sizeof(payload);
+    for (uint8_t b : payload)
+    {
+        checksum += b;
+        if (b == START_BYTE || b == END_BYTE || b == ESCAPE_BYTE)
+        {
+            stream.push_back(ESCAPE_BYTE);
+            b ^= ESCAPE_MASK;
+        }
+        stream.push_back(b);
+    }
+    stream.push_back(checksum);
+    stream.push_back(END_BYTE);
+
+    for (size_t chunkSize : {8, 32, 256})
+    {
+        FakeUART uart;
+        uart.RegisterHandler(1, dummyHandler);
+
+        BENCHMARK("211 byte payload, " + std::to_string(chunkSize) + " byte chunks")
+        {
+            int packets = 0;
+            for (size_t offset = 0; offset < stream.size(); offset += chunkSize)
+            {
+                uart.receive_buffer_size = std::min(chunkSize, stream.size() - offset);
+                std::memcpy(uart.receive_buffer, stream.data() + offset, uart.receive_buffer_size);
+                packets += uart.ReceiveUARTPackets();
+            }
+            return packets;
+        };
+    }
+}
+
+// The receive path before unstuff-on-ingest, kept as a baseline: raw bytes are copied one by one
+// into the ring buffer, then each packet is re-parsed with Peek()/PeekUnstuff().
+class PeekUnstuffParser
+{
+  public:
+    std::unordered_map<int, std::function<void(Payload &)>> handlers;
+
+    int Receive(const uint8_t *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            circularBuffer[writeIndex] = data[i];
+            writeIndex = (writeIndex + 1) % RING_BUFFER_SIZE;
+        }
+        packetsRead = 0;
+        while (TryParsePacket())
+        {
+        }
+        return packetsRead;
+    }
+
+  private:
+    uint8_t circularBuffer[RING_BUFFER_SIZE];
+    size_t readIndex = 0;
+    size_t writeIndex = 0;
+    size_t peekIndex = 0;
+    int packetsRead = 0;
+
+    size_t AvailableBytesToPeek() const
+    {
+        return (writeIndex - (readIndex + peekIndex) + RING_BUFFER_SIZE) % RING_BUFFER_SIZE;
+    }
+
+    uint8_t Peek()
+    {
+        uint8_t byte = circularBuffer[(readIndex + peekIndex) % RING_BUFFER_SIZE];
+        peekIndex = (peekIndex + 1) % RING_BUFFER_SIZE;
+        return byte;
+    }
+
+    std::optional<uint8_t> PeekUnstuff()
+    {
+        if (AvailableBytesToPeek() < 1)
+            return std::nullopt;
+        uint8_t byte = Peek();
+        if (byte == ESCAPE_BYTE)
+        {
+            if (AvailableBytesToPeek() < 1)
+                return std::nullopt;
+            byte = Peek() ^ ESCAPE_MASK;
+        }
+        return byte;
+    }
+
+    bool DiscardCurrentByteAndContinue()
+    {
+        readIndex = (readIndex + 1) % RING_BUFFER_SIZE;
+        return true;
+    }
+
+    bool TryParsePacket()
+    {
+        peekIndex = 0;
+        uint8_t packetBuffer[MAX_PAYLOAD_SIZE + 5];
+        size_t packetBufferIndex = 0;
+
+        if (AvailableBytesToPeek() < 1)
+            return false;
+        if (Peek() != START_BYTE)
+            return DiscardCurrentByteAndContinue();
+
+        auto id = PeekUnstuff();
+        if (!id.has_value())
+            return false;
+        if (handlers.find(id.value()) == handlers.end())
+            return DiscardCurrentByteAndContinue();
+        packetBuffer[packetBufferIndex++] = id.value();
+
+        auto length = PeekUnstuff();
+        if (!length.has_value())
+            return false;
+        packetBuffer[packetBufferIndex++] = length.value();
+
+        for (size_t i = 0; i < length.value(); i++)
+        {
+            auto byte = PeekUnstuff();
+            if (!byte.has_value())
+                return false;
+            packetBuffer[packetBufferIndex++] = byte.value();
+        }
+
+        auto checksum = PeekUnstuff();
+        if (!checksum.has_value())
+            return false;
+        uint8_t sum = 0;
+        for (size_t i = 0; i < packetBufferIndex; i++)
+            sum += packetBuffer[i];
+        if (sum != checksum.value())
+            return DiscardCurrentByteAndContinue();
+
+        if (AvailableBytesToPeek() < 1)
+            return false;
+        if (Peek() != END_BYTE)
+            return DiscardCurrentByteAndContinue();
+
+        Payload payload;
+        payload.SetBytes(packetBuffer + 2, packetBufferIndex - 2);
+        handlers.find(id.value())->second(payload);
+        readIndex = (readIndex + peekIndex) % RING_BUFFER_SIZE;
+        packetsRead++;
+        return true;
+    }
+};
+
+// Valid frames with random payloads, so that some bytes need escaping
+static std::vector<uint8_t> RandomFrames(size_t size, size_t payloadSize)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> stream;
+    while (true)
+    {
+        std::vector<uint8_t> frame = {START_BYTE, 0x01, static_cast<uint8_t>(payloadSize)};
+        uint8_t checksum = 0x01 + payloadSize;
+        for (size_t i = 0; i < payloadSize + 1; i++)
+        {
+            uint8_t b = (i < payloadSize) ? byte(rng) : checksum;
+            checksum += b;
+            if (b == START_BYTE || b == END_BYTE || b == ESCAPE_BYTE)
+            {
+                frame.push_back(ESCAPE_BYTE);
+                b ^= ESCAPE_MASK;
+            }
+            frame.push_back(b);
+        }
+        frame.push_back(END_BYTE);
+
+        if (stream.size() + frame.size() > size)
+            return stream;
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+}
+
+TEST_CASE("Benchmark unstuff-on-ingest against the Peek/PeekUnstuff parser", "[benchmark]")
+{
+    for (size_t payloadSize : {40, 211})
+    {
+        std::vector<uint8_t> stream = RandomFrames(16384, payloadSize);
+        std::string name = std::to_string(stream.size()) + " bytes of " + std::to_string(payloadSize) + " byte payloads";
+
+        FakeUART uart;
+        uart.RegisterHandler(1, dummyHandler);
+        REQUIRE(FeedStream(uart, stream) > 0);
+        BENCHMARK("unstuff-on-ingest, " + name)
+        {
+            return FeedStream(uart, stream);
+        };
+
+        PeekUnstuffParser parser;
+        parser.handlers[1] = legacyDummyHandler;
+        BENCHMARK("Peek/PeekUnstuff, " + name)
+        {
+            int packets = 0;
+            for (size_t offset = 0; offset < stream.size(); offset += CHUNK_SIZE)
+                packets += parser.Receive(stream.data() + offset, std::min(CHUNK_SIZE, stream.size() - offset));
+            return packets;
+        };
+    }
+}
+
+TEST_CASE("Benchmark unstuffing kernels", "[benchmark]")
+{
+    for (size_t size : {211, 4096})
+    {
+        std::vector<uint8_t> data = RandomNoise(2 * size);
+        std::vector<uint8_t> stuffed(4 * size);
+        stuffed.resize(StuffBytes(data.data(), size, stuffed.data()));
+        std::vector<uint8_t> unstuffed(size);
+
+        BENCHMARK("scalar, " + std::to_string(size) + " bytes")
+        {
+            bool escapePending = false;
+            size_t consumed;
+            return UnstuffBytesScalar(stuffed.data(), stuffed.size(), unstuffed.data(), size, escapePending, consumed);
+        };
+
+        BENCHMARK("vectorized, " + std::to_string(size) + " bytes")
+        {
+            bool escapePending = false;
+            size_t consumed;
+            return UnstuffBytes(stuffed.data(), stuffed.size(), unstuffed.data(), size, escapePending, consumed);
+        };
+
+        std::vector<uint8_t> encoded(CobsMaxEncodedSize(size));
+        encoded.resize(CobsEncode(data.data(), size, encoded.data()));
+        BENCHMARK("COBS, " + std::to_string(size) + " bytes")
+        {
+            size_t decodedSize;
+            return CobsDecode(encoded.data(), encoded.size(), unstuffed.data(), decodedSize);
+        };
+    }
+}
+
+TEST_CASE("Benchmark receiving with each framing", "[benchmark]")
+{
+    for (size_t payloadSize : {40, 211})
+    {
+        // Let a sender frame the same random payloads both ways
+        std::vector<uint8_t> data = RandomNoise(payloadSize * 64);
+        for (UART::Framing framing : {UART::Framing::ESCAPE, UART::Framing::COBS})
+        {
+            FakeUART sender;
+            sender.SetFraming(framing);
+            std::vector<uint8_t> stream;
+            for (size_t offset = 0; offset < data.size(); offset += payloadSize)
+            {
+                Payload payload;
+                payload.WriteBytes(data.data() + offset, payloadSize);
+                sender.SendUARTPacket(1, payload);
+                sender.SendUARTPackets();
+            }
+            stream.swap(sender.sent_bytes);
+
+            FakeUART uart;
+            uart.SetFraming(framing);
+            uart.RegisterHandler(1, dummyHandler);
+            REQUIRE(FeedStream(uart, stream) == 64);
+            std::string name = (framing == UART::Framing::COBS) ? "COBS" : "escape";
+            BENCHMARK(name + ", 64 packets of " + std::to_string(payloadSize) + " bytes")
+            {
+                return FeedStream(uart, stream);
+            };
+        }
+    }
+}
+
+TEST_CASE("Benchmark dispatching packets", "[benchmark]")
+{
+    // A mix of packet IDs, as they come out of the decoder
+    std::mt19937 rng(42);
+    std::vector<uint8_t> ids(1000);
+    for (auto &id : ids)
+        id = 1 + rng() % 8;
+    Payload payload;
+    int calls = 0;
+
+    // Before: a hash lookup to validate the ID, another one to dispatch, and a call through std::function
+    std::unordered_map<int, std::function<void(Payload &)>> handlerMap;
+    for (int id = 1; id <= 8; id++)
+        handlerMap[id] = [&calls](Payload &payload) { calls++; };
+    BENCHMARK("unordered_map of std::function, 1000 packets")
+    {
+        for (uint8_t id : ids)
+        {
+            if (handlerMap.find(id) == handlerMap.end())
+                continue;
+            handlerMap.find(id)->second(payload);
+        }
+        return calls;
+    };
+
+    // After: one indexed load, and a call through a function pointer
+    PacketHandler handlerTable[UINT8_MAX + 1];
+    for (int id = 1; id <= 8; id++)
+        handlerTable[id].Set([&calls](PayloadView &payload) { calls++; });
+    PayloadView view = payload.GetView();
+    BENCHMARK("PacketHandler table, 1000 packets")
+    {
+        for (uint8_t id : ids)
+        {
+            if (!handlerTable[id])
+                continue;
+            handlerTable[id](view);
+        }
+        return calls;
+    };
+}
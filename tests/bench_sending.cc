@@ -0,0 +1,316 @@
+#include "catch.hpp"
+#include "ByteStuffing.h"
+#include "DeltaCodec.h"
+#include "FakeUART.h"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random bytes, about 3 in 256 need escaping
+static std::vector<uint8_t> RandomBytes(size_t size)
+{
+    std::mt19937 rng(42);
+    std::vector<uint8_t> data(size);
+    for (auto &b : data)
+        b = rng();
+    return data;
+}
+
+TEST_CASE("Benchmark stuffing kernels", "[benchmark]")
+{
+    for (size_t size : {40, 211, 4096})
+    {
+        std::vector<uint8_t> data = RandomBytes(size);
+        std::vector<uint8_t> stuffed(2 * size);
+
+        BENCHMARK("scalar, " + std::to_string(size) + " bytes")
+        {
+            return StuffBytesScalar(data.data(), data.size(), stuffed.data());
+        };
+
+        BENCHMARK("vectorized, " + std::to_string(size) + " bytes")
+        {
+            return StuffBytes(data.data(), data.size(), stuffed.data());
+        };
+
+        std::vector<uint8_t> encoded(CobsMaxEncodedSize(size));
+        BENCHMARK("COBS, " + std::to_string(size) + " bytes")
+        {
+            return CobsEncode(data.data(), data.size(), encoded.data());
+        };
+    }
+}
+
+TEST_CASE("Benchmark queueing packets", "[benchmark]")
+{
+    for (size_t size : {40, 211})
+    {
+        std::vector<uint8_t> data = RandomBytes(size);
+        Payload payload;
+        payload.WriteBytes(data.data(), data.size());
+        FakeUART uart;
+
+        BENCHMARK("SendUARTPacket, " + std::to_string(size) + " byte payload")
+        {
+            bool queued = uart.SendUARTPacket(1, payload);
+            uart.SendUARTPackets();
+            return queued;
+        };
+
+        FakeUART cobsUart;
+        cobsUart.SetFraming(UART::Framing::COBS);
+        BENCHMARK("SendUARTPacket with COBS, " + std::to_string(size) + " byte payload")
+        {
+            bool queued = cobsUart.SendUARTPacket(1, payload);
+            cobsUart.SendUARTPackets();
+            return queued;
+        };
+    }
+}
+
+// A flight-like stream of armed ControlInputPackets, at 100 Hz
+static std::vector<ControlInputPacket> ControlInputStream(size_t count)
+{
+    std::mt19937 rng(42);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::vector<ControlInputPacket> packets(count);
+    State current;
+    for (size_t i = 0; i < count; i++)
+    {
+        ControlInputPacket &packet = packets[i];
+        packet.armed = true;
+        packet.timestamp = 10.0 * i;
+
+        // Hold a position setpoint, the current state drifts around it
+        packet.desired_state.pos = Vec3(1.0, 2.0, 1.5);
+        current.pos = Vec3(1.0 + noise(rng), 2.0 + noise(rng), 1.5 + noise(rng));
+        current.vel = Vec3(noise(rng), noise(rng), noise(rng));
+        current.att = Vec3(noise(rng), noise(rng), 0.0);
+        current.rate = Vec3(noise(rng), noise(rng), noise(rng));
+        packet.current_state = current;
+        packet.setpointSelection = POSITION_CONTROL_SELECTION;
+        packet.inline_thrust = 0.5 + noise(rng);
+    }
+    return packets;
+}
+
+TEST_CASE("Compare bytes on wire for each framing", "[benchmark]")
+{
+    std::vector<ControlInputPacket> packets = ControlInputStream(1000);
+    size_t payloadBytes = 0;
+    for (const auto &packet : packets)
+    {
+        Payload payload;
+        payload.WriteControlInputPacket(packet);
+        payloadBytes += payload.GetSize();
+    }
+
+    for (UART::Framing framing : {UART::Framing::ESCAPE, UART::Framing::COBS})
+    {
+        FakeUART uart;
+        uart.SetFraming(framing);
+        for (const auto &packet : packets)
+        {
+            Payload payload;
+            payload.WriteControlInputPacket(packet);
+            REQUIRE(uart.SendUARTPacket(static_cast<uint8_t>(PacketId::ControlInput), payload));
+            uart.SendUARTPackets();
+        }
+
+        std::string name = (framing == UART::Framing::COBS) ? "COBS" : "escape";
+        std::cout << name << " framing: " << uart.sent_bytes.size() << " bytes on wire for " << packets.size()
+                  << " ControlInputPackets, " << payloadBytes << " bytes of payload" << std::endl;
+    }
+}
+
+// Field by field encoder, with a size check per double, as Payload used to encode packets
+class FieldByFieldEncoder
+{
+  public:
+    uint8_t bytes[UINT8_MAX];
+    size_t size = 0;
+
+    bool WriteDouble(double value)
+    {
+        if (size + sizeof(value) > sizeof(bytes))
+            return false;
+        std::memcpy(bytes + size, &value, sizeof(value));
+        size += sizeof(value);
+        return true;
+    }
+
+    bool WriteVec3(const Vec3 &vec)
+    {
+        bool success = true;
+        success &= WriteDouble(vec.x);
+        success &= WriteDouble(vec.y);
+        success &= WriteDouble(vec.z);
+        return success;
+    }
+
+    bool WriteState(const State &state)
+    {
+        bool success = true;
+        success &= WriteVec3(state.pos);
+        success &= WriteVec3(state.vel);
+        success &= WriteVec3(state.att);
+        success &= WriteVec3(state.rate);
+        return success;
+    }
+
+    bool WriteControlInputPacket(const ControlInputPacket &packet)
+    {
+        bool success = true;
+        bytes[size++] = packet.armed;
+        success &= WriteDouble(packet.timestamp);
+        if (packet.armed)
+        {
+            success &= WriteState(packet.desired_state);
+            success &= WriteState(packet.current_state);
+            uint8_t setpoint[SETPOINT_SELECTION_WIRE_SIZE];
+            EncodeSetpointSelection(setpoint, packet.setpointSelection);
+            bytes[size++] = setpoint[0];
+            bytes[size++] = setpoint[1];
+            success &= WriteDouble(packet.inline_thrust);
+        }
+        return success;
+    }
+};
+
+TEST_CASE("Benchmark encoding packets", "[benchmark]")
+{
+    ControlInputPacket packet = ControlInputStream(1)[0];
+
+    // The encoders write into buffers that outlive the benchmarks, so that none of the stores can be left out
+    FieldByFieldEncoder encoder;
+    BENCHMARK("field by field, armed ControlInputPacket")
+    {
+        encoder.size = 0;
+        return encoder.WriteControlInputPacket(packet);
+    };
+
+    Payload payload;
+    BENCHMARK("generated, armed ControlInputPacket")
+    {
+        payload.Clear();
+        return payload.WriteControlInputPacket(packet);
+    };
+
+    ControlInputPacket decoded;
+    BENCHMARK("field by field decoder, armed ControlInputPacket")
+    {
+        PayloadView view = payload.GetView();
+        bool success = true;
+        success &= view.ReadBool(decoded.armed);
+        success &= view.ReadDouble(decoded.timestamp);
+        for (State *state : {&decoded.desired_state, &decoded.current_state})
+        {
+            for (Vec3 *vec : {&state->pos, &state->vel, &state->att, &state->rate})
+            {
+                success &= view.ReadDouble(vec->x);
+                success &= view.ReadDouble(vec->y);
+                success &= view.ReadDouble(vec->z);
+            }
+        }
+        success &= view.ReadSetpointSelection(decoded.setpointSelection);
+        success &= view.ReadDouble(decoded.inline_thrust);
+        return success;
+    };
+
+    BENCHMARK("generated decoder, armed ControlInputPacket")
+    {
+        PayloadView view = payload.GetView();
+        return view.ReadControlInputPacket(decoded);
+    };
+}
+
+TEST_CASE("Benchmark compact encoding", "[benchmark]")
+{
+    std::vector<ControlInputPacket> packets = ControlInputStream(1000);
+    for (WireEncoding encoding : {WireEncoding::FULL, WireEncoding::COMPACT})
+    {
+        std::string name = (encoding == WireEncoding::COMPACT) ? "compact" : "full";
+        FakeUART uart;
+        uart.SetEncoding(encoding);
+        for (const auto &packet : packets)
+        {
+            REQUIRE(uart.SendPacket(packet));
+            uart.SendUARTPackets();
+        }
+        std::cout << name << " encoding: " << uart.sent_bytes.size() << " bytes on wire for " << packets.size()
+                  << " ControlInputPackets" << std::endl;
+
+        Payload payload;
+        BENCHMARK(name + " encoding, armed ControlInputPacket")
+        {
+            payload.Clear();
+            return payload.WritePacket(packets[1], encoding);
+        };
+
+        ControlInputPacket decoded;
+        BENCHMARK(name + " decoding, armed ControlInputPacket")
+        {
+            PayloadView view = payload.GetView();
+            return view.ReadPacket(decoded, encoding);
+        };
+
+        size_t index = 0;
+        BENCHMARK(name + " SendPacket, armed ControlInputPacket")
+        {
+            bool queued = uart.SendPacket(packets[index++ % packets.size()]);
+            uart.SendUARTPackets();
+            return queued;
+        };
+    }
+}
+
+TEST_CASE("Benchmark delta encoding", "[benchmark]")
+{
+    std::vector<ControlInputPacket> packets = ControlInputStream(1000);
+    std::mt19937 rng(5);
+    // Some frames lost on the way, their acks are then missing
+    for (double loss : {0.0, 0.05})
+    {
+        std::bernoulli_distribution lost(loss);
+        DeltaEncoder encoder;
+        DeltaDecoder decoder;
+        FakeUART uart;
+        FakeUART acks;
+        for (const auto &packet : packets)
+        {
+            Payload payload;
+            REQUIRE(encoder.Encode(packet, payload));
+            REQUIRE(uart.SendUARTPacket(static_cast<uint8_t>(PacketId::ControlInputDelta), payload));
+            uart.SendUARTPackets();
+            if (lost(rng))
+            {
+                continue;
+            }
+            ControlInputPacket decoded;
+            REQUIRE(decoder.Decode(payload, decoded));
+            REQUIRE(acks.SendPacket(decoder.GetAck()));
+            acks.SendUARTPackets();
+            encoder.OnAck(decoder.GetAck());
+        }
+        std::cout << "delta encoding, " << loss * 100 << "% lost: " << uart.sent_bytes.size() << " bytes on wire for "
+                  << packets.size() << " ControlInputPackets, " << encoder.GetKeyframesEncoded() << " keyframes, "
+                  << acks.sent_bytes.size() << " bytes of acks" << std::endl;
+    }
+
+    // Steady state: every frame is a delta against the previous packet
+    DeltaEncoder encoder(0);
+    DeltaDecoder decoder;
+    Payload payload;
+    ControlInputPacket decoded;
+    size_t index = 0;
+    BENCHMARK("delta encoding and decoding, armed ControlInputPacket")
+    {
+        payload.Clear();
+        encoder.Encode(packets[index++ % packets.size()], payload);
+        bool success = decoder.Decode(payload, decoded);
+        encoder.OnAck(decoder.GetAck());
+        return success;
+    };
+}
@@ -0,0 +1,268 @@
+#include "catch.hpp"
+#include "ByteStuffing.h"
+#include "UART.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+TEST_CASE("Test stuffing kernel")
+{
+    // Special bytes at the start, in the middle and at the end, across a 16 byte boundary
+    uint8_t data[] = {START_BYTE, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+                      0x0e, END_BYTE, ESCAPE_BYTE, 0x11, 0x12, 0x7c, 0x80, 0x5d, 0x5e, 0x5f, ESCAPE_BYTE};
+    uint8_t expected[] = {ESCAPE_BYTE, START_BYTE ^ ESCAPE_MASK, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+                          0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, ESCAPE_BYTE, END_BYTE ^ ESCAPE_MASK, ESCAPE_BYTE,
+                          ESCAPE_BYTE ^ ESCAPE_MASK, 0x11, 0x12, 0x7c, 0x80, 0x5d, 0x5e, 0x5f, ESCAPE_BYTE,
+                          ESCAPE_BYTE ^ ESCAPE_MASK};
+
+    uint8_t stuffed[2 * sizeof(data)];
+    REQUIRE(StuffBytes(data, sizeof(data), stuffed) == sizeof(expected));
+    REQUIRE(std::memcmp(stuffed, expected, sizeof(expected)) == 0);
+
+    REQUIRE(StuffBytesScalar(data, sizeof(data), stuffed) == sizeof(expected));
+    REQUIRE(std::memcmp(stuffed, expected, sizeof(expected)) == 0);
+
+    // Nothing to stuff
+    REQUIRE(StuffBytes(data, 0, stuffed) == 0);
+}
+
+TEST_CASE("Test stuffing kernel against the scalar version")
+{
+    std::mt19937 rng(1234);
+    // From no special bytes at all to only special bytes
+    for (int specialPercent : {0, 1, 10, 50, 100})
+    {
+        for (size_t size = 0; size < 300; size++)
+        {
+            std::vector<uint8_t> data(size);
+            for (auto &b : data)
+            {
+                if ((int)(rng() % 100) < specialPercent)
+                    b = START_BYTE - 1 + rng() % 3;
+                else
+                    b = rng();
+            }
+
+            std::vector<uint8_t> expected(2 * size + 1);
+            std::vector<uint8_t> stuffed(2 * size + 1);
+            size_t expectedSize = StuffBytesScalar(data.data(), size, expected.data());
+            REQUIRE(StuffBytes(data.data(), size, stuffed.data()) == expectedSize);
+            REQUIRE(std::memcmp(stuffed.data(), expected.data(), expectedSize) == 0);
+        }
+    }
+}
+
+TEST_CASE("Test unstuffing kernel")
+{
+    uint8_t stuffed[] = {0x01, ESCAPE_BYTE, START_BYTE ^ ESCAPE_MASK, 0x02, ESCAPE_BYTE, END_BYTE ^ ESCAPE_MASK,
+                         ESCAPE_BYTE, ESCAPE_BYTE ^ ESCAPE_MASK, 0x03, END_BYTE, 0x04};
+    uint8_t expected[] = {0x01, START_BYTE, 0x02, END_BYTE, ESCAPE_BYTE, 0x03};
+    uint8_t unstuffed[sizeof(stuffed)];
+    bool escapePending = false;
+    size_t consumed;
+
+    // Stops before the END_BYTE
+    REQUIRE(UnstuffBytes(stuffed, sizeof(stuffed), unstuffed, sizeof(unstuffed), escapePending, consumed) ==
+            sizeof(expected));
+    REQUIRE(consumed == 9);
+    REQUIRE(std::memcmp(unstuffed, expected, sizeof(expected)) == 0);
+
+    // An escape sequence split between two calls
+    REQUIRE(UnstuffBytes(stuffed, 2, unstuffed, sizeof(unstuffed), escapePending, consumed) == 1);
+    REQUIRE(consumed == 2);
+    REQUIRE(escapePending);
+    REQUIRE(UnstuffBytes(stuffed + 2, 1, unstuffed + 1, sizeof(unstuffed), escapePending, consumed) == 1);
+    REQUIRE(consumed == 1);
+    REQUIRE(!escapePending);
+    REQUIRE(unstuffed[1] == START_BYTE);
+
+    // Stops once the output is full
+    REQUIRE(UnstuffBytes(stuffed, sizeof(stuffed), unstuffed, 2, escapePending, consumed) == 2);
+    REQUIRE(consumed == 3);
+
+    // A START_BYTE right after an ESCAPE_BYTE drops the escape
+    uint8_t broken[] = {0x01, ESCAPE_BYTE, START_BYTE};
+    REQUIRE(UnstuffBytes(broken, sizeof(broken), unstuffed, sizeof(unstuffed), escapePending, consumed) == 1);
+    REQUIRE(consumed == 2);
+    REQUIRE(!escapePending);
+
+    // Same thing with the START_BYTE in the next call
+    REQUIRE(UnstuffBytes(broken, 2, unstuffed, sizeof(unstuffed), escapePending, consumed) == 1);
+    REQUIRE(escapePending);
+    REQUIRE(UnstuffBytes(broken + 2, 1, unstuffed, sizeof(unstuffed), escapePending, consumed) == 0);
+    REQUIRE(consumed == 0);
+    REQUIRE(!escapePending);
+}
+
+TEST_CASE("Test unstuffing kernel against the scalar version")
+{
+    std::mt19937 rng(5678);
+    for (int specialPercent : {0, 1, 10, 50, 100})
+    {
+        for (int iteration = 0; iteration < 200; iteration++)
+        {
+            std::vector<uint8_t> data(rng() % 600);
+            for (auto &b : data)
+            {
+                if ((int)(rng() % 100) < specialPercent)
+                    b = START_BYTE - 1 + rng() % 3;
+                else
+                    b = rng();
+            }
+
+            // Unstuff the stream in random chunks with a random output limit, like the receiver does
+            bool expectedEscape = false;
+            bool escape = false;
+            size_t position = 0;
+            while (position < data.size())
+            {
+                size_t chunk = 1 + rng() % std::min<size_t>(100, data.size() - position);
+                size_t maxOutput = 1 + rng() % 100;
+                std::vector<uint8_t> expected(maxOutput);
+                std::vector<uint8_t> unstuffed(maxOutput);
+                size_t expectedConsumed;
+                size_t consumed;
+                size_t expectedSize = UnstuffBytesScalar(data.data() + position, chunk, expected.data(), maxOutput,
+                                                         expectedEscape, expectedConsumed);
+                REQUIRE(UnstuffBytes(data.data() + position, chunk, unstuffed.data(), maxOutput, escape, consumed) ==
+                        expectedSize);
+                REQUIRE(consumed == expectedConsumed);
+                REQUIRE(escape == expectedEscape);
+                REQUIRE(std::memcmp(unstuffed.data(), expected.data(), expectedSize) == 0);
+
+                // Skip the frame delimiter we stopped on
+                position += (consumed == 0) ? 1 : consumed;
+            }
+        }
+    }
+}
+
+TEST_CASE("Test stuffing and unstuffing round trip")
+{
+    std::mt19937 rng(91011);
+    for (int iteration = 0; iteration < 500; iteration++)
+    {
+        std::vector<uint8_t> data(rng() % 300);
+        for (auto &b : data)
+            b = (rng() % 4 == 0) ? START_BYTE - 1 + rng() % 3 : rng();
+
+        std::vector<uint8_t> stuffed(2 * data.size());
+        stuffed.resize(StuffBytes(data.data(), data.size(), stuffed.data()));
+
+        // Unstuff in place, in random chunks so that escape sequences straddle the chunks
+        bool escapePending = false;
+        size_t read = 0;
+        size_t written = 0;
+        while (read < stuffed.size())
+        {
+            size_t chunk = 1 + rng() % std::min<size_t>(40, stuffed.size() - read);
+            size_t consumed;
+            written += UnstuffBytes(stuffed.data() + read, chunk, stuffed.data() + written, stuffed.size(),
+                                    escapePending, consumed);
+            REQUIRE(consumed == chunk);
+            read += consumed;
+        }
+        REQUIRE(!escapePending);
+        REQUIRE(written == data.size());
+        REQUIRE(std::memcmp(stuffed.data(), data.data(), data.size()) == 0);
+    }
+}
+
+TEST_CASE("Test COBS encoding")
+{
+    struct Vector
+    {
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> encoded;
+    };
+    std::vector<Vector> vectors = {
+        {{}, {0x01}},
+        {{0x00}, {0x01, 0x01}},
+        {{0x00, 0x00}, {0x01, 0x01, 0x01}},
+        {{0x00, 0x11, 0x00}, {0x01, 0x02, 0x11, 0x01}},
+        {{0x11, 0x22, 0x00, 0x33}, {0x03, 0x11, 0x22, 0x02, 0x33}},
+        {{0x11, 0x22, 0x33, 0x44}, {0x05, 0x11, 0x22, 0x33, 0x44}},
+        {{0x11, 0x00, 0x00, 0x00}, {0x02, 0x11, 0x01, 0x01, 0x01}},
+    };
+
+    // Full blocks of 254 bytes without any zero
+    std::vector<uint8_t> full(254);
+    for (size_t i = 0; i < full.size(); i++)
+        full[i] = i + 1;
+    Vector fullBlock = {full, {0xFF}};
+    fullBlock.encoded.insert(fullBlock.encoded.end(), full.begin(), full.end());
+    vectors.push_back(fullBlock);
+
+    Vector fullBlockAndZero = fullBlock;
+    fullBlockAndZero.data.push_back(0x00);
+    fullBlockAndZero.encoded.insert(fullBlockAndZero.encoded.end(), {0x01, 0x01});
+    vectors.push_back(fullBlockAndZero);
+
+    Vector fullBlockAndByte = fullBlock;
+    fullBlockAndByte.data.push_back(0x42);
+    fullBlockAndByte.encoded.insert(fullBlockAndByte.encoded.end(), {0x02, 0x42});
+    vectors.push_back(fullBlockAndByte);
+
+    for (const auto &vector : vectors)
+    {
+        std::vector<uint8_t> encoded(CobsMaxEncodedSize(vector.data.size()));
+        encoded.resize(CobsEncode(vector.data.data(), vector.data.size(), encoded.data()));
+        REQUIRE(encoded == vector.encoded);
+
+        std::vector<uint8_t> decoded(encoded.size());
+        size_t decodedSize;
+        REQUIRE(CobsDecode(encoded.data(), encoded.size(), decoded.data(), decodedSize));
+        decoded.resize(decodedSize);
+        REQUIRE(decoded == vector.data);
+    }
+}
+
+TEST_CASE("Test COBS round trip")
+{
+    std::mt19937 rng(1213);
+    for (int zeroPercent : {0, 1, 10, 50, 100})
+    {
+        for (int iteration = 0; iteration < 200; iteration++)
+        {
+            std::vector<uint8_t> data(rng() % 800);
+            for (auto &b : data)
+                b = ((int)(rng() % 100) < zeroPercent) ? 0 : 1 + rng() % 255;
+
+            // Encode in random pieces
+            std::vector<uint8_t> encoded(CobsMaxEncodedSize(data.size()));
+            CobsEncoder encoder(encoded.data());
+            size_t position = 0;
+            while (position < data.size())
+            {
+                size_t piece = 1 + rng() % (data.size() - position);
+                encoder.Write(data.data() + position, piece);
+                position += piece;
+            }
+            encoded.resize(encoder.Finish());
+            REQUIRE(std::find(encoded.begin(), encoded.end(), 0) == encoded.end());
+
+            // Decode in place
+            size_t decodedSize;
+            REQUIRE(CobsDecode(encoded.data(), encoded.size(), encoded.data(), decodedSize));
+            REQUIRE(decodedSize == data.size());
+            REQUIRE(std::memcmp(encoded.data(), data.data(), data.size()) == 0);
+        }
+    }
+}
+
+TEST_CASE("Test COBS decoding malformed frames")
+{
+    uint8_t decoded[16];
+    size_t decodedSize;
+
+    // A block running past the end of the frame
+    uint8_t truncated[] = {0x05, 0x11, 0x22};
+    REQUIRE_FALSE(CobsDecode(truncated, sizeof(truncated), decoded, decodedSize));
+
+    // A zero inside a block, or as a code byte
+    uint8_t zeroData[] = {0x03, 0x11, 0x00};
+    REQUIRE_FALSE(CobsDecode(zeroData, sizeof(zeroData), decoded, decodedSize));
+    uint8_t zeroCode[] = {0x02, 0x11, 0x00};
+    REQUIRE_FALSE(CobsDecode(zeroCode, sizeof(zeroCode), decoded, decodedSize));
+}
@@ -0,0 +1,379 @@
+#include "catch.hpp"
+#include "CM4UART.h"
+#include "FakeUART.h"
+#include "PtyPair.h"
+#include <chrono>
+#include <thread>
+#include <unistd.h> // For read, write
+#include <vector>
+
+namespace
+{
+ControlOutputPacket MakeOutput(int i)
+{
+    return ControlOutputPacket{static_cast<double>(i), 1.5 * i, -2.5 * i, 0.5, -0.25};
+}
+
+// Bytes on the wire of packets encoded by another UART
+template <typename Packet> std::vector<uint8_t> Encode(const std::vector<Packet> &packets)
+{
+    FakeUART encoder;
+    for (const Packet &packet : packets)
+    {
+        encoder.SendPacket(packet);
+        encoder.SendUARTPackets();
+    }
+    return encoder.sent_bytes;
+}
+} // namespace
+
+TEST_CASE("Test the I/O thread of CM4UART over a pty")
+{
+    PtyPair pty;
+    QuietCM4UART uart(pty.SlavePath());
+    REQUIRE(uart.Begin());
+
+    std::vector<ControlOutputPacket> received;
+    std::vector<std::thread::id> handlerThreads;
+    uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) {
+        received.push_back(packet);
+        handlerThreads.push_back(std::this_thread::get_id());
+    });
+    REQUIRE(uart.StartIOThread());
+    REQUIRE_FALSE(uart.StartIOThread());
+
+    // Packets written to the other end are deframed by the I/O thread, and handled on this one
+    std::vector<ControlOutputPacket> sent;
+    for (int i = 0; i < 20; i++)
+    {
+        sent.push_back(MakeOutput(i));
+    }
+    std::vector<uint8_t> wire = Encode(sent);
+    REQUIRE(write(pty.MasterFd(), wire.data(), wire.size()) == static_cast<ssize_t>(wire.size()));
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (received.size() < sent.size() && std::chrono::steady_clock::now() < deadline)
+    {
+        uart.ReceiveUARTPackets();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    REQUIRE(received.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        REQUIRE(received[i].timestamp == sent[i].timestamp);
+        REQUIRE(received[i].d2 == sent[i].d2);
+        REQUIRE(handlerThreads[i] == std::this_thread::get_id());
+    }
+
+    // Packets sent from this thread are encoded and written by the I/O thread
+    for (int i = 0; i < 10; i++)
+    {
+        REQUIRE(uart.SendPacket(MakeOutput(100 + i)));
+    }
+    uart.SendUARTPackets();
+
+    FakeUART peer;
+    std::vector<ControlOutputPacket> echoed;
+    peer.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { echoed.push_back(packet); });
+    while (echoed.size() < 10 && std::chrono::steady_clock::now() < deadline)
+    {
+        ssize_t size = read(pty.MasterFd(), peer.receive_buffer, sizeof(peer.receive_buffer));
+        if (size > 0)
+        {
+            peer.receive_buffer_size = size;
+            peer.ReceiveUARTPackets();
+        }
+    }
+    REQUIRE(echoed.size() == 10);
+    for (size_t i = 0; i < echoed.size(); i++)
+    {
+        REQUIRE(echoed[i].timestamp == 100 + i);
+    }
+
+    uart.StopIOThread();
+    REQUIRE(uart.DroppedReceivedPackets() == 0);
+
+    // Back to the plain calls once stopped
+    wire = Encode(std::vector<ControlOutputPacket>{MakeOutput(200)});
+    REQUIRE(write(pty.MasterFd(), wire.data(), wire.size()) == static_cast<ssize_t>(wire.size()));
+    while (received.size() < sent.size() + 1 && std::chrono::steady_clock::now() < deadline)
+    {
+        uart.ReceiveUARTPackets();
+    }
+    REQUIRE(received.back().timestamp == 200);
+}
+
+TEST_CASE("Test the back-pressure of the I/O thread of CM4UART over a pty")
+{
+    PtyPair pty;
+    QuietCM4UART uart(pty.SlavePath());
+    REQUIRE(uart.Begin());
+    REQUIRE(uart.StartIOThread());
+
+    // Nobody reads the other end, so the pty, the send buffer and then the ring fill up. The last packets are
+    // refused instead of dropped by the I/O thread.
+    int accepted = 0;
+    int refused = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (refused < 10 && std::chrono::steady_clock::now() < deadline)
+    {
+        if (uart.SendPacket(MakeOutput(accepted)))
+        {
+            accepted++;
+        }
+        else
+        {
+            refused++;
+            // Give the I/O thread time to take what it can from the ring
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        uart.SendUARTPackets();
+    }
+    REQUIRE(refused == 10);
+
+    // Every packet accepted comes out, in order, once the other end reads
+    FakeUART peer;
+    std::vector<ControlOutputPacket> echoed;
+    peer.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { echoed.push_back(packet); });
+    while (echoed.size() < static_cast<size_t>(accepted) && std::chrono::steady_clock::now() < deadline)
+    {
+        uart.SendUARTPackets();
+        ssize_t size = read(pty.MasterFd(), peer.receive_buffer, sizeof(peer.receive_buffer));
+        if (size > 0)
+        {
+            peer.receive_buffer_size = size;
+            peer.ReceiveUARTPackets();
+        }
+    }
+    REQUIRE(echoed.size() == static_cast<size_t>(accepted));
+    for (size_t i = 0; i < echoed.size(); i++)
+    {
+        REQUIRE(echoed[i].timestamp == i);
+    }
+    uart.StopIOThread();
+    REQUIRE(uart.GetTransmitStats(UART::Priority::CONTROL).packetsDropped == 0);
+}
+
+TEST_CASE("Test waiting for packets on a pty")
+{
+    PtyPair pty;
+    QuietCM4UART uart(pty.SlavePath());
+    REQUIRE(uart.Begin());
+    std::vector<ControlOutputPacket> received;
+    uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { received.push_back(packet); });
+
+    using Clock = std::chrono::steady_clock;
+    const std::vector<uint8_t> wire = Encode(std::vector<ControlOutputPacket>{MakeOutput(1)});
+    const size_t half = wire.size() / 2;
+
+    for (bool threaded : {false, true})
+    {
+        if (threaded)
+        {
+            REQUIRE(uart.StartIOThread());
+        }
+        received.clear();
+
+        // Nothing arrives
+        auto start = Clock::now();
+        REQUIRE(uart.WaitForPackets(20000) == 0);
+        REQUIRE(Clock::now() - start >= std::chrono::milliseconds(20));
+
+        // A frame arrives in two parts, the packet is only handled once it is complete
+        ssize_t written = 0;
+        std::thread peer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            written += write(pty.MasterFd(), wire.data(), half);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            written += write(pty.MasterFd(), wire.data() + half, wire.size() - half);
+        });
+        start = Clock::now();
+        int packetsReceived = uart.WaitForPackets(5000000);
+        const auto elapsed = Clock::now() - start;
+        peer.join();
+        REQUIRE(written == static_cast<ssize_t>(wire.size()));
+        REQUIRE(packetsReceived == 1);
+        REQUIRE(received.size() == 1);
+        REQUIRE(received[0].timestamp == 1);
+        REQUIRE(elapsed >= std::chrono::milliseconds(30));
+        REQUIRE(elapsed < std::chrono::seconds(5));
+    }
+    uart.StopIOThread();
+}
+
+TEST_CASE("Test the io_uring transport of CM4UART over a pty")
+{
+    for (bool kernelPolling : {false, true})
+    {
+        PtyPair pty;
+        QuietCM4UART uart(pty.SlavePath());
+        REQUIRE(uart.Begin());
+        std::vector<ControlOutputPacket> received;
+        uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { received.push_back(packet); });
+
+        REQUIRE_FALSE(uart.UsingIoUring());
+        if (!uart.UseIoUring(kernelPolling))
+        {
+            // Not supported by the build or the kernel, CM4UART keeps using read() and write()
+            REQUIRE_FALSE(uart.UsingIoUring());
+            WARN("io_uring is not available, skipping");
+            return;
+        }
+        REQUIRE(uart.UsingIoUring());
+        REQUIRE_FALSE(uart.UseIoUring(kernelPolling));
+        REQUIRE_FALSE(uart.StartIOThread());
+
+        // Packets written to the other end are picked up from the completions of the posted reads
+        std::vector<ControlOutputPacket> sent;
+        for (int i = 0; i < 20; i++)
+        {
+            sent.push_back(MakeOutput(i));
+        }
+        std::vector<uint8_t> wire = Encode(sent);
+        REQUIRE(write(pty.MasterFd(), wire.data(), wire.size()) == static_cast<ssize_t>(wire.size()));
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (received.size() < sent.size() && std::chrono::steady_clock::now() < deadline)
+        {
+            uart.ReceiveUARTPackets();
+        }
+        REQUIRE(received.size() == sent.size());
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            REQUIRE(received[i].timestamp == sent[i].timestamp);
+            REQUIRE(received[i].d2 == sent[i].d2);
+        }
+
+        // Packets sent are written by one request at a time
+        for (int i = 0; i < 10; i++)
+        {
+            REQUIRE(uart.SendPacket(MakeOutput(100 + i)));
+        }
+        FakeUART peer;
+        std::vector<ControlOutputPacket> echoed;
+        peer.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { echoed.push_back(packet); });
+        while (echoed.size() < 10 && std::chrono::steady_clock::now() < deadline)
+        {
+            uart.SendUARTPackets();
+            uart.ReceiveUARTPackets();
+            ssize_t size = read(pty.MasterFd(), peer.receive_buffer, sizeof(peer.receive_buffer));
+            if (size > 0)
+            {
+                peer.receive_buffer_size = size;
+                peer.ReceiveUARTPackets();
+            }
+        }
+        REQUIRE(echoed.size() == 10);
+        for (size_t i = 0; i < echoed.size(); i++)
+        {
+            REQUIRE(echoed[i].timestamp == 100 + i);
+        }
+
+        // Waiting for packets waits for the completion of the read
+        received.clear();
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(uart.WaitForPackets(20000) == 0);
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+        wire = Encode(std::vector<ControlOutputPacket>{MakeOutput(1)});
+        ssize_t written = 0;
+        std::thread writer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            written = write(pty.MasterFd(), wire.data(), wire.size());
+        });
+        start = std::chrono::steady_clock::now();
+        int packetsReceived = uart.WaitForPackets(5000000);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        writer.join();
+        REQUIRE(written == static_cast<ssize_t>(wire.size()));
+        REQUIRE(packetsReceived == 1);
+        REQUIRE(received.size() == 1);
+        REQUIRE(received[0].timestamp == 1);
+        REQUIRE(elapsed >= std::chrono::milliseconds(10));
+        REQUIRE(elapsed < std::chrono::seconds(5));
+        REQUIRE(uart.UsingIoUring());
+    }
+}
+
+TEST_CASE("Test short io_uring writes of CM4UART over a pty")
+{
+    PtyPair pty;
+    QuietCM4UART uart(pty.SlavePath());
+    REQUIRE(uart.Begin());
+    if (!uart.UseIoUring(false))
+    {
+        WARN("io_uring is not available, skipping");
+        return;
+    }
+
+    // Nobody reads the other end until the pty is full, so that the writes in flight only complete partly
+    int accepted = 0;
+    int refused = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (refused < 100 && std::chrono::steady_clock::now() < deadline)
+    {
+        if (uart.SendPacket(MakeOutput(accepted)))
+        {
+            accepted++;
+            refused = 0;
+        }
+        else
+        {
+            refused++;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        uart.SendUARTPackets();
+    }
+    REQUIRE(refused == 100);
+
+    // Sending alone submits the rest of the partial writes, without any receiving
+    FakeUART peer;
+    std::vector<ControlOutputPacket> echoed;
+    peer.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { echoed.push_back(packet); });
+    while (echoed.size() < static_cast<size_t>(accepted) && std::chrono::steady_clock::now() < deadline)
+    {
+        uart.SendUARTPackets();
+        ssize_t size = read(pty.MasterFd(), peer.receive_buffer, sizeof(peer.receive_buffer));
+        if (size > 0)
+        {
+            peer.receive_buffer_size = size;
+            peer.ReceiveUARTPackets();
+        }
+    }
+    REQUIRE(echoed.size() == static_cast<size_t>(accepted));
+    for (size_t i = 0; i < echoed.size(); i++)
+    {
+        REQUIRE(echoed[i].timestamp == i);
+    }
+    REQUIRE(uart.UsingIoUring());
+}
+
+TEST_CASE("Test tearing the io_uring transport of CM4UART down over a pty")
+{
+    PtyPair pty;
+    const std::vector<uint8_t> wire = Encode(std::vector<ControlOutputPacket>{MakeOutput(1)});
+    for (bool kernelPolling : {false, true})
+    {
+        // The read in flight is cancelled before the destructor returns, so it cannot take the bytes of the next
+        // user of the device
+        {
+            QuietCM4UART uart(pty.SlavePath());
+            REQUIRE(uart.Begin());
+            if (!uart.UseIoUring(kernelPolling))
+            {
+                WARN("io_uring is not available, skipping");
+                return;
+            }
+            REQUIRE(uart.WaitForPackets(1000) == 0);
+        }
+        REQUIRE(write(pty.MasterFd(), wire.data(), wire.size()) == static_cast<ssize_t>(wire.size()));
+
+        QuietCM4UART uart(pty.SlavePath());
+        REQUIRE(uart.Begin());
+        std::vector<ControlOutputPacket> received;
+        uart.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) { received.push_back(packet); });
+        REQUIRE(uart.WaitForPackets(1000000) == 1);
+        REQUIRE(received.size() == 1);
+        REQUIRE(received[0].timestamp == 1);
+    }
+}
@@ -0,0 +1,43 @@
+#include "catch.hpp"
+#include "Crc.h"
+#include <random>
+#include <vector>
+
+static const uint8_t CHECK_INPUT[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+TEST_CASE("Test CRC check values")
+{
+    REQUIRE(Crc16Ccitt(CHECK_INPUT, sizeof(CHECK_INPUT)) == 0x29B1);
+    REQUIRE(Crc16CcittScalar(CHECK_INPUT, sizeof(CHECK_INPUT)) == 0x29B1);
+    REQUIRE(Crc32c(CHECK_INPUT, sizeof(CHECK_INPUT)) == 0xE3069283);
+    REQUIRE(Crc32cScalar(CHECK_INPUT, sizeof(CHECK_INPUT)) == 0xE3069283);
+    REQUIRE(Crc32cSliceBy8(CHECK_INPUT, sizeof(CHECK_INPUT)) == 0xE3069283);
+
+    // Nothing to check
+    REQUIRE(Crc16Ccitt(CHECK_INPUT, 0) == 0xFFFF);
+    REQUIRE(Crc32c(CHECK_INPUT, 0) == 0);
+}
+
+TEST_CASE("Test CRC kernels against the scalar versions")
+{
+    std::mt19937 rng(1415);
+    for (int iteration = 0; iteration < 1000; iteration++)
+    {
+        std::vector<uint8_t> data(rng() % 600);
+        for (auto &b : data)
+            b = rng();
+
+        uint16_t crc16 = Crc16CcittScalar(data.data(), data.size());
+        uint32_t crc32 = Crc32cScalar(data.data(), data.size());
+        REQUIRE(Crc16Ccitt(data.data(), data.size()) == crc16);
+        REQUIRE(Crc32c(data.data(), data.size()) == crc32);
+        REQUIRE(Crc32cSliceBy8(data.data(), data.size()) == crc32);
+
+        // Computed incrementally, in two pieces
+        size_t split = data.empty() ? 0 : rng() % data.size();
+        REQUIRE(Crc16Ccitt(data.data() + split, data.size() - split, Crc16Ccitt(data.data(), split)) == crc16);
+        REQUIRE(Crc32c(data.data() + split, data.size() - split, Crc32c(data.data(), split)) == crc32);
+        REQUIRE(Crc32cSliceBy8(data.data() + split, data.size() - split, Crc32cSliceBy8(data.data(), split)) ==
+                crc32);
+    }
+}
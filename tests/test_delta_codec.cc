@@ -0,0 +1,309 @@
+#include "catch.hpp"
+#include "DeltaCodec.h"
+#include "FakeUART.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Control inputs of a drone holding its position, with noise on the current state
+static std::vector<ControlInputPacket> ControlInputs(size_t count)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::vector<ControlInputPacket> packets(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ControlInputPacket &packet = packets[i];
+        packet.armed = true;
+        packet.timestamp = 10.0 * i;
+        packet.desired_state.pos = Vec3(1.0, 2.0, 1.5);
+        packet.current_state.pos = Vec3(1.0 + noise(rng), 2.0 + noise(rng), 1.5 + noise(rng));
+        packet.current_state.att = Vec3(noise(rng), noise(rng), 0.0);
+        packet.current_state.rate = Vec3(noise(rng), noise(rng), noise(rng));
+        packet.setpointSelection = POSITION_CONTROL_SELECTION;
+        packet.inline_thrust = 0.5 + noise(rng);
+    }
+    return packets;
+}
+
+// The packet as the decoder sees it
+static ControlInputPacket Quantized(const ControlInputPacket &packet)
+{
+    DeltaFields fields;
+    QuantizeDeltaFields(packet, fields);
+    ControlInputPacket quantized{};
+    RestoreDeltaFields(fields, quantized);
+    return quantized;
+}
+
+static bool SameFields(const ControlInputPacket &a, const ControlInputPacket &b)
+{
+    DeltaFields fieldsA, fieldsB;
+    QuantizeDeltaFields(a, fieldsA);
+    QuantizeDeltaFields(b, fieldsB);
+    return std::memcmp(fieldsA.values, fieldsB.values, sizeof(fieldsA.values)) == 0;
+}
+
+TEST_CASE("Test quantizing delta fields")
+{
+    ControlInputPacket packet{};
+    packet.armed = true;
+    packet.timestamp = 1234.5678;
+    packet.desired_state.pos = Vec3(1.23456, -100.0, 1e9);
+    packet.current_state.att = Vec3(0.12345, -3.0, std::nan(""));
+    packet.current_state.rate = Vec3(1.2345, 0.0, -0.0006);
+    packet.setpointSelection = ATTITUDE_CONTROL_YAW_RATE_SELECTION;
+    packet.inline_thrust = 0.123456;
+
+    ControlInputPacket quantized = Quantized(packet);
+    REQUIRE(quantized.armed);
+    REQUIRE(std::fabs(quantized.timestamp - 1234.5678) <= 0.0005);
+    REQUIRE(std::fabs(quantized.desired_state.pos.x - 1.23456) <= 0.00005);
+    REQUIRE(quantized.desired_state.pos.y == Approx(-100.0));
+    // Saturated, NaN gives 0
+    REQUIRE(quantized.desired_state.pos.z == Approx(214748.3647));
+    REQUIRE(std::fabs(quantized.current_state.att.x - 0.12345) <= 0.00005);
+    REQUIRE(quantized.current_state.att.y == Approx(-3.0));
+    REQUIRE(quantized.current_state.att.z == 0);
+    REQUIRE(std::fabs(quantized.current_state.rate.x - 1.2345) <= 0.0005);
+    REQUIRE(quantized.current_state.rate.z == Approx(-0.001));
+    REQUIRE(std::memcmp(&quantized.setpointSelection, &ATTITUDE_CONTROL_YAW_RATE_SELECTION,
+                        sizeof(SetpointSelection)) == 0);
+    REQUIRE(std::fabs(quantized.inline_thrust - 0.123456) <= 0.000005);
+
+    // Quantizing again changes nothing
+    REQUIRE(SameFields(quantized, Quantized(quantized)));
+}
+
+TEST_CASE("Test delta encoding against acknowledged packets")
+{
+    std::vector<ControlInputPacket> packets = ControlInputs(50);
+    DeltaEncoder encoder(0);
+    DeltaDecoder decoder;
+    REQUIRE(decoder.GetAck().keyframe_request);
+
+    std::vector<size_t> sizes;
+    for (const auto &packet : packets)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packet, payload));
+        sizes.push_back(payload.GetSize());
+
+        ControlInputPacket decoded{};
+        REQUIRE(decoder.Decode(payload, decoded));
+        REQUIRE(SameFields(decoded, packet));
+        ControlInputPacket quantized = Quantized(packet);
+        REQUIRE(decoded.timestamp == quantized.timestamp);
+        REQUIRE(decoded.current_state.pos.x == quantized.current_state.pos.x);
+        REQUIRE(decoded.inline_thrust == quantized.inline_thrust);
+        encoder.OnAck(decoder.GetAck());
+    }
+
+    // Only the first frame is a keyframe, the deltas are much smaller than the packets
+    REQUIRE(encoder.GetKeyframesEncoded() == 1);
+    REQUIRE(decoder.GetFramesDecoded() == 50);
+    REQUIRE(decoder.GetFramesRejected() == 0);
+    REQUIRE_FALSE(decoder.GetAck().keyframe_request);
+    for (size_t i = 1; i < sizes.size(); i++)
+    {
+        REQUIRE(sizes[i] < sizes[0]);
+        REQUIRE(sizes[i] < CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE / 2);
+    }
+
+    // An unchanged packet only sends its header, presence bits and checksum
+    Payload payload;
+    REQUIRE(encoder.Encode(packets.back(), payload));
+    REQUIRE(payload.GetSize() == 3 + DELTA_PRESENCE_SIZE + 2);
+    ControlInputPacket decoded{};
+    REQUIRE(decoder.Decode(payload, decoded));
+    REQUIRE(SameFields(decoded, packets.back()));
+}
+
+TEST_CASE("Test delta encoding with lost frames and acks")
+{
+    std::vector<ControlInputPacket> packets = ControlInputs(200);
+    DeltaEncoder encoder(0);
+    DeltaDecoder decoder;
+    std::mt19937 rng(3);
+    std::bernoulli_distribution lost(0.2);
+
+    size_t decoded = 0;
+    for (const auto &packet : packets)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packet, payload));
+        if (lost(rng))
+        {
+            continue;
+        }
+        // The frames that arrive always reference a packet the decoder has
+        ControlInputPacket output{};
+        REQUIRE(decoder.Decode(payload, output));
+        REQUIRE(SameFields(output, packet));
+        decoded++;
+        if (!lost(rng))
+        {
+            encoder.OnAck(decoder.GetAck());
+        }
+    }
+    REQUIRE(decoder.GetFramesDecoded() == decoded);
+    REQUIRE(decoder.GetFramesRejected() == 0);
+    REQUIRE(encoder.GetKeyframesEncoded() < 10);
+}
+
+TEST_CASE("Test delta encoding without acks")
+{
+    std::vector<ControlInputPacket> packets = ControlInputs(40);
+    DeltaEncoder encoder(0);
+    DeltaDecoder decoder;
+
+    // The first ack makes the first packet the reference, until it is too old to be one
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[i], payload));
+        ControlInputPacket output{};
+        REQUIRE(decoder.Decode(payload, output));
+        REQUIRE(SameFields(output, packets[i]));
+        if (i == 0)
+        {
+            encoder.OnAck(decoder.GetAck());
+        }
+    }
+    REQUIRE(encoder.GetKeyframesEncoded() == 1 + packets.size() - 1 - DELTA_HISTORY);
+
+    // Acks of frames that were never sent are ignored
+    DeltaEncoder fresh;
+    fresh.OnAck({5, false});
+    Payload payload;
+    REQUIRE(fresh.Encode(packets[0], payload));
+    REQUIRE(fresh.GetKeyframesEncoded() == 1);
+}
+
+TEST_CASE("Test periodic keyframes")
+{
+    std::vector<ControlInputPacket> packets = ControlInputs(100);
+    DeltaEncoder encoder(10);
+    DeltaDecoder decoder;
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[i], payload));
+        REQUIRE(((payload.GetBytes()[0] & DELTA_FLAG_KEYFRAME) != 0) == (i % 10 == 0));
+        ControlInputPacket output{};
+        REQUIRE(decoder.Decode(payload, output));
+        encoder.OnAck(decoder.GetAck());
+    }
+    REQUIRE(encoder.GetKeyframesEncoded() == 10);
+
+    // On demand
+    encoder.RequestKeyframe();
+    Payload payload;
+    REQUIRE(encoder.Encode(packets[0], payload));
+    REQUIRE(payload.GetBytes()[0] == DELTA_FLAG_KEYFRAME);
+}
+
+TEST_CASE("Test delta decoder resynchronization")
+{
+    std::vector<ControlInputPacket> packets = ControlInputs(20);
+    DeltaEncoder encoder(0);
+    DeltaDecoder decoder;
+    ControlInputPacket output{};
+
+    for (size_t i = 0; i < 5; i++)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[i], payload));
+        REQUIRE(decoder.Decode(payload, output));
+        encoder.OnAck(decoder.GetAck());
+    }
+
+    SECTION("Checksum failure")
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[5], payload));
+        uint8_t bytes[DELTA_FRAME_MAX_SIZE];
+        std::memcpy(bytes, payload.GetBytes(), payload.GetSize());
+        bytes[payload.GetSize() - 1] ^= 0x01;
+        REQUIRE_FALSE(decoder.Decode(PayloadView(bytes, payload.GetSize()), output));
+    }
+    SECTION("Unknown reference")
+    {
+        decoder.RequestKeyframe();
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[5], payload));
+        REQUIRE_FALSE(decoder.Decode(payload, output));
+    }
+    SECTION("Malformed frames")
+    {
+        const uint8_t truncated[] = {0, 5};
+        REQUIRE_FALSE(decoder.Decode(PayloadView(truncated, sizeof(truncated)), output));
+        const uint8_t unknownFlags[] = {0x80, 5, 4, 0, 0, 0, 0, 0, 0};
+        REQUIRE_FALSE(decoder.Decode(PayloadView(unknownFlags, sizeof(unknownFlags)), output));
+        // A varint running into the checksum
+        const uint8_t longVarint[] = {DELTA_FLAG_KEYFRAME, 5, 1, 0, 0, 0, 0x80, 0x80, 0x80};
+        REQUIRE_FALSE(decoder.Decode(PayloadView(longVarint, sizeof(longVarint)), output));
+    }
+
+    // The decoder asks for a keyframe and rejects deltas until it gets one
+    REQUIRE(decoder.GetAck().keyframe_request);
+    REQUIRE(decoder.GetFramesRejected() > 0);
+    encoder.OnAck(decoder.GetAck());
+    for (size_t i = 6; i < packets.size(); i++)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packets[i], payload));
+        REQUIRE(decoder.Decode(payload, output));
+        REQUIRE(SameFields(output, packets[i]));
+        encoder.OnAck(decoder.GetAck());
+    }
+    REQUIRE_FALSE(decoder.GetAck().keyframe_request);
+    REQUIRE(encoder.GetKeyframesEncoded() == 2);
+}
+
+TEST_CASE("Test sending delta encoded packets")
+{
+    FakeUART cm4;
+    FakeUART teensy;
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+
+    std::vector<ControlInputPacket> received;
+    teensy.RegisterHandler(static_cast<uint8_t>(PacketId::ControlInputDelta), [&](PayloadView &payload) {
+        ControlInputPacket packet{};
+        if (decoder.Decode(payload, packet))
+        {
+            received.push_back(packet);
+        }
+        teensy.SendPacket(decoder.GetAck());
+    });
+    cm4.On<PacketId::DeltaAck>([&](const DeltaAckPacket &ack) { encoder.OnAck(ack); });
+
+    std::vector<ControlInputPacket> packets = ControlInputs(30);
+    for (const auto &packet : packets)
+    {
+        Payload payload;
+        REQUIRE(encoder.Encode(packet, payload));
+        REQUIRE(cm4.SendUARTPacket(static_cast<uint8_t>(PacketId::ControlInputDelta), payload));
+        cm4.SendUARTPackets();
+        std::memcpy(teensy.receive_buffer, cm4.sent_bytes.data(), cm4.sent_bytes.size());
+        teensy.receive_buffer_size = cm4.sent_bytes.size();
+        cm4.sent_bytes.clear();
+        REQUIRE(teensy.ReceiveUARTPackets() == 1);
+
+        // The ack goes back before the next packet
+        teensy.SendUARTPackets();
+        std::memcpy(cm4.receive_buffer, teensy.sent_bytes.data(), teensy.sent_bytes.size());
+        cm4.receive_buffer_size = teensy.sent_bytes.size();
+        teensy.sent_bytes.clear();
+        REQUIRE(cm4.ReceiveUARTPackets() == 1);
+    }
+
+    REQUIRE(received.size() == packets.size());
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        REQUIRE(SameFields(received[i], packets[i]));
+    }
+    REQUIRE(encoder.GetKeyframesEncoded() == 1);
+}
@@ -0,0 +1,194 @@
+#include "catch.hpp"
+#include "FakeUART.h"
+#include "FramePool.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Test frame pool allocation")
+{
+    FramePool pool;
+    std::vector<FrameRef> frames;
+    for (size_t i = 0; i < FramePool::SIZE; i++)
+    {
+        FrameRef frame = pool.Allocate();
+        REQUIRE(frame);
+        REQUIRE(frame->GetSize() == 0);
+        REQUIRE(frame.UseCount() == 1);
+        frames.push_back(std::move(frame));
+    }
+    REQUIRE(pool.InUse() == FramePool::SIZE);
+
+    // Every frame is in use
+    REQUIRE_FALSE(pool.Allocate());
+    REQUIRE_FALSE(pool.Retain(frames[0].GetView()));
+    REQUIRE(pool.AllocationFailures() == 2);
+
+    // Frames go back to the pool with their last reference, and come back empty
+    frames[0]->WriteInt(1);
+    FrameRef copy = frames[0];
+    REQUIRE(copy.UseCount() == 2);
+    frames[0].Reset();
+    REQUIRE(pool.InUse() == FramePool::SIZE);
+    copy = frames[1];
+    REQUIRE(pool.InUse() == FramePool::SIZE - 1);
+    FrameRef frame = pool.Allocate();
+    REQUIRE(frame);
+    REQUIRE(frame->GetSize() == 0);
+
+    frames.clear();
+    copy.Reset();
+    frame.Reset();
+    REQUIRE(pool.InUse() == 0);
+    REQUIRE(pool.PeakInUse() == FramePool::SIZE);
+    REQUIRE(pool.AllocationFailures() == 2);
+}
+
+TEST_CASE("Test frame references")
+{
+    FramePool pool;
+    FrameRef empty;
+    REQUIRE_FALSE(empty);
+    REQUIRE(empty.UseCount() == 0);
+
+    FrameRef frame = pool.Allocate();
+    frame->WriteInt(313);
+
+    // Moving keeps the count, copying shares the frame
+    FrameRef moved = std::move(frame);
+    REQUIRE_FALSE(frame);
+    REQUIRE(moved.UseCount() == 1);
+    FrameRef shared = moved;
+    REQUIRE(shared.UseCount() == 2);
+    REQUIRE(shared.GetView().GetBytes() == moved.GetView().GetBytes());
+
+    int value = 0;
+    PayloadView view = shared;
+    REQUIRE(view.ReadInt(value));
+    REQUIRE(value == 313);
+
+    shared = shared;
+    REQUIRE(shared.UseCount() == 2);
+    moved.Reset();
+    REQUIRE(shared.UseCount() == 1);
+    REQUIRE(pool.InUse() == 1);
+}
+
+TEST_CASE("Test releasing frames from other threads")
+{
+    FramePool pool;
+    const int iterations = 20000;
+
+    // Frames taken by one thread are released by another
+    std::mutex mutex;
+    std::deque<FrameRef> queue;
+    std::atomic<bool> done(false);
+    std::thread producer([&]() {
+        for (int i = 0; i < iterations; i++)
+        {
+            FrameRef frame = pool.Allocate();
+            if (frame)
+            {
+                frame->WriteInt(i);
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(frame));
+            }
+        }
+        done = true;
+    });
+    std::thread consumer([&]() {
+        while (true)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.empty() && done)
+                break;
+            if (!queue.empty())
+                queue.pop_front();
+        }
+    });
+
+    // While other threads take and release frames on their own
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 2; i++)
+    {
+        threads.emplace_back([&pool]() {
+            for (int j = 0; j < iterations; j++)
+            {
+                FrameRef frame = pool.Allocate();
+                FrameRef copy = frame;
+            }
+        });
+    }
+    producer.join();
+    consumer.join();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(pool.InUse() == 0);
+
+    // The free list still holds every frame exactly once
+    std::vector<FrameRef> frames;
+    for (size_t i = 0; i < FramePool::SIZE; i++)
+    {
+        frames.push_back(pool.Allocate());
+        REQUIRE(frames.back());
+    }
+    REQUIRE_FALSE(pool.Allocate());
+}
+
+TEST_CASE("Test keeping received payloads and sending frames")
+{
+    FakeUART sender;
+    FakeUART receiver;
+
+    // The handler keeps the payloads past its call
+    std::vector<FrameRef> kept;
+    receiver.RegisterHandler(5, [&](PayloadView &payload) {
+        kept.push_back(receiver.GetFramePool().Retain(payload));
+    });
+
+    // The device is full, so the frames wait in their queue with their reference
+    sender.send_capacity = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        FrameRef frame = sender.GetFramePool().Allocate();
+        REQUIRE(frame);
+        uint8_t bytes[200];
+        std::fill(std::begin(bytes), std::end(bytes), static_cast<uint8_t>(i));
+        frame->WriteBytes(bytes, sizeof(bytes));
+        REQUIRE(sender.SendFrame(5, frame));
+        // Frames that fit in the send buffer are encoded right away and released
+        REQUIRE(frame.UseCount() == (i < 4 ? 1 : 2));
+    }
+    REQUIRE(sender.PendingSendFrames() == 4);
+    REQUIRE(sender.GetFramePool().InUse() == 4);
+    REQUIRE_FALSE(sender.SendFrame(5, FrameRef()));
+
+    // Sending makes room for the pending frames, in order
+    sender.send_capacity = SIZE_MAX;
+    while (sender.SendUARTPackets() > 0)
+    {
+    }
+    REQUIRE(sender.PendingSendFrames() == 0);
+    REQUIRE(sender.GetFramePool().InUse() == 0);
+
+    for (size_t start = 0; start < sender.sent_bytes.size(); start += sizeof(receiver.receive_buffer))
+    {
+        size_t size = std::min(sizeof(receiver.receive_buffer), sender.sent_bytes.size() - start);
+        std::memcpy(receiver.receive_buffer, sender.sent_bytes.data() + start, size);
+        receiver.receive_buffer_size = size;
+        receiver.ReceiveUARTPackets();
+    }
+
+    REQUIRE(kept.size() == 8);
+    REQUIRE(receiver.GetFramePool().InUse() == 8);
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        REQUIRE(kept[i]->GetSize() == 200);
+        REQUIRE(kept[i]->GetBytes()[0] == i);
+        REQUIRE(kept[i]->GetBytes()[199] == i);
+    }
+}
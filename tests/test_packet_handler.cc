@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include "PacketHandler.h"
+#include "Payload.h"
+#include <memory>
+
+static int functionCalls = 0;
+static void countingHandler(PayloadView &payload)
+{
+    functionCalls++;
+}
+
+TEST_CASE("Test packet handlers")
+{
+    Payload bytes;
+    bytes.WriteInt(313);
+    PayloadView payload = bytes.GetView();
+    PacketHandler handler;
+    REQUIRE_FALSE(handler);
+
+    // Function
+    functionCalls = 0;
+    handler.Set(countingHandler);
+    REQUIRE(handler);
+    handler(payload);
+    REQUIRE(functionCalls == 1);
+
+    // Lambda with captures, replacing the function
+    int calls = 0;
+    size_t size = 0;
+    handler.Set([&calls, &size](PayloadView &payload) {
+        calls++;
+        size = payload.GetSize();
+    });
+    handler(payload);
+    REQUIRE(calls == 1);
+    REQUIRE(size == 4);
+    REQUIRE(functionCalls == 1);
+
+    handler.Reset();
+    REQUIRE_FALSE(handler);
+}
+
+TEST_CASE("Test packet handlers release their captures")
+{
+    auto state = std::make_shared<int>(0);
+    {
+        PacketHandler handler;
+        handler.Set([state](PayloadView &payload) { (*state)++; });
+        REQUIRE(state.use_count() == 2);
+
+        PayloadView payload(nullptr, 0);
+        handler(payload);
+        REQUIRE(*state == 1);
+
+        // Replacing the handler releases the previous one
+        handler.Set([state](PayloadView &payload) { (*state) += 10; });
+        REQUIRE(state.use_count() == 2);
+        handler(payload);
+        REQUIRE(*state == 11);
+    }
+    REQUIRE(state.use_count() == 1);
+}
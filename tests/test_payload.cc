@@ -0,0 +1,233 @@
+#include "catch.hpp"
+#include "PacketRegistry.h"
+#include "Payload.h"
+#include <cmath>
+#include <cstring>
+
+TEST_CASE("Test payload capacity")
+{
+    BasicPayload<10> payload;
+    REQUIRE(payload.WriteDouble(1.5));
+    REQUIRE(payload.WriteBool(true));
+    REQUIRE(payload.WriteBool(false));
+    REQUIRE(!payload.WriteBool(true));
+    REQUIRE(!payload.WriteInt(1));
+    REQUIRE(payload.GetSize() == 10);
+
+    uint8_t bytes[11] = {};
+    REQUIRE(!payload.SetBytes(bytes, sizeof(bytes)));
+    REQUIRE(payload.SetBytes(bytes, 10));
+
+    // The default payload fits the biggest packet the length field allows
+    REQUIRE(Payload::MAX_SIZE == UINT8_MAX);
+}
+
+TEST_CASE("Test payloads sized to their packet")
+{
+    // Only the bytes of the packet and the bookkeeping take up space
+    REQUIRE(sizeof(BasicPayload<PacketTraits<ControlOutputPacket>::MAX_SIZE>) <= 40 + 2 * sizeof(size_t));
+
+    ControlInputPacket input{};
+    input.armed = true;
+    input.timestamp = 2.5;
+    input.desired_state.pos.x = 1.0;
+    input.setpointSelection.rateSPActive[2] = true;
+    input.inline_thrust = 0.75;
+
+    BasicPayload<PacketTraits<ControlInputPacket>::MAX_SIZE> payload;
+    REQUIRE(PacketTraits<ControlInputPacket>::Write(payload, input));
+    REQUIRE(payload.GetSize() == PacketTraits<ControlInputPacket>::MAX_SIZE);
+    REQUIRE(!payload.WriteBool(true));
+
+    ControlInputPacket output{};
+    REQUIRE(payload.ReadControlInputPacket(output));
+    REQUIRE(output.armed);
+    REQUIRE(output.timestamp == 2.5);
+    REQUIRE(output.desired_state.pos.x == 1.0);
+    REQUIRE(output.setpointSelection.rateSPActive[2]);
+    REQUIRE(!output.setpointSelection.rateSPActive[1]);
+    REQUIRE(output.inline_thrust == 0.75);
+}
+
+TEST_CASE("Test copying payloads")
+{
+    Payload payload;
+    payload.WriteInt(313);
+    payload.WriteFloat(2.5f);
+    int intValue = 0;
+    REQUIRE(payload.ReadInt(intValue));
+
+    // Copies keep the bytes and the read position
+    Payload copy(payload);
+    REQUIRE(copy.GetSize() == payload.GetSize());
+    REQUIRE(copy.GetReadPosition() == payload.GetReadPosition());
+    float floatValue = 0;
+    REQUIRE(copy.ReadFloat(floatValue));
+    REQUIRE(floatValue == 2.5f);
+
+    // The copy is independent of the original
+    copy.Clear();
+    copy.WriteInt(7);
+    payload.ResetReadPosition();
+    REQUIRE(payload.ReadInt(intValue));
+    REQUIRE(intValue == 313);
+
+    payload = copy;
+    REQUIRE(payload.GetSize() == sizeof(int));
+    REQUIRE(payload.ReadInt(intValue));
+    REQUIRE(intValue == 7);
+    REQUIRE(!payload.ReadInt(intValue));
+}
+
+TEST_CASE("Test generated packet codecs")
+{
+    ControlInputPacket input{};
+    input.armed = true;
+    input.timestamp = 12.5;
+    input.desired_state.att.z = -1.25;
+    input.current_state.rate.x = 3.0;
+    input.setpointSelection = ATTITUDE_CONTROL_YAW_RATE_SELECTION;
+    input.inline_thrust = 0.5;
+
+    // The fields are laid out one after the other, as the schema says
+    uint8_t bytes[CONTROL_INPUT_PACKET_MAX_SIZE];
+    REQUIRE(EncodedSize(input) == CONTROL_INPUT_PACKET_MAX_SIZE);
+    REQUIRE(EncodePacket(input, bytes, sizeof(bytes)) == sizeof(bytes));
+    REQUIRE(bytes[0] == 1);
+    double value = 0;
+    std::memcpy(&value, bytes + 1, sizeof(value));
+    REQUIRE(value == 12.5);
+    std::memcpy(&value, bytes + 9 + 8 * 8, sizeof(value));
+    REQUIRE(value == -1.25);
+    std::memcpy(&value, bytes + 9 + STATE_WIRE_SIZE + 9 * 8, sizeof(value));
+    REQUIRE(value == 3.0);
+    REQUIRE(bytes[9 + 2 * STATE_WIRE_SIZE] == 0xC0);
+    REQUIRE(bytes[9 + 2 * STATE_WIRE_SIZE + 1] == 0x08);
+    std::memcpy(&value, bytes + 9 + 2 * STATE_WIRE_SIZE + SETPOINT_SELECTION_WIRE_SIZE, sizeof(value));
+    REQUIRE(value == 0.5);
+
+    // Nothing is written when the packet does not fit
+    REQUIRE(EncodePacket(input, bytes, sizeof(bytes) - 1) == 0);
+
+    ControlInputPacket output{};
+    REQUIRE(DecodePacket(bytes, sizeof(bytes), output) == sizeof(bytes));
+    REQUIRE(output.desired_state.att.z == -1.25);
+    REQUIRE(output.current_state.rate.x == 3.0);
+    REQUIRE(output.setpointSelection.attSPActive[1]);
+    REQUIRE_FALSE(output.setpointSelection.attSPActive[2]);
+    REQUIRE(output.setpointSelection.rateSPActive[2]);
+
+    // Armed packets are checked for the armed section too
+    REQUIRE(DecodePacket(bytes, CONTROL_INPUT_PACKET_MIN_SIZE, output) == 0);
+    REQUIRE(DecodePacket(bytes, sizeof(bytes) - 1, output) == 0);
+
+    // Disarmed packets stop after the timestamp
+    input.armed = false;
+    REQUIRE(EncodePacket(input, bytes, sizeof(bytes)) == CONTROL_INPUT_PACKET_MIN_SIZE);
+    REQUIRE(DecodePacket(bytes, CONTROL_INPUT_PACKET_MIN_SIZE, output) == CONTROL_INPUT_PACKET_MIN_SIZE);
+    REQUIRE_FALSE(output.armed);
+    REQUIRE(DecodePacket(bytes, CONTROL_INPUT_PACKET_MIN_SIZE - 1, output) == 0);
+
+    REQUIRE(PacketTraits<ControlInputPacket>::MAX_SIZE == CONTROL_INPUT_PACKET_MAX_SIZE);
+    REQUIRE(PacketTraits<ControlOutputPacket>::MAX_SIZE == CONTROL_OUTPUT_PACKET_MAX_SIZE);
+}
+
+TEST_CASE("Test writing structs with a single size check")
+{
+    static_assert(WireFormat<Vec3>::SIZE == 3 * sizeof(double), "Vec3 is 3 doubles");
+    static_assert(WireFormat<State>::SIZE == 4 * WireFormat<Vec3>::SIZE, "State is 4 Vec3");
+    static_assert(WireFormat<SetpointSelection>::SIZE == 2, "SetpointSelection is packed into 2 bytes");
+    static_assert(WireFormat<ControlInputPacket>::MIN_SIZE == 1 + sizeof(double), "Disarmed is armed and timestamp");
+    static_assert(WireFormat<ControlOutputPacket>::MAX_SIZE == 5 * sizeof(double), "ControlOutput is 5 doubles");
+
+    State state;
+    state.pos = Vec3(1.0, 2.0, 3.0);
+    state.rate = Vec3(-4.0, -5.0, -6.0);
+
+    // A struct that does not fit is not written at all, rather than in part
+    BasicPayload<WireFormat<State>::SIZE + 4> payload;
+    REQUIRE(payload.WriteInt(1));
+    REQUIRE(payload.WriteInt(2));
+    REQUIRE_FALSE(payload.WriteState(state));
+    REQUIRE(payload.GetSize() == 2 * sizeof(int));
+
+    payload.Clear();
+    REQUIRE(payload.WriteState(state));
+    REQUIRE(payload.GetSize() == WireFormat<State>::SIZE);
+    REQUIRE_FALSE(payload.WriteVec3(state.pos));
+    REQUIRE(payload.GetSize() == WireFormat<State>::SIZE);
+
+    State read;
+    REQUIRE(payload.ReadState(read));
+    REQUIRE(read.pos.y == 2.0);
+    REQUIRE(read.rate.z == -6.0);
+
+    // Reading past the end fails without moving the read position
+    PayloadView view(payload.GetBytes(), WireFormat<State>::SIZE - 1);
+    REQUIRE_FALSE(view.ReadState(read));
+    REQUIRE(view.GetReadPosition() == 0);
+    REQUIRE(view.ReadVec3(read.vel));
+    REQUIRE(view.GetReadPosition() == WireFormat<Vec3>::SIZE);
+}
+
+TEST_CASE("Test compact packet codecs")
+{
+    static_assert(STATE_COMPACT_WIRE_SIZE == 6 * sizeof(float) + 6 * sizeof(int16_t), "pos and vel as float");
+    static_assert(CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE * 2 < CONTROL_INPUT_PACKET_MAX_SIZE, "Less than half");
+    static_assert(CONTROL_OUTPUT_PACKET_COMPACT_MAX_SIZE * 2 == CONTROL_OUTPUT_PACKET_MAX_SIZE, "Half");
+
+    ControlInputPacket input{};
+    input.armed = true;
+    input.timestamp = 3600123.4567; // An hour in ms
+    input.desired_state.pos = Vec3(12.345678, -0.5, 100.25);
+    input.desired_state.vel = Vec3(0.1, 0.2, -0.3);
+    input.desired_state.att = Vec3(3.14159, -1.2345678, 0.0);
+    input.current_state.rate = Vec3(-31.5, 7.77777, 0.00049);
+    input.current_state.att = Vec3(4.0, 0.0, 0.0); // Beyond +-3.2767 rad
+    input.setpointSelection = ATTITUDE_CONTROL_YAW_RATE_SELECTION;
+    input.inline_thrust = 0.123456789;
+
+    Payload payload;
+    REQUIRE(payload.WritePacket(input, WireEncoding::COMPACT));
+    REQUIRE(payload.GetSize() == CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE);
+    REQUIRE(payload.GetSize() == CompactEncodedSize(input));
+
+    // Within the documented precision of each quantization
+    ControlInputPacket output{};
+    REQUIRE(payload.ReadPacket(output, WireEncoding::COMPACT));
+    REQUIRE(payload.GetReadPosition() == payload.GetSize());
+    REQUIRE(output.armed);
+    REQUIRE(std::fabs(output.timestamp - input.timestamp) <= 0.0005);
+    REQUIRE(output.desired_state.pos.x == Approx(12.345678).epsilon(1e-7));
+    REQUIRE(output.desired_state.pos.z == 100.25);
+    REQUIRE(output.desired_state.vel.z == Approx(-0.3).epsilon(1e-7));
+    REQUIRE(std::fabs(output.desired_state.att.x - 3.14159) <= 0.00005);
+    REQUIRE(std::fabs(output.desired_state.att.y + 1.2345678) <= 0.00005);
+    REQUIRE(std::fabs(output.current_state.rate.x + 31.5) <= 0.0005);
+    REQUIRE(std::fabs(output.current_state.rate.y - 7.77777) <= 0.0005);
+    REQUIRE(output.current_state.rate.z == 0.0);
+    REQUIRE(output.current_state.att.x == Approx(3.2767));
+    REQUIRE(output.setpointSelection.attSPActive[1]);
+    REQUIRE(output.setpointSelection.rateSPActive[2]);
+    REQUIRE(output.inline_thrust == Approx(0.123456789).epsilon(1e-7));
+
+    // Sizes are checked like the full encoding
+    uint8_t bytes[CONTROL_INPUT_PACKET_COMPACT_MAX_SIZE];
+    REQUIRE(EncodeCompactPacket(input, bytes, sizeof(bytes) - 1) == 0);
+    REQUIRE(EncodeCompactPacket(input, bytes, sizeof(bytes)) == sizeof(bytes));
+    REQUIRE(DecodeCompactPacket(bytes, sizeof(bytes) - 1, output) == 0);
+    input.armed = false;
+    REQUIRE(EncodeCompactPacket(input, bytes, sizeof(bytes)) == CONTROL_INPUT_PACKET_COMPACT_MIN_SIZE);
+    REQUIRE(DecodeCompactPacket(bytes, CONTROL_INPUT_PACKET_COMPACT_MIN_SIZE - 1, output) == 0);
+
+    ControlOutputPacket controlOutput{5.0, 1.5, -2.5, 0.5, 0.1};
+    payload.Clear();
+    REQUIRE(PacketTraits<ControlOutputPacket>::Write(payload, controlOutput, WireEncoding::COMPACT));
+    REQUIRE(payload.GetSize() == CONTROL_OUTPUT_PACKET_COMPACT_MAX_SIZE);
+    ControlOutputPacket readOutput{};
+    PayloadView view = payload;
+    REQUIRE(PacketTraits<ControlOutputPacket>::Read(view, readOutput, WireEncoding::COMPACT));
+    REQUIRE(readOutput.timestamp == 5.0);
+    REQUIRE(readOutput.d2 == -2.5);
+    REQUIRE(readOutput.throttle_diff == Approx(0.1).epsilon(1e-7));
+}
@@ -0,0 +1,124 @@
+#include "catch.hpp"
+#include "Quantize.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+TEST_CASE("Test quantizing doubles to float")
+{
+    const double values[] = {0.0, -1.5, 3.14159265358979, 1e-3, 123456.789, -9.81, 1e40};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint8_t encoded[count * sizeof(float)];
+    REQUIRE(EncodeDoublesAsFloat(encoded, values, count) == encoded + sizeof(encoded));
+
+    double decoded[count];
+    REQUIRE(DecodeDoublesAsFloat(encoded, decoded, count) == encoded + sizeof(encoded));
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        // Rounded to the nearest float
+        REQUIRE(decoded[i] == static_cast<float>(values[i]));
+        REQUIRE(std::fabs(decoded[i] - values[i]) <= std::fabs(values[i]) * std::ldexp(1.0, -24));
+    }
+    // Beyond the range of floats
+    REQUIRE(std::isinf(decoded[count - 1]));
+}
+
+TEST_CASE("Test quantizing doubles to int16")
+{
+    const double step = 0.001;
+    const double values[] = {0.0, 1.0, -1.0, 0.0004, 0.0006, -0.0006, 32.767, 40.0, -40.0,
+                             std::numeric_limits<double>::quiet_NaN()};
+    const int16_t expected[] = {0, 1000, -1000, 0, 1, -1, 32767, 32767, -32767, 0};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint8_t encoded[count * sizeof(int16_t)];
+    REQUIRE(EncodeDoublesAsInt16(encoded, values, count, step) == encoded + sizeof(encoded));
+    int16_t steps[count];
+    std::memcpy(steps, encoded, sizeof(encoded));
+    for (size_t i = 0; i < count; i++)
+    {
+        REQUIRE(steps[i] == expected[i]);
+    }
+
+    double decoded[count];
+    REQUIRE(DecodeDoublesAsInt16(encoded, decoded, count, step) == encoded + sizeof(encoded));
+    // Within half a step inside the range, saturated outside
+    for (size_t i = 0; i < 7; i++)
+    {
+        REQUIRE(std::fabs(decoded[i] - values[i]) <= step / 2 + 1e-12);
+    }
+    REQUIRE(decoded[7] == Approx(32.767));
+    REQUIRE(decoded[8] == Approx(-32.767));
+    REQUIRE(decoded[9] == 0);
+}
+
+TEST_CASE("Test quantizing kernels against the scalar versions")
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> distribution(-50.0, 50.0);
+    for (size_t count = 0; count < 40; count++)
+    {
+        // Unaligned doubles, as in a packed struct
+        std::vector<uint8_t> values(count * sizeof(double) + 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            double value = distribution(rng);
+            std::memcpy(values.data() + 1 + i * sizeof(double), &value, sizeof(value));
+        }
+
+        std::vector<uint8_t> encoded(count * sizeof(float) + 1);
+        std::vector<uint8_t> expected(count * sizeof(float) + 1);
+        REQUIRE(EncodeDoublesAsFloat(encoded.data() + 1, values.data() + 1, count) ==
+                encoded.data() + 1 + count * sizeof(float));
+        EncodeDoublesAsFloatScalar(expected.data() + 1, values.data() + 1, count);
+        REQUIRE(encoded == expected);
+
+        std::vector<uint8_t> decoded(values.size());
+        std::vector<uint8_t> expectedDecoded(values.size());
+        DecodeDoublesAsFloat(encoded.data() + 1, decoded.data() + 1, count);
+        DecodeDoublesAsFloatScalar(encoded.data() + 1, expectedDecoded.data() + 1, count);
+        REQUIRE(decoded == expectedDecoded);
+
+        // Both within and beyond the +-32767 steps
+        for (double step : {0.001, 0.0001})
+        {
+            encoded.assign(count * sizeof(int16_t) + 1, 0);
+            expected.assign(count * sizeof(int16_t) + 1, 0);
+            REQUIRE(EncodeDoublesAsInt16(encoded.data() + 1, values.data() + 1, count, step) ==
+                    encoded.data() + 1 + count * sizeof(int16_t));
+            EncodeDoublesAsInt16Scalar(expected.data() + 1, values.data() + 1, count, step);
+            REQUIRE(encoded == expected);
+
+            DecodeDoublesAsInt16(encoded.data() + 1, decoded.data() + 1, count, step);
+            DecodeDoublesAsInt16Scalar(encoded.data() + 1, expectedDecoded.data() + 1, count, step);
+            REQUIRE(decoded == expectedDecoded);
+        }
+    }
+}
+
+TEST_CASE("Test quantizing doubles to uint32")
+{
+    uint8_t encoded[sizeof(uint32_t)];
+    uint32_t steps;
+    double decoded;
+
+    // A timestamp in ms sent in us
+    REQUIRE(EncodeDoubleAsUint32(encoded, 1234.5678, 0.001) == encoded + sizeof(encoded));
+    std::memcpy(&steps, encoded, sizeof(steps));
+    REQUIRE(steps == 1234568);
+    REQUIRE(DecodeDoubleAsUint32(encoded, decoded, 0.001) == encoded + sizeof(encoded));
+    REQUIRE(std::fabs(decoded - 1234.5678) <= 0.0005);
+
+    // Wrapped modulo 2^32 steps
+    EncodeDoubleAsUint32(encoded, 4294967296.0 * 0.001 + 1.0, 0.001);
+    std::memcpy(&steps, encoded, sizeof(steps));
+    REQUIRE(steps == 1000);
+    EncodeDoubleAsUint32(encoded, -0.001, 0.001);
+    std::memcpy(&steps, encoded, sizeof(steps));
+    REQUIRE(steps == UINT32_MAX);
+
+    EncodeDoubleAsUint32(encoded, std::numeric_limits<double>::infinity(), 0.001);
+    std::memcpy(&steps, encoded, sizeof(steps));
+    REQUIRE(steps == 0);
+}
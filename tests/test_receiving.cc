@@ -1,6 +1,9 @@
 #include "catch.hpp"
-#include "UART.h"
+#include "ByteStuffing.h"
+#include "FakeUART.h"
 #include <cstring>
+#include <random>
+#include <vector>
 
 int intReceived;
 float floatReceived;
@@ -8,68 +11,29 @@ bool boolReceived;
 uint8_t rawReceived[4];
 
 // Handler to test receiving an integer
-void intHandler(Payload &payload)
+void intHandler(PayloadView &payload)
 {
-    intReceived = payload.ReadInt();
+    payload.ReadInt(intReceived);
 }
 
 // Handler to test receiving a float
-void floatHandler(Payload &payload)
+void floatHandler(PayloadView &payload)
 {
-    floatReceived = payload.ReadFloat();
+    payload.ReadFloat(floatReceived);
 }
 
 // Handler to test receiving a bool
-void boolHandler(Payload &payload)
+void boolHandler(PayloadView &payload)
 {
-    boolReceived = payload.ReadBool();
+    payload.ReadBool(boolReceived);
 }
 
 // Handler to test receiving raw bytes
-void rawHandler(Payload &payload)
+void rawHandler(PayloadView &payload)
 {
     payload.ReadBytes(rawReceived, 4);
 }
 
-// Fake UART class for testing
-class FakeUART : public UART
-{
-  public:
-    FakeUART() : UART() {}
-
-    uint8_t send_buffer[1024];
-    size_t send_buffer_size = 0;
-    size_t Send(const uint8_t *data, const size_t data_size) override
-    {
-        if (data_size > sizeof(send_buffer))
-        {
-            throw std::runtime_error("Packet too big for send buffer");
-        }
-        std::memcpy(send_buffer, data, data_size);
-        send_buffer_size = data_size;
-        return data_size;
-    }
-
-    uint8_t receive_buffer[1024];
-    size_t receive_buffer_size = 0;
-    size_t Receive(uint8_t *data, const size_t data_size) override
-    {
-        if (receive_buffer_size > data_size)
-        {
-            throw std::runtime_error("Receive buffer too small");
-        }
-        std::memcpy(data, receive_buffer, receive_buffer_size);
-        return receive_buffer_size;
-    }
-
-    const char *log_message;
-    void Log(LOG_LEVEL level, const char *message) override
-    {
-        // std::cout << message << std::endl;
-        log_message = message;
-    }
-};
-
 TEST_CASE("Test receiving integer packets")
 {
     FakeUART uart;
@@ -82,7 +46,7 @@ TEST_CASE("Test receiving integer packets")
     uint8_t packet[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x3f, END_BYTE};
     uart.receive_buffer_size = sizeof(packet);
     std::memcpy(uart.receive_buffer, packet, sizeof(packet));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == 313);
 
     // Test receiving another packet with an integer
@@ -90,7 +54,7 @@ TEST_CASE("Test receiving integer packets")
     uint8_t packet1[] = {START_BYTE, 0x01, 0x04, 0x38, 0x01, 0x00, 0x00, 0x3e, END_BYTE};
     uart.receive_buffer_size = sizeof(packet1);
     std::memcpy(uart.receive_buffer, packet1, sizeof(packet1));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == 312);
 }
 
@@ -106,7 +70,7 @@ TEST_CASE("Test receiving float packets")
     uint8_t packet2[] = {START_BYTE, 0x02, 0x04, 0xda, 0x0f, 0x49, 0x40, 0x78, END_BYTE};
     uart.receive_buffer_size = sizeof(packet2);
     std::memcpy(uart.receive_buffer, packet2, sizeof(packet2));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
 
     // Fix for the float comparison - use separate tests instead of chained expressions
     const float expectedValue = 3.14159f;
@@ -127,7 +91,7 @@ TEST_CASE("Test receiving boolean packets")
     uint8_t packet3[] = {START_BYTE, 0x03, 0x01, 0x01, 0x05, END_BYTE};
     uart.receive_buffer_size = sizeof(packet3);
     std::memcpy(uart.receive_buffer, packet3, sizeof(packet3));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(boolReceived == true);
 }
 
@@ -143,7 +107,7 @@ TEST_CASE("Test receiving raw byte packets")
     uint8_t packet4[] = {START_BYTE, 0x04, 0x04, 0x01, 0x02, 0x03, 0x04, 0x12, END_BYTE};
     uart.receive_buffer_size = sizeof(packet4);
     std::memcpy(uart.receive_buffer, packet4, sizeof(packet4));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(rawReceived[0] == 1);
     REQUIRE(rawReceived[1] == 2);
     REQUIRE(rawReceived[2] == 3);
@@ -168,7 +132,7 @@ TEST_CASE("Test noise rejection")
                          START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x3f, END_BYTE, 0x33};
     uart.receive_buffer_size = sizeof(packet5);
     std::memcpy(uart.receive_buffer, packet5, sizeof(packet5));
-    REQUIRE(uart.Update() == 2);
+    REQUIRE(uart.ReceiveUARTPackets() == 2);
     REQUIRE(intReceived == 313);
     REQUIRE(boolReceived == false);
 }
@@ -188,14 +152,100 @@ TEST_CASE("Test receiving packets in chunks")
 
     uart.receive_buffer_size = sizeof(packet6a);
     std::memcpy(uart.receive_buffer, packet6a, sizeof(packet6a));
-    REQUIRE(uart.Update() == 0);
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
 
     uart.receive_buffer_size = sizeof(packet6b);
     std::memcpy(uart.receive_buffer, packet6b, sizeof(packet6b));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == 313);
 }
 
+TEST_CASE("Test receiving packets one byte at a time")
+{
+    FakeUART uart;
+    uart.RegisterHandler(1, intHandler);
+    uart.RegisterHandler(2, floatHandler);
+    uart.RegisterHandler(3, boolHandler);
+    uart.RegisterHandler(4, rawHandler);
+
+    // The escape sequence is split between two reads
+    intReceived = 0;
+    uint8_t packet[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, START_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x83, END_BYTE};
+    int packetsReceived = 0;
+    for (size_t i = 0; i < sizeof(packet); i++)
+    {
+        uart.receive_buffer_size = 1;
+        uart.receive_buffer[0] = packet[i];
+        packetsReceived += uart.ReceiveUARTPackets();
+    }
+    REQUIRE(packetsReceived == 1);
+    REQUIRE(intReceived == (int)START_BYTE);
+}
+
+TEST_CASE("Test receiving random packets in random chunks")
+{
+    FakeUART uart;
+    bool mirrored = GENERATE(false, true);
+    UART::Framing framing = GENERATE(UART::Framing::ESCAPE, UART::Framing::COBS);
+    REQUIRE(uart.SetFraming(framing));
+    // After the framing, which leaves the COBS decoder waiting for the ID of the first frame
+    if (mirrored)
+    {
+        REQUIRE(uart.UseMirroredBuffers());
+    }
+    std::vector<std::vector<uint8_t>> received;
+    uart.RegisterHandler(5, [&](PayloadView &payload) {
+        received.emplace_back(payload.GetBytes(), payload.GetBytes() + payload.GetSize());
+    });
+
+    // Build a stream of packets with random payloads, heavy in bytes that need stuffing
+    std::mt19937 rng(42);
+    std::vector<std::vector<uint8_t>> sent;
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < 100; i++)
+    {
+        std::vector<uint8_t> payload(rng() % 256);
+        for (auto &b : payload)
+            b = (rng() % 4 == 0) ? START_BYTE - 1 + rng() % 3 : rng();
+        sent.push_back(payload);
+
+        std::vector<uint8_t> frame = {0x05, static_cast<uint8_t>(payload.size())};
+        frame.insert(frame.end(), payload.begin(), payload.end());
+        uint8_t checksum = 0;
+        for (uint8_t b : frame)
+            checksum += b;
+        frame.push_back(checksum);
+
+        if (framing == UART::Framing::COBS)
+        {
+            std::vector<uint8_t> encoded(CobsMaxEncodedSize(frame.size()));
+            encoded.resize(CobsEncode(frame.data(), frame.size(), encoded.data()));
+            stream.insert(stream.end(), encoded.begin(), encoded.end());
+            stream.push_back(COBS_DELIMITER);
+        }
+        else
+        {
+            std::vector<uint8_t> stuffed(2 * frame.size());
+            stuffed.resize(StuffBytes(frame.data(), frame.size(), stuffed.data()));
+            stream.push_back(START_BYTE);
+            stream.insert(stream.end(), stuffed.begin(), stuffed.end());
+            stream.push_back(END_BYTE);
+        }
+    }
+
+    int packetsReceived = 0;
+    size_t position = 0;
+    while (position < stream.size())
+    {
+        uart.receive_buffer_size = std::min<size_t>(1 + rng() % sizeof(uart.receive_buffer), stream.size() - position);
+        std::memcpy(uart.receive_buffer, stream.data() + position, uart.receive_buffer_size);
+        position += uart.receive_buffer_size;
+        packetsReceived += uart.ReceiveUARTPackets();
+    }
+    REQUIRE(packetsReceived == 100);
+    REQUIRE(received == sent);
+}
+
 TEST_CASE("Test error handling")
 {
     FakeUART uart;
@@ -208,15 +258,15 @@ TEST_CASE("Test error handling")
     uint8_t packet7[] = {START_BYTE, 0xFF, 0x01, 0x01, 0x05, END_BYTE};
     uart.receive_buffer_size = sizeof(packet7);
     std::memcpy(uart.receive_buffer, packet7, sizeof(packet7));
-    REQUIRE(uart.Update() == 0);
-    REQUIRE(std::strcmp(uart.log_message, "Invalid packet ID received") == 0);
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+    REQUIRE(uart.log_message == "Invalid packet ID received");
 
     // Test invalid checksum
     uint8_t packet8[] = {START_BYTE, 0x03, 0x01, 0x01, 0xFF, END_BYTE};
     uart.receive_buffer_size = sizeof(packet8);
     std::memcpy(uart.receive_buffer, packet8, sizeof(packet8));
-    REQUIRE(uart.Update() == 0);
-    REQUIRE(std::strcmp(uart.log_message, "Invalid checksum received") == 0);
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+    REQUIRE(uart.log_message == "Invalid checksum received");
 }
 
 TEST_CASE("Test byte unstuffing")
@@ -232,7 +282,7 @@ TEST_CASE("Test byte unstuffing")
     uint8_t packet1[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, START_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x83, END_BYTE};
     uart.receive_buffer_size = sizeof(packet1);
     std::memcpy(uart.receive_buffer, packet1, sizeof(packet1));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == (int)START_BYTE);
 
     // Test end byte unstuffing
@@ -240,7 +290,7 @@ TEST_CASE("Test byte unstuffing")
     uint8_t packet2[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, END_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x84, END_BYTE};
     uart.receive_buffer_size = sizeof(packet2);
     std::memcpy(uart.receive_buffer, packet2, sizeof(packet2));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == (int)END_BYTE);
 
     // Test escape byte unstuffing
@@ -248,16 +298,259 @@ TEST_CASE("Test byte unstuffing")
     uint8_t packet3[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, ESCAPE_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x82, END_BYTE};
     uart.receive_buffer_size = sizeof(packet3);
     std::memcpy(uart.receive_buffer, packet3, sizeof(packet3));
-    REQUIRE(uart.Update() == 1);
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
     REQUIRE(intReceived == (int)ESCAPE_BYTE);
 }
 
+TEST_CASE("Test resynchronization on start bytes")
+{
+    FakeUART uart;
+    uart.RegisterHandler(1, intHandler);
+    uart.RegisterHandler(2, floatHandler);
+    uart.RegisterHandler(3, boolHandler);
+    uart.RegisterHandler(4, rawHandler);
+
+    // A truncated frame is abandoned as soon as the next start byte shows up
+    intReceived = 0;
+    uint8_t packet1[] = {START_BYTE, 0x01, 0x04, 0x39, START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x3f, END_BYTE};
+    uart.receive_buffer_size = sizeof(packet1);
+    std::memcpy(uart.receive_buffer, packet1, sizeof(packet1));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+
+    // A run of start bytes followed by a valid packet
+    intReceived = 0;
+    uint8_t packet2[64];
+    std::memset(packet2, START_BYTE, sizeof(packet2));
+    uint8_t valid[] = {START_BYTE, 0x01, 0x04, 0x38, 0x01, 0x00, 0x00, 0x3e, END_BYTE};
+    std::memcpy(packet2 + sizeof(packet2) - sizeof(valid), valid, sizeof(valid));
+    uart.receive_buffer_size = sizeof(packet2);
+    std::memcpy(uart.receive_buffer, packet2, sizeof(packet2));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 312);
+
+    // A start byte in place of the end byte begins the next frame
+    boolReceived = false;
+    uint8_t packet3[] = {START_BYTE, 0x03, 0x01, 0x01, 0x05, START_BYTE, 0x03, 0x01, 0x01, 0x05, END_BYTE};
+    uart.receive_buffer_size = sizeof(packet3);
+    std::memcpy(uart.receive_buffer, packet3, sizeof(packet3));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(boolReceived == true);
+
+    // An escaped start byte is never a valid escape sequence
+    intReceived = 0;
+    uint8_t packet4[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x3f, END_BYTE};
+    uart.receive_buffer_size = sizeof(packet4);
+    std::memcpy(uart.receive_buffer, packet4, sizeof(packet4));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+}
+
+TEST_CASE("Test payload views")
+{
+    Payload payload;
+    payload.WriteInt(313);
+    payload.WriteDouble(2.5);
+    payload.WriteBool(true);
+
+    // A view reads the bytes in place
+    PayloadView view = payload.GetView();
+    REQUIRE(view.GetBytes() == payload.GetBytes());
+    REQUIRE(view.GetSize() == payload.GetSize());
+    int i;
+    double d;
+    bool b;
+    REQUIRE(view.ReadInt(i));
+    REQUIRE(view.ReadDouble(d));
+    REQUIRE(view.ReadBool(b));
+    REQUIRE(i == 313);
+    REQUIRE(d == 2.5);
+    REQUIRE(b);
+    REQUIRE_FALSE(view.ReadBool(b));
+
+    // Views start at the read position of the payload, which keeps its own
+    REQUIRE(payload.ReadInt(i));
+    PayloadView rest = payload.GetView();
+    REQUIRE(rest.GetReadPosition() == sizeof(int));
+    REQUIRE(rest.ReadDouble(d));
+    REQUIRE(d == 2.5);
+    REQUIRE(payload.GetReadPosition() == sizeof(int));
+    REQUIRE(payload.ReadDouble(d));
+    REQUIRE(payload.ReadBool(b));
+    REQUIRE_FALSE(payload.ReadBool(b));
+}
+
+TEST_CASE("Test receiving packets with a CRC")
+{
+    FakeUART uart;
+    uart.RegisterHandler(1, intHandler);
+
+    // Two swapped bytes go unnoticed by the checksum
+    intReceived = 0;
+    uint8_t swapped[] = {START_BYTE, 0x01, 0x04, 0x01, 0x39, 0x00, 0x00, 0x3f, END_BYTE};
+    uart.receive_buffer_size = sizeof(swapped);
+    std::memcpy(uart.receive_buffer, swapped, sizeof(swapped));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 0x3901);
+
+    REQUIRE(uart.SetIntegrity(UART::Integrity::CRC16));
+    intReceived = 0;
+    uint8_t packet1[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x18, 0x2a, END_BYTE};
+    uart.receive_buffer_size = sizeof(packet1);
+    std::memcpy(uart.receive_buffer, packet1, sizeof(packet1));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+
+    // But not by the CRC
+    uint8_t swapped1[] = {START_BYTE, 0x01, 0x04, 0x01, 0x39, 0x00, 0x00, 0x18, 0x2a, END_BYTE};
+    uart.receive_buffer_size = sizeof(swapped1);
+    std::memcpy(uart.receive_buffer, swapped1, sizeof(swapped1));
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+    REQUIRE(uart.log_message == "Invalid checksum received");
+
+    REQUIRE(uart.SetIntegrity(UART::Integrity::CRC32C));
+    intReceived = 0;
+    uint8_t packet2[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0xb5, 0x57, 0x5e, 0xe8, END_BYTE};
+    uart.receive_buffer_size = sizeof(packet2);
+    std::memcpy(uart.receive_buffer, packet2, sizeof(packet2));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+
+    // A CRC cut short by the end byte
+    uint8_t truncated[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0xb5, 0x57, END_BYTE};
+    uart.receive_buffer_size = sizeof(truncated);
+    std::memcpy(uart.receive_buffer, truncated, sizeof(truncated));
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+}
+
+TEST_CASE("Test receiving COBS packets")
+{
+    FakeUART uart;
+    uart.RegisterHandler(1, intHandler);
+    REQUIRE(uart.SetFraming(UART::Framing::COBS));
+
+    // The packet of 313 has two zero bytes in its payload
+    intReceived = 0;
+    uint8_t packet1[] = {0x05, 0x01, 0x04, 0x39, 0x01, 0x01, 0x02, 0x3f, COBS_DELIMITER};
+    uart.receive_buffer_size = sizeof(packet1);
+    std::memcpy(uart.receive_buffer, packet1, sizeof(packet1));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+
+    // A truncated packet is abandoned at the delimiter, and the next one is received
+    intReceived = 0;
+    uint8_t packet2[] = {0x05, 0x01, 0x04, 0x39, COBS_DELIMITER, 0x05, 0x01, 0x04, 0x38, 0x01, 0x01, 0x02, 0x3e,
+                         COBS_DELIMITER};
+    uart.receive_buffer_size = sizeof(packet2);
+    std::memcpy(uart.receive_buffer, packet2, sizeof(packet2));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 312);
+
+    // A packet with a wrong checksum is dropped
+    intReceived = 0;
+    uint8_t packet3[] = {0x05, 0x01, 0x04, 0x39, 0x01, 0x01, 0x02, 0x40, COBS_DELIMITER};
+    uart.receive_buffer_size = sizeof(packet3);
+    std::memcpy(uart.receive_buffer, packet3, sizeof(packet3));
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+    REQUIRE(uart.log_message == "Invalid checksum received");
+
+    // Extra bytes after the checksum make the packet invalid
+    uint8_t packet4[] = {0x05, 0x01, 0x04, 0x39, 0x01, 0x01, 0x03, 0x3f, 0x11, COBS_DELIMITER};
+    uart.receive_buffer_size = sizeof(packet4);
+    std::memcpy(uart.receive_buffer, packet4, sizeof(packet4));
+    REQUIRE(uart.ReceiveUARTPackets() == 0);
+    REQUIRE(intReceived == 0);
+
+    // Idle delimiters between packets are ignored
+    uint8_t packet5[] = {COBS_DELIMITER, COBS_DELIMITER, 0x05, 0x01, 0x04, 0x39, 0x01, 0x01, 0x02, 0x3f, COBS_DELIMITER};
+    uart.receive_buffer_size = sizeof(packet5);
+    std::memcpy(uart.receive_buffer, packet5, sizeof(packet5));
+    REQUIRE(uart.ReceiveUARTPackets() == 1);
+    REQUIRE(intReceived == 313);
+}
+
+TEST_CASE("Test the bytes left to the next packet")
+{
+    for (UART::Framing framing : {UART::Framing::ESCAPE, UART::Framing::COBS})
+    {
+        for (UART::Integrity integrity : {UART::Integrity::CHECKSUM, UART::Integrity::CRC32C})
+        {
+            // Random packets, many of them with bytes to stuff, and where each one ends on the wire
+            FakeUART sender;
+            REQUIRE(sender.SetFraming(framing));
+            REQUIRE(sender.SetIntegrity(integrity));
+            std::mt19937 rng(5);
+            std::vector<size_t> frameEnds;
+            for (int i = 0; i < 200; i++)
+            {
+                Payload payload;
+                size_t size = rng() % 64;
+                for (size_t j = 0; j < size; j++)
+                {
+                    // Around the frame and escape bytes, and zeros for COBS
+                    uint8_t byte = (rng() % 4 == 0) ? 0 : static_cast<uint8_t>(0x7C + rng() % 5);
+                    payload.WriteBytes(&byte, 1);
+                }
+                REQUIRE(sender.SendUARTPacket(1, payload));
+                sender.SendUARTPackets();
+                frameEnds.push_back(sender.sent_bytes.size());
+            }
+
+            // Fed one byte at a time, the bound never goes past the end of the frame being received
+            FakeUART uart;
+            REQUIRE(uart.SetFraming(framing));
+            REQUIRE(uart.SetIntegrity(integrity));
+            uart.RegisterHandler(1, [](PayloadView &) {});
+            size_t frame = 0;
+            int packetsReceived = 0;
+            for (size_t i = 0; i < sender.sent_bytes.size(); i++)
+            {
+                if (i == frameEnds[frame])
+                    frame++;
+                REQUIRE(uart.MinimumBytesToNextPacket() >= 1);
+                REQUIRE(uart.MinimumBytesToNextPacket() <= frameEnds[frame] - i);
+                if (i + 1 == frameEnds[frame])
+                    REQUIRE(uart.MinimumBytesToNextPacket() == 1);
+
+                uart.receive_buffer[0] = sender.sent_bytes[i];
+                uart.receive_buffer_size = 1;
+                packetsReceived += uart.ReceiveUARTPackets();
+            }
+            REQUIRE(packetsReceived == 200);
+
+            // A frame whose length got corrupted is dropped by the end of the frame, and the bound never goes past
+            // the end of the short frame that follows
+            FakeUART corrupted;
+            REQUIRE(corrupted.SetFraming(framing));
+            REQUIRE(corrupted.SetIntegrity(integrity));
+            const uint8_t bytes[5] = {1, 2, 3, 4, 5};
+            REQUIRE(corrupted.SendUARTPacket(1, PayloadView(bytes, sizeof(bytes))));
+            corrupted.SendUARTPackets();
+            REQUIRE(corrupted.sent_bytes[2] == sizeof(bytes)); // After START_BYTE or the COBS code, and the ID
+            corrupted.sent_bytes[2] = 250;
+            REQUIRE(corrupted.SendUARTPacket(1, PayloadView(bytes, 1)));
+            corrupted.SendUARTPackets();
+
+            packetsReceived = 0;
+            const std::vector<uint8_t> &stream = corrupted.sent_bytes;
+            for (size_t i = 0; i < stream.size(); i++)
+            {
+                REQUIRE(uart.MinimumBytesToNextPacket() <= stream.size() - i);
+                uart.receive_buffer[0] = stream[i];
+                uart.receive_buffer_size = 1;
+                packetsReceived += uart.ReceiveUARTPackets();
+            }
+            REQUIRE(packetsReceived == 1);
+        }
+    }
+}
+
 // TODO: More realistic tests
 // float d1 = 0;
 // float d2 = 0;
 // float thrust = 0;
 // float mz = 0;
-// void realHandler(Payload &payload)
+// void realHandler(PayloadView &payload)
 // {
 //     d1 = payload.ReadFloat();
 //     d2 = payload.ReadFloat();
@@ -275,7 +568,7 @@ TEST_CASE("Test byte unstuffing")
 //                         0x00, END_BYTE};
 //     uart.receive_buffer_size = sizeof(packet);
 //     std::memcpy(uart.receive_buffer, packet, sizeof(packet));
-//     REQUIRE(uart.Update() == 1);
+//     REQUIRE(uart.ReceiveUARTPackets() == 1);
 
 //     float expectedD1 =  5.3465f;
 //     float expectedD2 = -3.2794f;
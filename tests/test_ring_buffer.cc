@@ -0,0 +1,75 @@
+#include "catch.hpp"
+#include "ByteStuffing.h"
+#include "RingBuffer.h"
+#include "UART.h"
+#include <cstring>
+#include <vector>
+
+TEST_CASE("Test ring buffer indexes")
+{
+    uint8_t storage[64];
+    RingBuffer ring(storage, sizeof(storage));
+
+    REQUIRE(ring.Data() == storage);
+    REQUIRE(ring.Size() == 64);
+    REQUIRE_FALSE(ring.IsMirrored());
+    REQUIRE(ring.Wrap(63) == 63);
+    REQUIRE(ring.Wrap(64) == 0);
+    REQUIRE(ring.Wrap(70) == 6);
+    REQUIRE(ring.Wrap(size_t(0) - 1) == 63);
+    REQUIRE(ring.ContiguousSize(0) == 64);
+    REQUIRE(ring.ContiguousSize(60) == 4);
+}
+
+TEST_CASE("Test mirrored ring buffer")
+{
+    uint8_t storage[2048];
+    RingBuffer ring(storage, sizeof(storage));
+    REQUIRE(ring.Mirror());
+
+    REQUIRE(ring.IsMirrored());
+    REQUIRE(ring.Data() != storage);
+    REQUIRE(ring.Size() >= sizeof(storage));
+    REQUIRE((ring.Size() & (ring.Size() - 1)) == 0);
+    REQUIRE(ring.ContiguousSize(ring.Size() - 1) == ring.Size());
+
+    // Bytes written across the end show up at the start, and the other way around
+    uint8_t *data = ring.Data();
+    size_t end = ring.Size() - 4;
+    for (size_t i = 0; i < 8; i++)
+    {
+        data[end + i] = static_cast<uint8_t>(i + 1);
+    }
+    REQUIRE(data[0] == 5);
+    REQUIRE(data[3] == 8);
+    data[1] = 42;
+    REQUIRE(data[ring.Size() + 1] == 42);
+}
+
+TEST_CASE("Test unstuffing in place across the end of a mirrored ring buffer")
+{
+    uint8_t storage[2048];
+    RingBuffer ring(storage, sizeof(storage));
+    REQUIRE(ring.Mirror());
+
+    // The stuffed bytes are read through the mirror, while the unstuffed bytes are written a few bytes behind them
+    // through the first mapping: the ranges overlap in memory, but not in address space
+    std::vector<uint8_t> data(200);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (i == 3) ? ESCAPE_BYTE : static_cast<uint8_t>(i);
+    }
+    std::vector<uint8_t> stuffed(2 * data.size());
+    stuffed.resize(StuffBytes(data.data(), data.size(), stuffed.data()));
+
+    size_t source = ring.Size() + 4;
+    std::memcpy(ring.Data() + ring.Wrap(source), stuffed.data(), stuffed.size());
+
+    bool escapePending = false;
+    size_t consumed;
+    size_t destination = 1;
+    REQUIRE(UnstuffBytes(ring.Data() + source, stuffed.size(), ring.Data() + destination, data.size(), escapePending,
+                         consumed) == data.size());
+    REQUIRE(consumed == stuffed.size());
+    REQUIRE(std::memcmp(ring.Data() + destination, data.data(), data.size()) == 0);
+}
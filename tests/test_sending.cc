@@ -1,47 +1,12 @@
 #include "catch.hpp"
-#include "UART.h"
+#include "FakeUART.h"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <random>
+#include <vector>
 
 
-// Fake UART class for testing
-class FakeUART : public UART
-{
-  public:
-    FakeUART() : UART() {}
-
-    uint8_t send_buffer[1024];
-    size_t send_buffer_size = 0;
-    size_t Send(const uint8_t *data, const size_t data_size) override
-    {
-        if (data_size > sizeof(send_buffer))
-        {
-            throw std::runtime_error("Packet too big for send buffer");
-        }
-        std::memcpy(send_buffer, data, data_size);
-        send_buffer_size = data_size;
-        return data_size;
-    }
-
-    uint8_t receive_buffer[1024];
-    size_t receive_buffer_size = 0;
-    size_t Receive(uint8_t *data, const size_t data_size) override
-    {
-        if (receive_buffer_size > data_size)
-        {
-            throw std::runtime_error("Receive buffer too small");
-        }
-        std::memcpy(data, receive_buffer, receive_buffer_size);
-        return receive_buffer_size;
-    }
-
-    const char *log_message;
-    void Log(LOG_LEVEL level, const char *message) override
-    {
-        // std::cout << message << std::endl;
-        log_message = message;
-    }
-};
-
 TEST_CASE("Test sending integer packets")
 {
     FakeUART uart;
@@ -50,7 +15,7 @@ TEST_CASE("Test sending integer packets")
     Payload payload;
     payload.WriteInt(313);
     uart.SendUARTPacket(1, payload);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 9);
     uint8_t expected[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x3f, END_BYTE};
@@ -60,7 +25,7 @@ TEST_CASE("Test sending integer packets")
     Payload payload2;
     payload2.WriteInt(312);
     uart.SendUARTPacket(1, payload2);
-    uart.Update();
+    uart.SendUARTPackets();
 
     
     REQUIRE(uart.send_buffer_size == 9);
@@ -76,7 +41,7 @@ TEST_CASE("Test sending float packets")
     Payload payload;
     payload.WriteFloat(3.1415926f);
     uart.SendUARTPacket(2, payload);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 9);
     uint8_t expected[] = {START_BYTE, 0x02, 0x04, 0xda, 0x0f, 0x49, 0x40, 0x78, END_BYTE};
@@ -91,7 +56,7 @@ TEST_CASE("Test sending boolean packets")
     Payload payload;
     payload.WriteBool(true);
     uart.SendUARTPacket(3, payload);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 6);
     uint8_t expected[] = {START_BYTE, 0x03, 0x01, 0x01, 0x05, END_BYTE};
@@ -101,7 +66,7 @@ TEST_CASE("Test sending boolean packets")
     Payload payload2;
     payload2.WriteBool(false);
     uart.SendUARTPacket(3, payload2);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 6);
     uint8_t expected2[] = {START_BYTE, 0x03, 0x01, 0x00, 0x04, END_BYTE};
@@ -117,7 +82,7 @@ TEST_CASE("Test sending raw byte packets")
     uint8_t rawBytes[] = {0x01, 0x02, 0x03, 0x04};
     payload.WriteBytes(rawBytes, 4);
     uart.SendUARTPacket(4, payload);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 9);
     uint8_t expected[] = {START_BYTE, 0x04, 0x04, 0x01, 0x02, 0x03, 0x04, 0x12, END_BYTE};
@@ -132,7 +97,7 @@ TEST_CASE("Test byte stuffing")
     Payload payload1;
     payload1.WriteInt((int)START_BYTE);
     uart.SendUARTPacket(1, payload1);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 10);
     uint8_t expected1[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, START_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x83, END_BYTE};
@@ -142,7 +107,7 @@ TEST_CASE("Test byte stuffing")
     Payload payload2;
     payload2.WriteInt((int)END_BYTE);
     uart.SendUARTPacket(1, payload2);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 10);
     uint8_t expected2[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, END_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x84, END_BYTE};
@@ -152,13 +117,558 @@ TEST_CASE("Test byte stuffing")
     Payload payload3;
     payload3.WriteInt((int)ESCAPE_BYTE);
     uart.SendUARTPacket(1, payload3);
-    uart.Update();
+    uart.SendUARTPackets();
     
     REQUIRE(uart.send_buffer_size == 10);
     uint8_t expected3[] = {START_BYTE, 0x01, 0x04, ESCAPE_BYTE, ESCAPE_BYTE ^ ESCAPE_MASK, 0x00, 0x00, 0x00, 0x82, END_BYTE};
     REQUIRE(std::memcmp(uart.send_buffer, expected3, sizeof(expected3)) == 0);
 }
 
+TEST_CASE("Test sending COBS packets")
+{
+    FakeUART uart;
+    REQUIRE(uart.SetFraming(UART::Framing::COBS));
+
+    Payload payload;
+    payload.WriteInt(313);
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    uart.SendUARTPackets();
+
+    uint8_t expected[] = {0x05, 0x01, 0x04, 0x39, 0x01, 0x01, 0x02, 0x3f, COBS_DELIMITER};
+    REQUIRE(uart.send_buffer_size == sizeof(expected));
+    REQUIRE(std::memcmp(uart.send_buffer, expected, sizeof(expected)) == 0);
+
+    // The framing cannot change while packets are waiting to be sent
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    REQUIRE_FALSE(uart.SetFraming(UART::Framing::ESCAPE));
+}
+
+TEST_CASE("Test sending packets with a CRC")
+{
+    FakeUART uart;
+    Payload payload;
+    payload.WriteInt(313);
+
+    // The CRC is sent least significant byte first
+    REQUIRE(uart.SetIntegrity(UART::Integrity::CRC16));
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    uart.SendUARTPackets();
+    uint8_t expected16[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0x18, 0x2a, END_BYTE};
+    REQUIRE(uart.send_buffer_size == sizeof(expected16));
+    REQUIRE(std::memcmp(uart.send_buffer, expected16, sizeof(expected16)) == 0);
+
+    REQUIRE(uart.SetIntegrity(UART::Integrity::CRC32C));
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    uart.SendUARTPackets();
+    uint8_t expected32[] = {START_BYTE, 0x01, 0x04, 0x39, 0x01, 0x00, 0x00, 0xb5, 0x57, 0x5e, 0xe8, END_BYTE};
+    REQUIRE(uart.send_buffer_size == sizeof(expected32));
+    REQUIRE(std::memcmp(uart.send_buffer, expected32, sizeof(expected32)) == 0);
+}
+
+TEST_CASE("Test the capacity of the send buffer once mirrored")
+{
+    // Mirroring maps at least a page, but the send buffer holds no more bytes than SEND_BUFFER_SIZE
+    std::vector<size_t> pending;
+    for (bool mirrored : {false, true})
+    {
+        FakeUART uart;
+        if (mirrored)
+        {
+            REQUIRE(uart.UseMirroredBuffers());
+        }
+        uint8_t bytes[10] = {};
+        while (uart.SendUARTPacket(1, PayloadView(bytes, sizeof(bytes))))
+        {
+        }
+        REQUIRE(uart.PendingSendBytes() < SEND_BUFFER_SIZE);
+        pending.push_back(uart.PendingSendBytes());
+    }
+    REQUIRE(pending[0] == pending[1]);
+}
+
+TEST_CASE("Test sending packets across the end of the send buffer")
+{
+    FakeUART sender;
+    FakeUART receiver;
+    bool mirrored = GENERATE(false, true);
+    if (mirrored)
+    {
+        REQUIRE(sender.UseMirroredBuffers());
+        REQUIRE(receiver.UseMirroredBuffers());
+    }
+    UART::Framing framing = GENERATE(UART::Framing::ESCAPE, UART::Framing::COBS);
+    REQUIRE(sender.SetFraming(framing));
+    REQUIRE(receiver.SetFraming(framing));
+    UART::Integrity integrity = GENERATE(UART::Integrity::CHECKSUM, UART::Integrity::CRC16, UART::Integrity::CRC32C);
+    REQUIRE(sender.SetIntegrity(integrity));
+    REQUIRE(receiver.SetIntegrity(integrity));
+    std::vector<std::vector<uint8_t>> received;
+    receiver.RegisterHandler(5, [&](PayloadView &payload) {
+        received.emplace_back(payload.GetBytes(), payload.GetBytes() + payload.GetSize());
+    });
+
+    // Payloads heavy in bytes that need stuffing, of sizes that make the frames wrap at different places
+    std::mt19937 rng(42);
+    std::vector<std::vector<uint8_t>> sent;
+    for (int i = 0; i < 100; i++)
+    {
+        std::vector<uint8_t> bytes(rng() % 256);
+        for (auto &b : bytes)
+            b = (rng() % 4 == 0) ? START_BYTE - 1 + rng() % 3 : rng();
+        sent.push_back(bytes);
+
+        Payload payload;
+        payload.WriteBytes(bytes.data(), bytes.size());
+        REQUIRE(sender.SendUARTPacket(5, payload));
+
+        // Loop back everything that was sent
+        REQUIRE(sender.SendUARTPackets() == 0);
+        std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+        receiver.receive_buffer_size = sender.sent_bytes.size();
+        sender.sent_bytes.clear();
+        receiver.ReceiveUARTPackets();
+    }
+
+    REQUIRE(received == sent);
+}
+
+TEST_CASE("Test flushing the send buffer with partial writes")
+{
+    FakeUART sender;
+    FakeUART receiver;
+    std::vector<std::vector<uint8_t>> received;
+    receiver.RegisterHandler(5, [&](PayloadView &payload) {
+        received.emplace_back(payload.GetBytes(), payload.GetBytes() + payload.GetSize());
+    });
+
+    // Move the send buffer close to its end, so that the next packets wrap around it
+    Payload padding;
+    uint8_t paddingBytes[200] = {};
+    padding.WriteBytes(paddingBytes, sizeof(paddingBytes));
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(sender.SendUARTPacket(6, padding));
+    }
+    REQUIRE(sender.SendUARTPackets() == 0);
+    sender.sent_bytes.clear();
+
+    std::vector<std::vector<uint8_t>> sent;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        std::vector<uint8_t> bytes(100, i);
+        sent.push_back(bytes);
+        Payload payload;
+        payload.WriteBytes(bytes.data(), bytes.size());
+        REQUIRE(sender.SendUARTPacket(5, payload));
+    }
+    size_t queued = sender.PendingSendBytes();
+    REQUIRE(queued == 4 * 105);
+
+    // The byte budget is respected
+    REQUIRE(sender.SendUARTPackets(50) == queued - 50);
+
+    // The device only takes 7 bytes per write and is full after 200 bytes
+    sender.send_limit = 7;
+    sender.send_capacity = 200;
+    REQUIRE(sender.SendUARTPackets() == queued - 250);
+
+    // Once the device has room again, both halves of the wrapped buffer are sent in a single call
+    sender.send_capacity = SIZE_MAX;
+    REQUIRE(sender.SendUARTPackets() == 0);
+    REQUIRE(sender.sent_bytes.size() == queued);
+
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    REQUIRE(receiver.ReceiveUARTPackets() == 4);
+    REQUIRE(received == sent);
+}
+
+TEST_CASE("Test sending a full send buffer")
+{
+    FakeUART uart;
+
+    // Each packet may need twice its size in the send buffer, it is refused if there is no room for that
+    Payload payload;
+    uint8_t bytes[255] = {};
+    payload.WriteBytes(bytes, sizeof(bytes));
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    REQUIRE(uart.SendUARTPacket(1, payload));
+    REQUIRE(!uart.SendUARTPacket(1, payload));
+
+    // The length field is a single byte
+    BasicPayload<512> bigPayload;
+    uint8_t bigBytes[256] = {};
+    REQUIRE(bigPayload.WriteBytes(bigBytes, sizeof(bigBytes)));
+    REQUIRE(!uart.SendUARTPacket(1, bigPayload));
+}
+
 // TODO: large packets and error conditions
 // Zero length packets
-// doubles
\ No newline at end of file
+// doubles
+TEST_CASE("Test sending and receiving typed packets")
+{
+    FakeUART sender;
+    FakeUART receiver;
+
+    ControlInputPacket input{};
+    input.armed = true;
+    input.timestamp = 1234.5;
+    input.desired_state.pos = Vec3(1.0, 2.0, 3.0);
+    input.current_state.att = Vec3(0.1, -0.2, 0.3);
+    input.setpointSelection = POSITION_CONTROL_SELECTION;
+    input.inline_thrust = 0.75;
+    ControlOutputPacket output{5.0, 1.5, -2.5, 0.5, 0.1};
+
+    ControlInputPacket receivedInput{};
+    ControlOutputPacket receivedOutput{};
+    int inputs = 0;
+    int outputs = 0;
+    receiver.On<PacketId::ControlInput>([&](const ControlInputPacket &packet) {
+        receivedInput = packet;
+        inputs++;
+    });
+    receiver.On<PacketId::ControlOutput>([&](const ControlOutputPacket &packet) {
+        receivedOutput = packet;
+        outputs++;
+    });
+
+    REQUIRE(sender.SendPacket(input));
+    REQUIRE(sender.SendPacket(output));
+    sender.SendUARTPackets();
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    REQUIRE(receiver.ReceiveUARTPackets() == 2);
+
+    REQUIRE(inputs == 1);
+    REQUIRE(receivedInput.armed);
+    REQUIRE(receivedInput.timestamp == 1234.5);
+    REQUIRE(receivedInput.desired_state.pos.y == 2.0);
+    REQUIRE(receivedInput.current_state.att.y == -0.2);
+    REQUIRE(receivedInput.setpointSelection.posSPActive[2]);
+    REQUIRE_FALSE(receivedInput.setpointSelection.rateSPActive[0]);
+    REQUIRE(receivedInput.inline_thrust == 0.75);
+
+    REQUIRE(outputs == 1);
+    REQUIRE(receivedOutput.timestamp == 5.0);
+    REQUIRE(receivedOutput.d2 == -2.5);
+    REQUIRE(receivedOutput.throttle_diff == 0.1);
+
+    // A ControlOutputPacket is never longer than 40 bytes, the frame is rejected from its length field
+    uint8_t tooLong[] = {START_BYTE, 0x02, 41};
+    std::memcpy(receiver.receive_buffer, tooLong, sizeof(tooLong));
+    receiver.receive_buffer_size = sizeof(tooLong);
+    REQUIRE(receiver.ReceiveUARTPackets() == 0);
+    REQUIRE(receiver.log_message == "Invalid packet length received");
+
+    // A payload too short for its struct is not handed to the handler
+    Payload truncated;
+    truncated.WriteDouble(5.0);
+    REQUIRE(sender.SendUARTPacket(static_cast<uint8_t>(PacketId::ControlOutput), truncated));
+    sender.sent_bytes.clear();
+    sender.SendUARTPackets();
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    receiver.ReceiveUARTPackets();
+    REQUIRE(outputs == 1);
+    REQUIRE(receiver.log_message == "Invalid packet payload received");
+}
+
+TEST_CASE("Test sending and receiving compact packets")
+{
+    FakeUART sender;
+    FakeUART receiver;
+    REQUIRE(sender.SetEncoding(WireEncoding::COMPACT));
+    REQUIRE(receiver.SetEncoding(WireEncoding::COMPACT));
+
+    ControlInputPacket input{};
+    input.armed = true;
+    input.timestamp = 1234.5;
+    input.desired_state.pos = Vec3(1.0, 2.0, 3.0);
+    input.current_state.att = Vec3(0.1, -0.2, 0.3);
+    input.inline_thrust = 0.75;
+
+    ControlInputPacket receivedInput{};
+    int inputs = 0;
+    receiver.On<PacketId::ControlInput>([&](const ControlInputPacket &packet) {
+        receivedInput = packet;
+        inputs++;
+    });
+
+    REQUIRE(sender.SendPacket(input));
+    REQUIRE(sender.PendingSendBytes() < CONTROL_INPUT_PACKET_MAX_SIZE / 2);
+    sender.SendUARTPackets();
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    REQUIRE(receiver.ReceiveUARTPackets() == 1);
+
+    REQUIRE(inputs == 1);
+    REQUIRE(receivedInput.armed);
+    REQUIRE(receivedInput.timestamp == 1234.5);
+    REQUIRE(receivedInput.desired_state.pos.y == 2.0);
+    REQUIRE(std::fabs(receivedInput.current_state.att.y + 0.2) <= 0.00005);
+    REQUIRE(receivedInput.inline_thrust == 0.75);
+
+    // The encoding cannot change with packets waiting to be sent
+    REQUIRE(sender.SendPacket(input));
+    REQUIRE_FALSE(sender.SetEncoding(WireEncoding::FULL));
+    REQUIRE(sender.log_message == "Cannot change the encoding while the buffers are in use");
+}
+
+TEST_CASE("Test sending packets by priority")
+{
+    FakeUART sender;
+    FakeUART receiver;
+    std::vector<uint8_t> received;
+    for (uint8_t id : {1, 2, 3})
+    {
+        receiver.RegisterHandler(id, [&received, id](PayloadView &) { received.push_back(id); });
+    }
+    sender.SetPriority(2, UART::Priority::TELEMETRY);
+    sender.SetPriority(3, UART::Priority::BULK);
+
+    Payload payload;
+    payload.WriteInt(42);
+    REQUIRE(sender.SendUARTPacket(3, payload));
+    REQUIRE(sender.SendUARTPacket(2, payload));
+    REQUIRE(sender.SendUARTPacket(1, payload));
+
+    // Only the CONTROL packet is in the send buffer, the others wait in their queues
+    REQUIRE(sender.PendingSendBytes() == 9);
+    REQUIRE(sender.GetTransmitStats(UART::Priority::TELEMETRY).depth == 1);
+    REQUIRE(sender.GetTransmitStats(UART::Priority::BULK).depth == 1);
+
+    REQUIRE(sender.SendUARTPackets() == 0);
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    REQUIRE(receiver.ReceiveUARTPackets() == 3);
+    REQUIRE(received == std::vector<uint8_t>{1, 2, 3});
+
+    UART::TransmitStats bulk = sender.GetTransmitStats(UART::Priority::BULK);
+    REQUIRE(bulk.depth == 0);
+    REQUIRE(bulk.peakDepth == 1);
+    REQUIRE(bulk.packetsQueued == 1);
+    REQUIRE(bulk.packetsSent == 1);
+    // Queued first, sent after the two other packets
+    REQUIRE(bulk.maxLatency == 18);
+    REQUIRE(sender.GetTransmitStats(UART::Priority::CONTROL).maxLatency == 0);
+
+    // Frames of the lower classes are copied, and go back to the pool right away
+    FrameRef frame = sender.GetFramePool().Allocate();
+    frame->WriteInt(7);
+    REQUIRE(sender.SendFrame(3, std::move(frame)));
+    REQUIRE(sender.GetFramePool().InUse() == 0);
+    REQUIRE(sender.PendingSendFrames() == 0);
+    REQUIRE(sender.GetTransmitStats(UART::Priority::BULK).depth == 1);
+
+    REQUIRE_FALSE(sender.SetPriorityWeight(UART::Priority::CONTROL, 2));
+    REQUIRE_FALSE(sender.SetPriorityWeight(UART::Priority::BULK, 0));
+}
+
+TEST_CASE("Test weighted sharing between priority classes")
+{
+    FakeUART uart;
+    uart.SetPriority(2, UART::Priority::TELEMETRY);
+    uart.SetPriority(3, UART::Priority::BULK);
+    REQUIRE(uart.SetPriorityWeight(UART::Priority::TELEMETRY, 3));
+
+    // Packets of different sizes, the share is in bytes
+    Payload telemetry;
+    uint8_t bytes[200] = {};
+    telemetry.WriteBytes(bytes, 50);
+    Payload bulk;
+    bulk.WriteBytes(bytes, 200);
+
+    for (int tick = 0; tick < 2000; tick++)
+    {
+        while (uart.SendUARTPacket(2, telemetry))
+        {
+        }
+        while (uart.SendUARTPacket(3, bulk))
+        {
+        }
+        uart.SendUARTPackets(64);
+    }
+
+    UART::TransmitStats telemetryStats = uart.GetTransmitStats(UART::Priority::TELEMETRY);
+    UART::TransmitStats bulkStats = uart.GetTransmitStats(UART::Priority::BULK);
+    double ratio = (telemetryStats.packetsSent * 52.0) / (bulkStats.packetsSent * 202.0);
+    REQUIRE(ratio > 2.8);
+    REQUIRE(ratio < 3.2);
+    REQUIRE(telemetryStats.packetsDropped > 0);
+    REQUIRE(bulkStats.packetsDropped > 0);
+}
+
+TEST_CASE("Test bounded delay of control packets with a saturated bulk queue")
+{
+    FakeUART uart;
+    const uint8_t controlId = 2;
+    const uint8_t bulkId = 9;
+    uart.SetPriority(bulkId, UART::Priority::BULK);
+
+    // Neither payload has bytes to escape, so the packets are easy to find on the wire
+    Payload control;
+    uint8_t controlBytes[20];
+    std::memset(controlBytes, 0x22, sizeof(controlBytes));
+    control.WriteBytes(controlBytes, sizeof(controlBytes));
+    Payload bulk;
+    uint8_t bulkBytes[200];
+    std::memset(bulkBytes, 0x11, sizeof(bulkBytes));
+    bulk.WriteBytes(bulkBytes, sizeof(bulkBytes));
+
+    // The link takes 32 bytes per tick, the bulk queue is refilled every tick
+    std::vector<size_t> queuedAt;
+    for (int tick = 0; tick < 1000; tick++)
+    {
+        while (uart.SendUARTPacket(bulkId, bulk))
+        {
+        }
+        if (tick % 7 == 0)
+        {
+            queuedAt.push_back(uart.sent_bytes.size());
+            REQUIRE(uart.SendUARTPacket(controlId, control));
+        }
+        uart.SendUARTPackets(32);
+    }
+    while (uart.SendUARTPackets() > 0)
+    {
+    }
+
+    // Bytes sent between queueing each control packet and its start byte
+    std::vector<size_t> delays;
+    const std::vector<uint8_t> &wire = uart.sent_bytes;
+    size_t position = 0;
+    for (size_t queued : queuedAt)
+    {
+        position = std::max(position, queued);
+        while (position + 1 < wire.size() && !(wire[position] == START_BYTE && wire[position + 1] == controlId))
+        {
+            position++;
+        }
+        REQUIRE(position + 1 < wire.size());
+        delays.push_back(position - queued);
+        position++;
+    }
+
+    // At most the rest of one bulk packet, however long the bulk queue is
+    const size_t bulkPacketSize = 1 + 2 + sizeof(bulkBytes) + 2 + 1;
+    size_t maxDelay = *std::max_element(delays.begin(), delays.end());
+    REQUIRE(maxDelay > 0);
+    REQUIRE(maxDelay <= bulkPacketSize);
+
+    UART::TransmitStats controlStats = uart.GetTransmitStats(UART::Priority::CONTROL);
+    REQUIRE(controlStats.packetsSent == queuedAt.size());
+    REQUIRE(controlStats.maxLatency == maxDelay);
+    REQUIRE(controlStats.packetsDropped == 0);
+
+    // The bulk packets still get the rest of the link
+    UART::TransmitStats bulkStats = uart.GetTransmitStats(UART::Priority::BULK);
+    REQUIRE(bulkStats.packetsSent * bulkPacketSize + controlStats.packetsSent * 26 >= 31000);
+    REQUIRE(bulkStats.peakDepth == TransmitQueue::SIZE / (TransmitQueue::HEADER_SIZE + sizeof(bulkBytes)));
+}
+
+TEST_CASE("Test sending packets through a mailbox")
+{
+    FakeUART sender;
+    FakeUART receiver;
+    std::vector<int> received;
+    receiver.RegisterHandler(2, [&](PayloadView &payload) {
+        int value;
+        payload.ReadInt(value);
+        received.push_back(value);
+    });
+    REQUIRE(sender.UseMailbox(2));
+
+    // The first packet goes straight into the send buffer, the next ones replace each other in the mailbox
+    for (int value = 1; value <= 4; value++)
+    {
+        Payload payload;
+        payload.WriteInt(value);
+        REQUIRE(sender.SendUARTPacket(2, payload));
+    }
+    REQUIRE(sender.PendingSendBytes() == 9);
+    REQUIRE(sender.SupersededPackets(2) == 2);
+    REQUIRE(sender.GetTransmitStats(UART::Priority::CONTROL).depth == 1);
+
+    // Frames are copied into the mailbox too
+    FrameRef frame = sender.GetFramePool().Allocate();
+    frame->WriteInt(5);
+    REQUIRE(sender.SendFrame(2, std::move(frame)));
+    REQUIRE(sender.GetFramePool().InUse() == 0);
+    REQUIRE(sender.SupersededPackets(2) == 3);
+
+    // The mailbox is encoded once the packet before it has been sent
+    sender.send_capacity = 5;
+    REQUIRE(sender.SendUARTPackets() == 4 + 6);
+    sender.send_capacity = SIZE_MAX;
+    REQUIRE(sender.SendUARTPackets() == 0);
+
+    std::memcpy(receiver.receive_buffer, sender.sent_bytes.data(), sender.sent_bytes.size());
+    receiver.receive_buffer_size = sender.sent_bytes.size();
+    REQUIRE(receiver.ReceiveUARTPackets() == 2);
+    REQUIRE(received == std::vector<int>{1, 5});
+
+    UART::TransmitStats stats = sender.GetTransmitStats(UART::Priority::CONTROL);
+    REQUIRE(stats.packetsQueued == 5);
+    REQUIRE(stats.packetsSent == 2);
+    REQUIRE(stats.packetsSuperseded == 3);
+    REQUIRE(stats.depth == 0);
+    REQUIRE(stats.peakDepth == 1);
+    // The last packet was queued before the first one started, and waited for all of it
+    REQUIRE(stats.maxLatency == 9);
+
+    // Other IDs are not affected, and there are only so many mailboxes
+    REQUIRE(sender.SupersededPackets(3) == 0);
+    REQUIRE(sender.UseMailbox(2));
+    for (uint8_t id = 3; id < 3 + UART::MAILBOX_COUNT - 1; id++)
+    {
+        REQUIRE(sender.UseMailbox(id));
+    }
+    REQUIRE_FALSE(sender.UseMailbox(10));
+    REQUIRE(sender.log_message == "No mailbox left");
+}
+
+TEST_CASE("Test mailboxes on a saturated link")
+{
+    // A 32 byte packet every tick, on a link that takes 16 bytes per tick
+    Payload payload;
+    uint8_t bytes[24] = {};
+    payload.WriteBytes(bytes, sizeof(bytes));
+    const size_t packetSize = 1 + 2 + sizeof(bytes) + 1 + 1;
+
+    for (bool mailbox : {false, true})
+    {
+        FakeUART uart;
+        if (mailbox)
+        {
+            REQUIRE(uart.UseMailbox(2));
+        }
+        size_t refused = 0;
+        for (int tick = 0; tick < 1000; tick++)
+        {
+            if (!uart.SendUARTPacket(2, payload))
+            {
+                refused++;
+            }
+            uart.SendUARTPackets(16);
+        }
+
+        UART::TransmitStats stats = uart.GetTransmitStats(UART::Priority::CONTROL);
+        if (mailbox)
+        {
+            // Every packet is accepted, those that would fall behind are superseded, and none waits for more than
+            // the packet before it
+            REQUIRE(refused == 0);
+            REQUIRE(stats.packetsSuperseded > 400);
+            REQUIRE(stats.packetsSent + stats.packetsSuperseded + stats.depth == 1000);
+            REQUIRE(stats.maxLatency <= packetSize);
+            REQUIRE(uart.PendingSendBytes() <= packetSize);
+        }
+        else
+        {
+            // The send buffer fills up with stale packets, then refuses new ones
+            REQUIRE(refused > 400);
+            REQUIRE(stats.packetsDropped == refused);
+            REQUIRE(stats.maxLatency > SEND_BUFFER_SIZE - 2 * packetSize);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#include "catch.hpp"
+#include "SpscRing.h"
+#include <cstdint>
+#include <thread>
+
+TEST_CASE("Test SPSC ring order and capacity")
+{
+    SpscRing<int, 4> ring;
+    REQUIRE(ring.Front() == nullptr);
+
+    for (int i = 0; i < 4; i++)
+    {
+        int *slot = ring.Back();
+        REQUIRE(slot != nullptr);
+        *slot = i;
+        ring.Push();
+    }
+    REQUIRE(ring.Count() == 4);
+    REQUIRE(ring.Back() == nullptr);
+
+    REQUIRE(*ring.Front() == 0);
+    ring.Pop();
+    REQUIRE(ring.Back() != nullptr);
+    *ring.Back() = 4;
+    ring.Push();
+
+    for (int i = 1; i <= 4; i++)
+    {
+        REQUIRE(ring.Front() != nullptr);
+        REQUIRE(*ring.Front() == i);
+        ring.Pop();
+    }
+    REQUIRE(ring.Front() == nullptr);
+    REQUIRE(ring.Count() == 0);
+}
+
+TEST_CASE("Test SPSC ring between two threads")
+{
+    struct Item
+    {
+        uint32_t value;
+        uint32_t check;
+    };
+    SpscRing<Item, 16> ring;
+    const uint32_t count = 200000;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count;)
+        {
+            Item *item = ring.Back();
+            if (item == nullptr)
+            {
+                // Let the consumer run on a single core
+                std::this_thread::yield();
+                continue;
+            }
+            item->value = i;
+            item->check = ~i;
+            ring.Push();
+            i++;
+        }
+    });
+
+    // Every item arrives once, in order, and fully written
+    bool valid = true;
+    for (uint32_t i = 0; i < count;)
+    {
+        Item *item = ring.Front();
+        if (item == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        valid = valid && item->value == i && item->check == ~i;
+        ring.Pop();
+        i++;
+    }
+    producer.join();
+    REQUIRE(valid);
+    REQUIRE(ring.Front() == nullptr);
+}
@@ -0,0 +1,108 @@
+#include "catch.hpp"
+#include "TransmitQueue.h"
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+TEST_CASE("Test transmit queue order")
+{
+    TransmitQueue queue;
+    REQUIRE(queue.Empty());
+
+    const uint8_t first[] = {1, 2, 3};
+    const uint8_t second[] = {4};
+    REQUIRE(queue.Push(10, PayloadView(first, sizeof(first)), 100));
+    REQUIRE(queue.Push(20, PayloadView(second, sizeof(second)), 200));
+    REQUIRE(queue.Push(30, PayloadView(nullptr, 0), 300));
+    REQUIRE(queue.Count() == 3);
+    REQUIRE(queue.Bytes() == 2 + 3 + 2 + 1 + 2);
+
+    REQUIRE(queue.FrontId() == 10);
+    REQUIRE(queue.FrontStamp() == 100);
+    REQUIRE(queue.FrontPayload().GetSize() == 3);
+    REQUIRE(std::memcmp(queue.FrontPayload().GetBytes(), first, sizeof(first)) == 0);
+    queue.Pop();
+    REQUIRE(queue.FrontId() == 20);
+    REQUIRE(queue.FrontStamp() == 200);
+    REQUIRE(queue.FrontPayload().GetBytes()[0] == 4);
+    queue.Pop();
+    REQUIRE(queue.FrontId() == 30);
+    REQUIRE(queue.FrontPayload().GetSize() == 0);
+    queue.Pop();
+    REQUIRE(queue.Empty());
+    REQUIRE(queue.Bytes() == 0);
+}
+
+TEST_CASE("Test transmit queue capacity")
+{
+    TransmitQueue queue;
+    std::vector<uint8_t> payload(UINT8_MAX, 0xAB);
+
+    // Full records only, the space left at the end is not enough for another
+    const size_t recordSize = TransmitQueue::HEADER_SIZE + payload.size();
+    size_t pushed = 0;
+    while (queue.Push(1, PayloadView(payload.data(), payload.size()), 0))
+    {
+        pushed++;
+    }
+    REQUIRE(pushed == TransmitQueue::SIZE / recordSize);
+    REQUIRE(queue.Count() == pushed);
+
+    // Smaller packets still fit at the end
+    REQUIRE(queue.Push(2, PayloadView(payload.data(), TransmitQueue::SIZE % recordSize - TransmitQueue::HEADER_SIZE), 0));
+    REQUIRE_FALSE(queue.Push(3, PayloadView(nullptr, 0), 0));
+
+    // Room at the start once the oldest packet is gone
+    queue.Pop();
+    REQUIRE(queue.Push(4, PayloadView(payload.data(), payload.size()), 0));
+    REQUIRE_FALSE(queue.Push(5, PayloadView(nullptr, 0), 0));
+}
+
+TEST_CASE("Test transmit queue against a reference queue")
+{
+    struct Packet
+    {
+        uint8_t id;
+        uint32_t stamp;
+        std::vector<uint8_t> payload;
+    };
+
+    TransmitQueue queue;
+    std::deque<Packet> reference;
+    std::mt19937 rng(11);
+    size_t referenceBytes = 0;
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        if (rng() % 2 == 0)
+        {
+            Packet packet{static_cast<uint8_t>(rng()), i, std::vector<uint8_t>(rng() % 200)};
+            for (auto &b : packet.payload)
+                b = rng();
+            if (queue.Push(packet.id, PayloadView(packet.payload.data(), packet.payload.size()), packet.stamp))
+            {
+                referenceBytes += packet.payload.size() + 2;
+                reference.push_back(std::move(packet));
+            }
+            else
+            {
+                // Only refused when most of the storage is in use
+                REQUIRE(referenceBytes + reference.size() * sizeof(uint32_t) + 2 * (TransmitQueue::HEADER_SIZE + 200) >
+                        TransmitQueue::SIZE);
+            }
+        }
+        else if (!reference.empty())
+        {
+            const Packet &packet = reference.front();
+            REQUIRE(queue.FrontId() == packet.id);
+            REQUIRE(queue.FrontStamp() == packet.stamp);
+            PayloadView payload = queue.FrontPayload();
+            REQUIRE(std::vector<uint8_t>(payload.GetBytes(), payload.GetBytes() + payload.GetSize()) == packet.payload);
+            referenceBytes -= packet.payload.size() + 2;
+            reference.pop_front();
+            queue.Pop();
+        }
+        REQUIRE(queue.Count() == reference.size());
+        REQUIRE(queue.Bytes() == referenceBytes);
+    }
+}
@@ -0,0 +1,653 @@
+#!/usr/bin/env python3
+"""Generate inc/PacketCodecs.h from schema/packets.schema.
+
+The generated header holds, for every struct and packet of the schema, straight-line encode and decode functions with
+their wire sizes as constants and WireFormat<T> descriptors, the same for the compact encoding where the fields marked
+with '~' are quantized, the PacketTraits and PacketType specializations used by UART::On() and UART::SendPacket(), and
+a hash of the schema that both ends of a link can compare.
+
+Usage: generate_packets.py [--schema SCHEMA] [--output HEADER] [--check]
+With --check, nothing is written and the exit code tells whether HEADER is up to date.
+"""
+
+import argparse
+import re
+import sys
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent.parent
+
+# Primitive types: C++ type and size on the wire
+PRIMITIVES = {
+    "bool": ("bool", 1),
+    "uint8": ("uint8_t", 1),
+    "int32": ("int32_t", 4),
+    "uint32": ("uint32_t", 4),
+    "float": ("float", 4),
+    "double": ("double", 8),
+}
+
+# Quantizations of the compact encoding: size on the wire of each double, and whether they take a step
+QUANTIZATIONS = {
+    "float": (4, False),
+    "int16": (2, True),
+    "uint32": (4, True),
+}
+
+FIELD_RE = re.compile(r"^([A-Za-z_]\w*) ([A-Za-z_]\w*)(?:\[([1-9]\d*)\])?$")
+STEP_RE = re.compile(r"^\d+(?:\.\d+)?(?:[eE][-+]?\d+)?$")
+INDENT = 4
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field:
+    def __init__(self, type_name, name, count, line, quantization=None, step=None):
+        self.type_name = type_name
+        self.name = name
+        self.count = count  # None for a plain field
+        self.line = line
+        self.quantization = quantization  # Encoding of the doubles of the field in the compact encoding, or None
+        self.step = step  # C++ literal of the step of an integer quantization
+
+
+class Condition:
+    def __init__(self, field, line):
+        self.field = field
+        self.items = []
+        self.line = line
+
+
+class Definition:
+    def __init__(self, kind, name, line, packet_id=None):
+        self.kind = kind  # "struct", "bits" or "packet"
+        self.name = name
+        self.line = line
+        self.packet_id = packet_id
+        self.items = []
+
+    @property
+    def cpp_name(self):
+        return self.name + "Packet" if self.kind == "packet" else self.name
+
+
+def constant_name(name):
+    """ControlInputPacket -> CONTROL_INPUT_PACKET"""
+    return re.sub(r"(?<=[a-z0-9])(?=[A-Z])", "_", name).upper()
+
+
+def parse(text):
+    """Parse the schema into a list of definitions, and the canonical lines the hash is computed from."""
+    definitions = []
+    canonical = []
+    # Blocks being filled, with their indentation depth
+    stack = []
+
+    for number, raw in enumerate(text.splitlines(), 1):
+        line = raw.split("#", 1)[0].rstrip()
+        if not line.strip():
+            continue
+        stripped = line.lstrip(" ")
+        indent = len(line) - len(stripped)
+        if "\t" in line or indent % INDENT:
+            raise SchemaError(f"line {number}: indent with multiples of {INDENT} spaces")
+        depth = indent // INDENT
+        tokens = stripped.split()
+        canonical.append(f"{depth} {' '.join(tokens)}")
+
+        if depth == 0:
+            stack = []
+            if tokens[0] in ("struct", "bits") and len(tokens) == 2:
+                definition = Definition(tokens[0], tokens[1], number)
+            elif tokens[0] == "packet" and len(tokens) == 4 and tokens[2] == "=" and tokens[3].isdigit():
+                definition = Definition("packet", tokens[1], number, int(tokens[3]))
+                if not 0 <= definition.packet_id <= 255:
+                    raise SchemaError(f"line {number}: packet IDs are a single byte")
+            else:
+                raise SchemaError(f"line {number}: expected 'struct <Name>', 'bits <Name>' or 'packet <Id> = <value>'")
+            definitions.append(definition)
+            stack.append((0, definition))
+            continue
+
+        if not stack or depth > stack[-1][0] + 1:
+            raise SchemaError(f"line {number}: unexpected indentation")
+        while stack[-1][0] >= depth:
+            stack.pop()
+        block = stack[-1][1]
+
+        if tokens[0] == "if":
+            if len(tokens) != 2 or stack[0][1].kind != "packet":
+                raise SchemaError(f"line {number}: 'if <field>' is only allowed in packets")
+            condition = Condition(tokens[1], number)
+            block.items.append(condition)
+            stack.append((depth, condition))
+            continue
+
+        quantization = None
+        step = None
+        if "~" in tokens:
+            index = tokens.index("~")
+            tokens, quantization = tokens[:index], tokens[index + 1 :]
+            if not quantization or quantization[0] not in QUANTIZATIONS:
+                raise SchemaError(f"line {number}: expected '~ float', '~ int16 <step>' or '~ uint32 <step>'")
+            quantization, arguments = quantization[0], quantization[1:]
+            if QUANTIZATIONS[quantization][1]:
+                if len(arguments) != 1 or not STEP_RE.match(arguments[0]) or float(arguments[0]) == 0:
+                    raise SchemaError(f"line {number}: '~ {quantization}' needs a positive step")
+                step = arguments[0]
+            elif arguments:
+                raise SchemaError(f"line {number}: '~ {quantization}' takes no step")
+
+        match = FIELD_RE.match(" ".join(tokens))
+        if not match:
+            raise SchemaError(f"line {number}: expected '<type> <name>' or '<type> <name>[<count>]'")
+        count = int(match.group(3)) if match.group(3) else None
+        block.items.append(Field(match.group(1), match.group(2), count, number, quantization, step))
+
+    return definitions, canonical
+
+
+def schema_hash(canonical):
+    """32-bit FNV-1a of the canonical schema, which ignores comments and spacing"""
+    value = 0x811C9DC5
+    for byte in "\n".join(canonical).encode():
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+    return value
+
+
+class Generator:
+    def __init__(self, definitions):
+        self.definitions = definitions
+        self.sizes = {}  # Wire size of each struct and bits
+        self.compact_sizes = {}  # Same in the compact encoding
+        self.compact = set()  # Structs whose compact encoding differs
+        self.doubles = {}  # Number of doubles of the structs only made of doubles
+        self.layouts = set()  # Structs whose layout has been checked by a static_assert
+        self.lines = []
+
+    def emit(self, line=""):
+        self.lines.append(line)
+
+    def fields(self, items):
+        for item in items:
+            if isinstance(item, Condition):
+                yield from self.fields(item.items)
+            else:
+                yield item
+
+    def element_doubles(self, type_name):
+        """Number of doubles of a type only made of doubles, or None"""
+        return 1 if type_name == "double" else self.doubles.get(type_name)
+
+    def field_doubles(self, field):
+        return self.element_doubles(field.type_name) * (field.count or 1)
+
+    def field_size(self, field, compact=False):
+        if compact and field.quantization:
+            return QUANTIZATIONS[field.quantization][0] * self.field_doubles(field)
+        sizes = self.compact_sizes if compact else self.sizes
+        if field.type_name in PRIMITIVES:
+            size = PRIMITIVES[field.type_name][1]
+        elif field.type_name in sizes:
+            size = sizes[field.type_name]
+        else:
+            raise SchemaError(f"line {field.line}: unknown type '{field.type_name}', types must be defined before use")
+        return size * (field.count or 1)
+
+    def block_size(self, items, compact=False):
+        """Size of the fields of a block that are always encoded, and the biggest size with all the conditions"""
+        always = 0
+        biggest = 0
+        for item in items:
+            if isinstance(item, Condition):
+                biggest += self.block_size(item.items, compact)[1]
+            else:
+                size = self.field_size(item, compact)
+                always += size
+                biggest += size
+        return always, biggest
+
+    def runs(self, items, compact):
+        """Split a block into its conditions and runs of fields. In the compact encoding, consecutive fields quantized
+        to float or int16 with the same step make up a single run, converted with one batch call."""
+        run = []
+        for item in items:
+            if run and not (compact and isinstance(item, Field) and self.joins(run[-1], item)):
+                yield run
+                run = []
+            if isinstance(item, Condition):
+                yield item
+            else:
+                run.append(item)
+        if run:
+            yield run
+
+    def joins(self, previous, field):
+        return previous.quantization in ("float", "int16") and (field.quantization, field.step) == (
+            previous.quantization,
+            previous.step,
+        )
+
+    def elements(self, field, owner):
+        """Expressions of the elements of a field, arrays unrolled"""
+        if field.count is None:
+            return [f"{owner}.{field.name}"]
+        return [f"{owner}.{field.name}[{i}]" for i in range(field.count)]
+
+    def codec_call(self, type_name, compact=False):
+        if type_name in PRIMITIVES:
+            return type_name.capitalize()
+        if compact and type_name in self.compact:
+            return "Compact" + type_name
+        return type_name
+
+    def codec_lines(self, run, owner, compact, decode):
+        """Lines encoding or decoding a run of fields of owner"""
+        verb, cursor = ("Decode", "in") if decode else ("Encode", "out")
+        field = run[0]
+        if compact and field.quantization == "uint32":
+            return [f"{cursor} = {verb}DoubleAsUint32({cursor}, {owner}.{field.name}, {field.step});"]
+        if compact and field.quantization:
+            count = sum(self.field_doubles(item) for item in run)
+            step = f", {field.step}" if field.step else ""
+            kernel = f"{verb}DoublesAs{field.quantization.capitalize()}"
+            return [f"{cursor} = {kernel}({cursor}, &{owner}.{field.name}, {count}{step});"]
+        codec = self.codec_call(field.type_name, compact)
+        return [f"{cursor} = {verb}{codec}({cursor}, {element});" for element in self.elements(field, owner)]
+
+    def layout_checks(self, owner, items):
+        """static_asserts that the runs converted in one batch are contiguous doubles"""
+        for run in self.runs(items, True):
+            if isinstance(run, Condition):
+                self.layout_checks(owner, run.items)
+                continue
+            if run[0].quantization not in ("float", "int16"):
+                continue
+            offset = 0
+            for field in run:
+                if field.type_name != "double" and field.type_name not in self.layouts:
+                    self.layouts.add(field.type_name)
+                    doubles = self.element_doubles(field.type_name)
+                    self.emit(
+                        f"static_assert(sizeof({field.type_name}) == {doubles} * sizeof(double), "
+                        f'"{field.type_name} must be {doubles} doubles without padding to be quantized in one batch");'
+                    )
+                if offset:
+                    size = "sizeof(double)" if offset == 1 else f"{offset} * sizeof(double)"
+                    self.emit(
+                        f"static_assert(offsetof({owner}, {field.name}) == offsetof({owner}, {run[0].name}) + "
+                        f'{size},\n              "{owner}::{run[0].name} to {field.name} must be '
+                        f'contiguous to be quantized in one batch");'
+                    )
+                offset += self.field_doubles(field)
+
+    def check(self, definition):
+        names = set()
+        for field in self.fields(definition.items):
+            if field.name in names:
+                raise SchemaError(f"line {field.line}: duplicate field '{field.name}'")
+            names.add(field.name)
+        if definition.kind == "bits":
+            for field in definition.items:
+                if field.type_name != "bool":
+                    raise SchemaError(f"line {field.line}: bits only hold bool fields")
+        self.check_conditions(definition.items, {})
+
+        for field in self.fields(definition.items):
+            if not field.quantization:
+                continue
+            if self.element_doubles(field.type_name) is None:
+                raise SchemaError(f"line {field.line}: '~' only applies to doubles and structs of doubles")
+            if field.quantization == "uint32" and (field.type_name != "double" or field.count is not None):
+                raise SchemaError(f"line {field.line}: '~ uint32' only applies to a single double")
+        if definition.kind == "struct":
+            doubles = [self.element_doubles(field.type_name) for field in definition.items]
+            if None not in doubles:
+                self.doubles[definition.name] = sum(
+                    count * (field.count or 1) for count, field in zip(doubles, definition.items)
+                )
+            if any(field.quantization or field.type_name in self.compact for field in definition.items):
+                self.compact.add(definition.name)
+
+    def check_conditions(self, items, known):
+        known = dict(known)
+        for item in items:
+            if isinstance(item, Condition):
+                if known.get(item.field) != "bool":
+                    raise SchemaError(f"line {item.line}: 'if {item.field}' needs a bool field before it")
+                self.check_conditions(item.items, known)
+            elif item.count is None:
+                known[item.name] = item.type_name
+
+    def primitives(self):
+        self.emit("// Encoders and decoders of the primitive types, they return the position right after the value")
+        for type_name, (cpp_type, size) in PRIMITIVES.items():
+            name = self.codec_call(type_name)
+            if type_name == "bool":
+                self.emit(f"inline uint8_t *Encode{name}(uint8_t *out, bool value)")
+                self.emit("{")
+                self.emit("    *out = value ? 1 : 0;")
+                self.emit("    return out + 1;")
+                self.emit("}")
+                self.emit(f"inline const uint8_t *Decode{name}(const uint8_t *in, bool &value)")
+                self.emit("{")
+                self.emit("    value = *in != 0;")
+                self.emit("    return in + 1;")
+                self.emit("}")
+                continue
+            self.emit(f"inline uint8_t *Encode{name}(uint8_t *out, {cpp_type} value)")
+            self.emit("{")
+            self.emit(f"    std::memcpy(out, &value, {size});")
+            self.emit(f"    return out + {size};")
+            self.emit("}")
+            self.emit(f"inline const uint8_t *Decode{name}(const uint8_t *in, {cpp_type} &value)")
+            self.emit("{")
+            self.emit(f"    std::memcpy(&value, in, {size});")
+            self.emit(f"    return in + {size};")
+            self.emit("}")
+        self.emit()
+
+    def struct(self, definition):
+        name = definition.name
+        size = self.block_size(definition.items)[0]
+        self.sizes[name] = size
+        self.compact_sizes[name] = self.block_size(definition.items, True)[0]
+        self.emit(f"// {name}")
+        self.emit(f"constexpr size_t {constant_name(name)}_WIRE_SIZE = {size};")
+        self.struct_codecs(definition, False)
+        self.fixed_wire_format(name)
+        if name in self.compact:
+            self.emit(f"// {name} in the compact encoding")
+            self.emit(f"constexpr size_t {constant_name(name)}_COMPACT_WIRE_SIZE = {self.compact_sizes[name]};")
+            self.layout_checks(name, definition.items)
+            self.struct_codecs(definition, True)
+            self.emit()
+
+    def struct_codecs(self, definition, compact):
+        name = definition.name
+        codec = self.codec_call(name, compact)
+        self.emit(f"inline uint8_t *Encode{codec}(uint8_t *out, const {name} &value)")
+        self.emit("{")
+        for run in self.runs(definition.items, compact):
+            for line in self.codec_lines(run, "value", compact, False):
+                self.emit(f"    {line}")
+        self.emit("    return out;")
+        self.emit("}")
+        self.emit(f"inline const uint8_t *Decode{codec}(const uint8_t *in, {name} &value)")
+        self.emit("{")
+        for run in self.runs(definition.items, compact):
+            for line in self.codec_lines(run, "value", compact, True):
+                self.emit(f"    {line}")
+        self.emit("    return in;")
+        self.emit("}")
+
+    def bits(self, definition):
+        name = definition.name
+        bits = [element for field in definition.items for element in self.elements(field, "value")]
+        size = (len(bits) + 7) // 8
+        self.sizes[name] = size
+        self.compact_sizes[name] = size
+        self.emit(f"// {name}, {len(bits)} bits packed into {size} bytes")
+        self.emit(f"constexpr size_t {constant_name(name)}_WIRE_SIZE = {size};")
+        self.emit(f"inline uint8_t *Encode{name}(uint8_t *out, const {name} &value)")
+        self.emit("{")
+        for byte in range(size):
+            terms = [f"{bit} << {i}" for i, bit in enumerate(bits[byte * 8 : byte * 8 + 8])]
+            self.emit(f"    out[{byte}] = static_cast<uint8_t>({(' |' + chr(10) + ' ' * 32).join(terms)});")
+        self.emit(f"    return out + {size};")
+        self.emit("}")
+        self.emit(f"inline const uint8_t *Decode{name}(const uint8_t *in, {name} &value)")
+        self.emit("{")
+        for index, bit in enumerate(bits):
+            self.emit(f"    {bit} = (in[{index // 8}] >> {index % 8}) & 1;")
+        self.emit(f"    return in + {size};")
+        self.emit("}")
+        self.fixed_wire_format(name)
+
+    def fixed_wire_format(self, name):
+        self.emit(f"template <> struct WireFormat<{name}>")
+        self.emit("{")
+        self.emit(f"    static constexpr size_t SIZE = {constant_name(name)}_WIRE_SIZE;")
+        self.emit(f"    static uint8_t *Encode(uint8_t *out, const {name} &value)")
+        self.emit("    {")
+        self.emit(f"        return Encode{name}(out, value);")
+        self.emit("    }")
+        self.emit(f"    static const uint8_t *Decode(const uint8_t *in, {name} &value)")
+        self.emit("    {")
+        self.emit(f"        return Decode{name}(in, value);")
+        self.emit("    }")
+        self.emit("};")
+        self.emit()
+
+    def size_expression(self, items, compact):
+        terms = [str(self.block_size(items, compact)[0])]
+        for item in items:
+            if isinstance(item, Condition):
+                terms.append(f"(packet.{item.field} ? {self.size_expression(item.items, compact)} : 0)")
+        return " + ".join(terms) if len(terms) > 1 else terms[0]
+
+    def encode_items(self, items, indent, compact):
+        pad = " " * indent
+        for run in self.runs(items, compact):
+            if isinstance(run, Condition):
+                self.emit(f"{pad}if (packet.{run.field})")
+                self.emit(f"{pad}{{")
+                self.encode_items(run.items, indent + 4, compact)
+                self.emit(f"{pad}}}")
+                continue
+            for line in self.codec_lines(run, "packet", compact, False):
+                self.emit(f"{pad}{line}")
+
+    def decode_items(self, items, indent, compact):
+        pad = " " * indent
+        for run in self.runs(items, compact):
+            if isinstance(run, Condition):
+                size = self.block_size(run.items, compact)[0]
+                self.emit(f"{pad}if (packet.{run.field})")
+                self.emit(f"{pad}{{")
+                self.emit(f"{pad}    if (size - static_cast<size_t>(in - start) < {size})")
+                self.emit(f"{pad}        return 0;")
+                self.decode_items(run.items, indent + 4, compact)
+                self.emit(f"{pad}}}")
+                continue
+            for line in self.codec_lines(run, "packet", compact, True):
+                self.emit(f"{pad}{line}")
+
+    def packet(self, definition):
+        name = definition.cpp_name
+        prefix = constant_name(name)
+        always, biggest = self.block_size(definition.items)
+        if always == 0:
+            raise SchemaError(f"line {definition.line}: packets need at least one field that is always encoded")
+        if biggest > 255:
+            raise SchemaError(f"line {definition.line}: {name} can be {biggest} bytes, the length field is one byte")
+
+        self.emit(f"// {name}, sent with PacketId::{definition.name}")
+        self.emit(
+            f"static_assert(static_cast<int>(PacketId::{definition.name}) == {definition.packet_id}, "
+            f'"PacketId::{definition.name} does not match the schema");'
+        )
+        self.emit(f"constexpr size_t {prefix}_MIN_SIZE = {always};")
+        self.emit(f"constexpr size_t {prefix}_MAX_SIZE = {biggest};")
+        compact_always, compact_biggest = self.block_size(definition.items, True)
+        self.emit(f"constexpr size_t {prefix}_COMPACT_MIN_SIZE = {compact_always};")
+        self.emit(f"constexpr size_t {prefix}_COMPACT_MAX_SIZE = {compact_biggest};")
+        self.packet_codecs(definition, False)
+        self.layout_checks(name, definition.items)
+        self.packet_codecs(definition, True)
+        self.emit(f"template <> struct WireFormat<{name}>")
+        self.emit("{")
+        self.emit(f"    static constexpr size_t MIN_SIZE = {prefix}_MIN_SIZE;")
+        self.emit(f"    static constexpr size_t MAX_SIZE = {prefix}_MAX_SIZE;")
+        self.emit(f"    static constexpr size_t COMPACT_MIN_SIZE = {prefix}_COMPACT_MIN_SIZE;")
+        self.emit(f"    static constexpr size_t COMPACT_MAX_SIZE = {prefix}_COMPACT_MAX_SIZE;")
+        self.emit(f"    static size_t Size(const {name} &packet)")
+        self.emit("    {")
+        self.emit("        return EncodedSize(packet);")
+        self.emit("    }")
+        self.emit(f"    static size_t CompactSize(const {name} &packet)")
+        self.emit("    {")
+        self.emit("        return CompactEncodedSize(packet);")
+        self.emit("    }")
+        self.emit("};")
+        self.emit()
+
+    def packet_codecs(self, definition, compact):
+        name = definition.cpp_name
+        prefix = constant_name(name) + ("_COMPACT" if compact else "")
+        variant = "Compact" if compact else ""
+        conditional = any(isinstance(item, Condition) for item in definition.items)
+        self.emit(f"inline size_t {variant}EncodedSize(const {name} &{'packet' if conditional else ''})")
+        self.emit("{")
+        self.emit(f"    return {self.size_expression(definition.items, compact)};")
+        self.emit("}")
+        self.emit(f"inline size_t Encode{variant}Packet(const {name} &packet, uint8_t *out, size_t capacity)")
+        self.emit("{")
+        self.emit(f"    const size_t size = {variant}EncodedSize(packet);")
+        self.emit("    if (size > capacity)")
+        self.emit("        return 0;")
+        self.encode_items(definition.items, 4, compact)
+        self.emit("    return size;")
+        self.emit("}")
+        self.emit(f"inline size_t Decode{variant}Packet(const uint8_t *in, size_t size, {name} &packet)")
+        self.emit("{")
+        self.emit(f"    if (size < {prefix}_MIN_SIZE)")
+        self.emit("        return 0;")
+        self.emit("    const uint8_t *start = in;")
+        self.decode_items(definition.items, 4, compact)
+        self.emit("    return static_cast<size_t>(in - start);")
+        self.emit("}")
+
+    def traits(self, packets):
+        self.emit("// Compile-time mapping between packet IDs, packet structs and their codecs, see PacketRegistry.h")
+        self.emit("template <typename T> struct PacketTraits;")
+        self.emit("template <PacketId Id> struct PacketType;")
+        self.emit()
+        for definition in packets:
+            name = definition.cpp_name
+            self.emit(f"template <> struct PacketTraits<{name}>")
+            self.emit("{")
+            self.emit(f"    static constexpr PacketId ID = PacketId::{definition.name};")
+            self.emit(f"    static constexpr size_t MAX_SIZE = WireFormat<{name}>::MAX_SIZE;")
+            self.emit()
+            self.emit("    template <typename Writer>")
+            self.emit(
+                f"    static bool Write(Writer &payload, const {name} &packet, WireEncoding encoding = WireEncoding::FULL)"
+            )
+            self.emit("    {")
+            self.emit("        return payload.WritePacket(packet, encoding);")
+            self.emit("    }")
+            self.emit()
+            self.emit("    template <typename Reader>")
+            self.emit(f"    static bool Read(Reader &payload, {name} &packet, WireEncoding encoding = WireEncoding::FULL)")
+            self.emit("    {")
+            self.emit("        return payload.ReadPacket(packet, encoding);")
+            self.emit("    }")
+            self.emit("};")
+            self.emit()
+            self.emit(f"template <> struct PacketType<PacketId::{definition.name}>")
+            self.emit("{")
+            self.emit(f"    using Type = {name};")
+            self.emit("};")
+            self.emit()
+
+    def generate(self, hash_value, schema_name):
+        names = set()
+        packet_ids = set()
+        for definition in self.definitions:
+            if definition.cpp_name in names:
+                raise SchemaError(f"line {definition.line}: '{definition.cpp_name}' is defined twice")
+            names.add(definition.cpp_name)
+            if definition.kind == "packet":
+                if definition.packet_id in packet_ids:
+                    raise SchemaError(f"line {definition.line}: packet ID {definition.packet_id} is used twice")
+                packet_ids.add(definition.packet_id)
+            self.check(definition)
+
+        self.emit(f"// Generated by tools/generate_packets.py from {schema_name}, do not edit.")
+        self.emit(
+            "// Regenerate it with the packet_codecs target after changing the schema, and commit it along with the schema."
+        )
+        self.emit()
+        self.emit("#ifndef PACKET_CODECS_H")
+        self.emit("#define PACKET_CODECS_H")
+        self.emit()
+        self.emit("#ifndef ARDUINO")
+        self.emit('#include "Packets.h"')
+        self.emit('#include "Quantize.h"')
+        self.emit("#endif // ARDUINO")
+        self.emit()
+        self.emit("#include <cstddef> // For size_t, offsetof")
+        self.emit("#include <cstdint> // For uint8_t")
+        self.emit("#include <cstring> // For memcpy")
+        self.emit()
+        self.emit("// Hash of the schema, both ends of a link must have the same")
+        self.emit(f"constexpr uint32_t PACKET_SCHEMA_HASH = 0x{hash_value:08X};")
+        self.emit()
+        self.emit("// How the packets are encoded on a link, both ends must use the same, see UART::SetEncoding()")
+        self.emit("enum class WireEncoding")
+        self.emit("{")
+        self.emit("    FULL,    // Every field as it is in memory")
+        self.emit("    COMPACT, // The fields marked with '~' in the schema quantized, see Quantize.h")
+        self.emit("};")
+        self.emit()
+        self.emit("// Compile-time wire format of the structs and packets of the schema:")
+        self.emit("//  - structs: SIZE, and Encode() and Decode(), which return the position right after the value")
+        self.emit("//  - packets: MIN_SIZE, MAX_SIZE, and Size() of a given packet, and the same for the compact encoding")
+        self.emit("template <typename T> struct WireFormat;")
+        self.emit()
+        self.primitives()
+
+        self.emit("// Encoders and decoders of the structs, the caller checks the size")
+        self.emit()
+        for definition in self.definitions:
+            if definition.kind == "struct":
+                self.struct(definition)
+            elif definition.kind == "bits":
+                self.bits(definition)
+
+        self.emit("// Encoders and decoders of the packets, with a single size check per conditional section.")
+        self.emit("// EncodePacket() returns the number of bytes written, or 0 if they do not fit in capacity.")
+        self.emit("// DecodePacket() returns the number of bytes read, or 0 if size is too short for the packet.")
+        self.emit("// EncodeCompactPacket() and DecodeCompactPacket() do the same with the compact encoding.")
+        self.emit()
+        packets = [definition for definition in self.definitions if definition.kind == "packet"]
+        for definition in packets:
+            self.packet(definition)
+
+        self.traits(packets)
+        self.emit("#endif // PACKET_CODECS_H")
+        return "\n".join(self.lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the packet codecs from the schema")
+    parser.add_argument("--schema", type=Path, default=ROOT / "schema" / "packets.schema")
+    parser.add_argument("--output", type=Path, default=ROOT / "inc" / "PacketCodecs.h")
+    parser.add_argument("--check", action="store_true", help="only check that the output is up to date")
+    args = parser.parse_args()
+
+    try:
+        definitions, canonical = parse(args.schema.read_text())
+        header = Generator(definitions).generate(schema_hash(canonical), "schema/" + args.schema.name)
+    except SchemaError as error:
+        print(f"{args.schema}: {error}", file=sys.stderr)
+        return 1
+
+    current = args.output.read_text() if args.output.exists() else None
+    if args.check:
+        if current != header:
+            print(f"{args.output} is out of date, run {Path(__file__).name}", file=sys.stderr)
+            return 1
+        return 0
+
+    # Keep the timestamp of an unchanged header, so that nothing gets rebuilt
+    if current != header:
+        args.output.write_text(header)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())